@@ -0,0 +1,110 @@
+#include "src/common.h"
+#include "src/error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Insert, lookup and delete microbenchmark of `pyg_hashmap_t` */
+
+static const unsigned int kPygBenchDefaultCount = 1000000;
+
+static double pyg_bench_now(void);
+static void pyg_bench_report(const char* name,
+                             unsigned int count,
+                             double start);
+
+
+double pyg_bench_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+void pyg_bench_report(const char* name, unsigned int count, double start) {
+  double elapsed;
+
+  elapsed = pyg_bench_now() - start;
+  fprintf(stdout,
+          "%-8s %8u keys %8.3f ms %8.1f ns/op\n",
+          name,
+          count,
+          elapsed * 1e3,
+          elapsed * 1e9 / count);
+}
+
+
+int main(int argc, char** argv) {
+  pyg_error_t err;
+  pyg_hashmap_t map;
+  unsigned int count;
+  unsigned int i;
+  unsigned int found;
+  char* keys;
+  double start;
+
+  count = argc > 1 ? (unsigned int) atoi(argv[1]) : kPygBenchDefaultCount;
+
+  /* Fixed-size NUL-terminated keys, `key:<n>` */
+  keys = malloc(count * 16);
+  if (keys == NULL)
+    return 1;
+  for (i = 0; i < count; i++)
+    snprintf(keys + i * 16, 16, "key:%u", i);
+
+  err = pyg_hashmap_init(&map, 16);
+  if (!pyg_is_ok(err)) {
+    pyg_error_print(err, stderr);
+    return 1;
+  }
+
+  start = pyg_bench_now();
+  for (i = 0; i < count; i++) {
+    err = pyg_hashmap_cinsert(&map, keys + i * 16, keys + i * 16);
+    if (!pyg_is_ok(err)) {
+      pyg_error_print(err, stderr);
+      return 1;
+    }
+  }
+  pyg_bench_report("insert", count, start);
+
+  start = pyg_bench_now();
+  for (i = 0, found = 0; i < count; i++)
+    found += pyg_hashmap_cget(&map, keys + i * 16) == keys + i * 16;
+  pyg_bench_report("hit", count, start);
+  if (found != count) {
+    fprintf(stderr, "Lost %u keys\n", count - found);
+    return 1;
+  }
+
+  /* Same keys with different prefix */
+  for (i = 0; i < count; i++)
+    keys[i * 16] = 'K';
+  start = pyg_bench_now();
+  for (i = 0, found = 0; i < count; i++)
+    found += pyg_hashmap_cget(&map, keys + i * 16) != NULL;
+  pyg_bench_report("miss", count, start);
+  for (i = 0; i < count; i++)
+    keys[i * 16] = 'k';
+
+  start = pyg_bench_now();
+  for (i = 0; i < count; i += 2)
+    pyg_hashmap_cdelete(&map, keys + i * 16);
+  pyg_bench_report("delete", count / 2, start);
+
+  start = pyg_bench_now();
+  for (i = 0, found = 0; i < count; i++)
+    found += pyg_hashmap_cget(&map, keys + i * 16) != NULL;
+  pyg_bench_report("mixed", count, start);
+  if (found != count / 2) {
+    fprintf(stderr, "Expected %u keys, found %u\n", count / 2, found);
+    return 1;
+  }
+
+  pyg_hashmap_destroy(&map);
+  free(keys);
+  return 0;
+}
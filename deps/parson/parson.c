@@ -32,22 +32,44 @@
 #include <ctype.h>
 #include <math.h>
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PARSON_USE_MMAP
+#endif
+
 #define STARTING_CAPACITY         15
 #define ARRAY_MAX_CAPACITY    122880 /* 15*(2^13) */
-#define OBJECT_MAX_CAPACITY      960 /* 15*(2^6)  */
+#define OBJECT_MAX_CAPACITY   122880 /* 15*(2^13) */
+#define OBJECT_INDEX_THRESHOLD    16 /* objects with more names are hashed */
 #define MAX_NESTING               19
 #define DOUBLE_SERIALIZATION_FORMAT "%f"
 
 #define SIZEOF_TOKEN(a)       (sizeof(a) - 1)
-#define SKIP_CHAR(str)        ((*str)++)
-#define SKIP_WHITESPACES(str) while (isspace(**str)) { SKIP_CHAR(str); }
-#define SKIP_COMMAS(str)                                                      \
-  while (isspace(**str) || **str == ',') { SKIP_CHAR(str); }
+#define SKIP_CHAR(parser)     ((parser)->string++)
 #define MAX(a, b)             ((a) > (b) ? (a) : (b))
 
-#define PARSON_MALLOC(a)     malloc(a)
-#define PARSON_FREE(a)       free((void*)(a))
-#define PARSON_REALLOC(a, b) realloc((a), (b))
+/* Value flags */
+#define VALUE_BORROWED        0x1 /* string points into a parsed buffer */
+#define VALUE_DOCUMENT        0x2 /* value is JSON_Document, owns the buffer */
+
+#if defined(_MSC_VER)
+#define PARSON_THREAD_LOCAL  __declspec(thread)
+#else
+#define PARSON_THREAD_LOCAL  __thread
+#endif
+
+/* Allocation functions are per-thread, NULL parson_free - memory is reclaimed
+   by the owner in bulk */
+static PARSON_THREAD_LOCAL JSON_Malloc_Function parson_malloc = malloc;
+static PARSON_THREAD_LOCAL JSON_Free_Function parson_free = free;
+static PARSON_THREAD_LOCAL JSON_Intern_Function parson_intern = NULL;
+
+#define PARSON_MALLOC(a)     parson_malloc(a)
+#define PARSON_FREE(a)       do { if (parson_free != NULL) parson_free((void*)(a)); } while (0)
+#define PARSON_DEFAULT_ALLOCATOR() (parson_malloc == malloc && parson_free == free)
 
 #define PRINT_AND_SKIP(str, to_append) str += sprintf(str, to_append);
 #define PRINTF_AND_SKIP(str, format, to_append) str += sprintf(str, format, to_append);
@@ -64,16 +86,46 @@ typedef union json_value_value {
 
 struct json_value_t {
     JSON_Value_Type     type;
+    int                 flags;
     JSON_Value_Value    value;
 };
 
+/* Slot of the object's name index, open addressing with linear probing */
+typedef struct json_object_slot_t {
+    unsigned int hash;
+    unsigned int position; /* index in names/values + 1, 0 - empty slot */
+} JSON_Object_Slot;
+
 struct json_object_t {
     const char **names;
     JSON_Value **values;
     size_t       count;
     size_t       capacity;
+    /* NULL while capacity is below OBJECT_INDEX_THRESHOLD, power of two size */
+    JSON_Object_Slot *index;
+    size_t       index_size;
+    /* Names within this range are borrowed from a parsed buffer */
+    const char  *borrowed_start;
+    const char  *borrowed_end;
+    /* Non-NULL - all names come from this function and are not owned */
+    JSON_Intern_Function intern;
 };
 
+/* Root of the tree parsed in place, owns the parsed buffer */
+typedef struct json_document_t {
+    JSON_Value   value;
+    char        *buffer;
+    size_t       alloc_size; /* of the mapping or allocation, for unmap_file */
+    int          mapped;
+} JSON_Document;
+
+typedef struct json_parser_t {
+    const char  *string;
+    int          comments; /* skip comments along with whitespace */
+    char        *buffer;   /* non-NULL - unescape strings in place and borrow them */
+    size_t       size;
+} JSON_Parser;
+
 struct json_array_t {
     JSON_Value **items;
     size_t       count;
@@ -81,11 +133,13 @@ struct json_array_t {
 };
 
 /* Various */
-static char * read_file(const char *filename);
-static void   remove_comments(char *string, const char *start_token, const char *end_token);
-static int    try_realloc(void **ptr, size_t new_size);
+static char * read_file(const char *filename, size_t *size, size_t *alloc_size);
+static char * map_file(const char *filename, size_t *size, size_t *alloc_size, int *mapped);
+static void   unmap_file(char *buffer, size_t size, int mapped);
+static int    try_realloc(void **ptr, size_t old_size, size_t new_size);
 static char * parson_strndup(const char *string, size_t n);
 static char * parson_strdup(const char *string);
+static unsigned int hash_string(const char *string, size_t n);
 static int    is_utf(const unsigned char *string);
 static int    is_decimal(const char *string, size_t length);
 static size_t parson_strlen(const char *string);
@@ -93,9 +147,15 @@ static size_t parson_strlen(const char *string);
 /* JSON Object */
 static JSON_Object * json_object_init(void);
 static JSON_Status   json_object_add(JSON_Object *object, const char *name, JSON_Value *value);
+static JSON_Status   json_object_append(JSON_Object *object, const char *name, int interned, JSON_Value *value);
 static JSON_Status   json_object_resize(JSON_Object *object, size_t capacity);
+static JSON_Status   json_object_resize_index(JSON_Object *object, size_t capacity);
+static void          json_object_reindex(JSON_Object *object);
+static void          json_object_index_add(JSON_Object *object, size_t position);
+static size_t        json_object_find(const JSON_Object *object, const char *name, size_t n, int interned);
 static JSON_Value  * json_object_nget_value(const JSON_Object *object, const char *name, size_t n);
 static void          json_object_free(JSON_Object *object);
+static int           json_object_owns_name(const JSON_Object *object, const char *name);
 
 /* JSON Array */
 static JSON_Array * json_array_init(void);
@@ -107,17 +167,22 @@ static void         json_array_free(JSON_Array *array);
 static JSON_Value * json_value_init_string_no_copy(const char *string);
 
 /* Parser */
+static void         skip_whitespaces(JSON_Parser *parser);
+static void         skip_commas(JSON_Parser *parser);
 static void         skip_quotes(const char **string);
 static int          parse_utf_16(const char **unprocessed, char **processed);
-static char*        process_string(const char *input, size_t len);
-static const char * get_quoted_string(const char **string);
-static JSON_Value * parse_object_value(const char **string, size_t nesting);
-static JSON_Value * parse_array_value(const char **string, size_t nesting);
-static JSON_Value * parse_string_value(const char **string);
-static JSON_Value * parse_boolean_value(const char **string);
-static JSON_Value * parse_number_value(const char **string);
-static JSON_Value * parse_null_value(const char **string);
-static JSON_Value * parse_value(const char **string, size_t nesting);
+static char*        process_string(const char *input, size_t len, char *output);
+static char*        copy_processed_string(const char *input, size_t len);
+static const char * get_quoted_string(JSON_Parser *parser);
+static JSON_Value * parse_object_value(JSON_Parser *parser, size_t nesting);
+static JSON_Value * parse_array_value(JSON_Parser *parser, size_t nesting);
+static JSON_Value * parse_string_value(JSON_Parser *parser);
+static JSON_Value * parse_boolean_value(JSON_Parser *parser);
+static JSON_Value * parse_number_value(JSON_Parser *parser);
+static JSON_Value * parse_null_value(JSON_Parser *parser);
+static JSON_Value * parse_value(JSON_Parser *parser, size_t nesting);
+static JSON_Value * parse_root(JSON_Parser *parser);
+static JSON_Value * parse_buffer(char *buffer, size_t size, void *arg);
 
 /* Serialization */
 static size_t json_serialization_size_r(const JSON_Value *value, char *buf);
@@ -125,15 +190,31 @@ static char * json_serialize_to_buffer_r(const JSON_Value *value, char *buf);
 static char * json_serialize_string(const char *string, char *buf);
 
 /* Various */
-static int try_realloc(void **ptr, size_t new_size) {
+static int try_realloc(void **ptr, size_t old_size, size_t new_size) {
     void *reallocated_ptr = NULL;
     if (new_size == 0) {
         return JSONFailure;
     }
-    reallocated_ptr = PARSON_REALLOC(*ptr, new_size);
+    if (PARSON_DEFAULT_ALLOCATOR()) {
+        reallocated_ptr = realloc(*ptr, new_size);
+        if (reallocated_ptr == NULL) {
+            return JSONFailure;
+        }
+        *ptr = reallocated_ptr;
+        return JSONSuccess;
+    }
+    /* Shrinking would not give anything back to bulk allocator */
+    if (parson_free == NULL && new_size <= old_size) {
+        return JSONSuccess;
+    }
+    reallocated_ptr = PARSON_MALLOC(new_size);
     if (reallocated_ptr == NULL) {
         return JSONFailure;
     }
+    if (*ptr != NULL) {
+        memcpy(reallocated_ptr, *ptr, old_size < new_size ? old_size : new_size);
+        PARSON_FREE(*ptr);
+    }
     *ptr = reallocated_ptr;
     return JSONSuccess;
 }
@@ -151,6 +232,16 @@ static char * parson_strdup(const char *string) {
     return parson_strndup(string, strlen(string));
 }
 
+/* FNV-1a */
+static unsigned int hash_string(const char *string, size_t n) {
+    unsigned int hash = 2166136261U;
+    while (n--) {
+        hash ^= (unsigned char)*string++;
+        hash *= 16777619U;
+    }
+    return hash & 0xffffffffU;
+}
+
 static int is_utf(const unsigned char *s) {
     return isxdigit(s[0]) && isxdigit(s[1]) && isxdigit(s[2]) && isxdigit(s[3]);
 }
@@ -178,7 +269,8 @@ static size_t parson_strlen(const char *string) {
     return result;
 }
 
-static char * read_file(const char * filename) {
+/* `size` is the length of the contents, without the trailing zero */
+static char * read_file(const char * filename, size_t *size, size_t *alloc_size) {
     FILE *fp = fopen(filename, "r");
     size_t file_size;
     char *file_contents;
@@ -201,38 +293,53 @@ static char * read_file(const char * filename) {
     }
     fclose(fp);
     file_contents[file_size] = '\0';
+    *size = file_size;
+    *alloc_size = file_size + 1;
     return file_contents;
 }
 
-static void remove_comments(char *string, const char *start_token, const char *end_token) {
-    int in_string = 0, escaped = 0;
-    size_t i;
-    char *ptr = NULL, current_char;
-    size_t start_token_len = strlen(start_token);
-    size_t end_token_len = strlen(end_token);
-    if (start_token_len == 0 || end_token_len == 0)
-    	return;
-    while ((current_char = *string) != '\0') {
-        if (current_char == '\\' && !escaped) {
-            escaped = 1;
-            string++;
-            continue;
-        } else if ((current_char == '\"' || current_char == '\'') && !escaped) {
-            in_string = !in_string;
-        } else if (!in_string && strncmp(string, start_token, start_token_len) == 0) {
-			for(i = 0; i < start_token_len; i++)
-                string[i] = ' ';
-        	string = string + start_token_len;
-            ptr = strstr(string, end_token);
-            if (!ptr)
-                return;
-            for (i = 0; i < (ptr - string) + end_token_len; i++)
-                string[i] = ' ';
-          	string = ptr + end_token_len - 1;
-        }
-        escaped = 0;
-        string++;
+/* Maps file privately, so that strings could be unescaped in place without
+   touching the file. Falls back to read_file() when there is no room for the
+   trailing zero in the last page. */
+static char * map_file(const char *filename, size_t *size, size_t *alloc_size, int *mapped) {
+#ifdef PARSON_USE_MMAP
+    int fd;
+    struct stat st;
+    long page_size;
+    void *map;
+    fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
     }
+    page_size = sysconf(_SC_PAGESIZE);
+    if (st.st_size > 0 && page_size > 0 && (st.st_size % page_size) != 0) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+            return NULL;
+        *size = (size_t)st.st_size;
+        *alloc_size = *size;
+        *mapped = 1;
+        return (char*)map;
+    }
+    close(fd);
+#endif
+    *mapped = 0;
+    return read_file(filename, size, alloc_size);
+}
+
+static void unmap_file(char *buffer, size_t size, int mapped) {
+#ifdef PARSON_USE_MMAP
+    if (mapped) {
+        munmap(buffer, size);
+        return;
+    }
+#endif
+    PARSON_FREE(buffer);
 }
 
 /* JSON Object */
@@ -244,10 +351,23 @@ static JSON_Object * json_object_init(void) {
     new_obj->values = (JSON_Value**)NULL;
     new_obj->capacity = 0;
     new_obj->count = 0;
+    new_obj->index = NULL;
+    new_obj->index_size = 0;
+    new_obj->borrowed_start = NULL;
+    new_obj->borrowed_end = NULL;
+    new_obj->intern = parson_intern;
     return new_obj;
 }
 
 static JSON_Status json_object_add(JSON_Object *object, const char *name, JSON_Value *value) {
+    if (json_object_find(object, name, strlen(name), 0) != object->count)
+        return JSONFailure;
+    return json_object_append(object, name, 0, value);
+}
+
+/* Adds name without checking for duplicates, `interned` - name comes from
+   the intern function of the object already */
+static JSON_Status json_object_append(JSON_Object *object, const char *name, int interned, JSON_Value *value) {
     size_t index;
     if (object->count >= object->capacity) {
         size_t new_capacity = MAX(object->capacity * 2, STARTING_CAPACITY);
@@ -256,45 +376,123 @@ static JSON_Status json_object_add(JSON_Object *object, const char *name, JSON_V
         if (json_object_resize(object, new_capacity) == JSONFailure)
             return JSONFailure;
     }
-    if (json_object_get_value(object, name) != NULL)
-        return JSONFailure;
     index = object->count;
-    object->names[index] = parson_strdup(name);
+    if (object->intern != NULL)
+        object->names[index] = interned ? name : object->intern(name, strlen(name));
+    /* Names from the buffer of in-place parsed tree are borrowed */
+    else if (json_object_owns_name(object, name))
+        object->names[index] = parson_strdup(name);
+    else
+        object->names[index] = name;
     if (!object->names[index])
         return JSONFailure;
     object->values[index] = value;
     object->count++;
+    if (object->index != NULL)
+        json_object_index_add(object, index);
     return JSONSuccess;
 }
 
 static JSON_Status json_object_resize(JSON_Object *object, size_t capacity) {
-    if (try_realloc((void**)&object->names, capacity * sizeof(char*)) == JSONFailure)
+    if (try_realloc((void**)&object->names, object->capacity * sizeof(char*), capacity * sizeof(char*)) == JSONFailure)
         return JSONFailure;
-    if (try_realloc((void**)&object->values, capacity * sizeof(JSON_Value*)) == JSONFailure)
+    if (try_realloc((void**)&object->values, object->capacity * sizeof(JSON_Value*), capacity * sizeof(JSON_Value*)) == JSONFailure)
         return JSONFailure;
     object->capacity = capacity;
+    if (capacity >= OBJECT_INDEX_THRESHOLD)
+        return json_object_resize_index(object, capacity);
     return JSONSuccess;
 }
 
-static JSON_Value * json_object_nget_value(const JSON_Object *object, const char *name, size_t n) {
-    size_t i, name_length;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        name_length = strlen(object->names[i]);
-        if (name_length != n)
+/* Index is kept at most half full */
+static JSON_Status json_object_resize_index(JSON_Object *object, size_t capacity) {
+    JSON_Object_Slot *index = NULL;
+    size_t size = 1;
+    while (size < capacity * 2)
+        size <<= 1;
+    if (size <= object->index_size)
+        return JSONSuccess;
+    index = (JSON_Object_Slot*)PARSON_MALLOC(size * sizeof(JSON_Object_Slot));
+    if (index == NULL)
+        return JSONFailure;
+    PARSON_FREE(object->index);
+    object->index = index;
+    object->index_size = size;
+    json_object_reindex(object);
+    return JSONSuccess;
+}
+
+static void json_object_reindex(JSON_Object *object) {
+    size_t i;
+    memset(object->index, 0, object->index_size * sizeof(JSON_Object_Slot));
+    for (i = 0; i < object->count; i++)
+        json_object_index_add(object, i);
+}
+
+static void json_object_index_add(JSON_Object *object, size_t position) {
+    const char *name = object->names[position];
+    unsigned int hash = hash_string(name, strlen(name));
+    size_t mask = object->index_size - 1;
+    size_t i;
+    for (i = hash & mask; object->index[i].position != 0; i = (i + 1) & mask);
+    object->index[i].hash = hash;
+    object->index[i].position = (unsigned int)(position + 1);
+}
+
+/* Returns position of the name or object->count if not found, `interned` -
+   name comes from the intern function of the object and is compared by
+   pointer */
+static size_t json_object_find(const JSON_Object *object, const char *name, size_t n, int interned) {
+    const JSON_Object_Slot *slot = NULL;
+    const char *candidate = NULL;
+    unsigned int hash;
+    size_t i, mask;
+    if (object->index == NULL) {
+        for (i = 0; i < object->count; i++) {
+            candidate = object->names[i];
+            if (interned ? candidate == name :
+                           strncmp(candidate, name, n) == 0 && candidate[n] == '\0')
+                return i;
+        }
+        return object->count;
+    }
+    hash = hash_string(name, n);
+    mask = object->index_size - 1;
+    for (i = hash & mask; object->index[i].position != 0; i = (i + 1) & mask) {
+        slot = &object->index[i];
+        if (slot->hash != hash)
             continue;
-        if (strncmp(object->names[i], name, n) == 0)
-            return object->values[i];
+        candidate = object->names[slot->position - 1];
+        if (interned ? candidate == name :
+                       strncmp(candidate, name, n) == 0 && candidate[n] == '\0')
+            return slot->position - 1;
     }
-    return NULL;
+    return object->count;
+}
+
+static JSON_Value * json_object_nget_value(const JSON_Object *object, const char *name, size_t n) {
+    size_t i;
+    if (object == NULL)
+        return NULL;
+    i = json_object_find(object, name, n, 0);
+    return i == object->count ? NULL : object->values[i];
+}
+
+static int json_object_owns_name(const JSON_Object *object, const char *name) {
+    if (object->intern != NULL)
+        return 0;
+    return name < object->borrowed_start || name >= object->borrowed_end;
 }
 
 static void json_object_free(JSON_Object *object) {
     while(object->count--) {
-        PARSON_FREE(object->names[object->count]);
+        if (json_object_owns_name(object, object->names[object->count]))
+            PARSON_FREE(object->names[object->count]);
         json_value_free(object->values[object->count]);
     }
     PARSON_FREE(object->names);
     PARSON_FREE(object->values);
+    PARSON_FREE(object->index);
     PARSON_FREE(object);
 }
 
@@ -323,7 +521,7 @@ static JSON_Status json_array_add(JSON_Array *array, JSON_Value *value) {
 }
 
 static JSON_Status json_array_resize(JSON_Array *array, size_t capacity) {
-    if (try_realloc((void**)&array->items, capacity * sizeof(JSON_Value*)) == JSONFailure)
+    if (try_realloc((void**)&array->items, array->capacity * sizeof(JSON_Value*), capacity * sizeof(JSON_Value*)) == JSONFailure)
         return JSONFailure;
     array->capacity = capacity;
     return JSONSuccess;
@@ -342,27 +540,59 @@ static JSON_Value * json_value_init_string_no_copy(const char *string) {
     if (!new_value)
         return NULL;
     new_value->type = JSONString;
+    new_value->flags = 0;
     new_value->value.string = string;
     return new_value;
 }
 
 /* Parser */
+static void skip_whitespaces(JSON_Parser *parser) {
+    const char *string = parser->string;
+    for (;;) {
+        while (isspace((unsigned char)*string))
+            string++;
+        if (!parser->comments)
+            break;
+        if (*string == '#' || (string[0] == '/' && string[1] == '/')) {
+            while (*string != '\0' && *string != '\n')
+                string++;
+        } else if (string[0] == '/' && string[1] == '*') {
+            string += 2;
+            while (*string != '\0' && !(string[0] == '*' && string[1] == '/'))
+                string++;
+            if (*string != '\0')
+                string += 2;
+        } else {
+            break;
+        }
+    }
+    parser->string = string;
+}
+
+static void skip_commas(JSON_Parser *parser) {
+    skip_whitespaces(parser);
+    while (*parser->string == ',') {
+        SKIP_CHAR(parser);
+        skip_whitespaces(parser);
+    }
+}
+
 static void skip_quotes(const char **string) {
     char quote;
 
     quote = **string;
-    SKIP_CHAR(string);
+    (*string)++;
     while (**string != quote) {
         if (**string == '\0')
             return;
         if (**string == '\\') {
-            SKIP_CHAR(string);
+            (*string)++;
             if (**string == '\0')
                 return;
         }
-        SKIP_CHAR(string);
+        (*string)++;
     }
-    SKIP_CHAR(string);
+    (*string)++;
 }
 
 static int parse_utf_16(const char **unprocessed, char **processed) {
@@ -405,11 +635,12 @@ static int parse_utf_16(const char **unprocessed, char **processed) {
 }
 
 
-/* Copies and processes passed string up to supplied length.
-Example: "\u006Corem ipsum" -> lorem ipsum */
-static char* process_string(const char *input, size_t len) {
+/* Processes passed string up to supplied length into output and returns
+pointer to its trailing zero. Output may be the same as input, unescaped
+string is never longer.
+Example: "lorem ipsum" -> lorem ipsum */
+static char* process_string(const char *input, size_t len, char *output) {
     const char *input_ptr = input;
-    char *output = (char*)PARSON_MALLOC((len + 1) * sizeof(char));
     char *output_ptr = output;
     while ((*input_ptr != '\0') && (size_t)(input_ptr - input) < len) {
         if (*input_ptr == '\\') {
@@ -426,13 +657,13 @@ static char* process_string(const char *input, size_t len) {
                 case 't':  *output_ptr = '\t'; break;
                 case 'u':
                     if (parse_utf_16(&input_ptr, &output_ptr) == JSONFailure)
-                        goto error;
+                        return NULL;
                     break;
                 default:
-                    goto error;
+                    return NULL;
             }
         } else if ((unsigned char)*input_ptr < 0x20) {
-            goto error; /* 0x00-0x19 are invalid characters for json string (http://www.ietf.org/rfc/rfc4627.txt) */
+            return NULL; /* 0x00-0x19 are invalid characters for json string (http://www.ietf.org/rfc/rfc4627.txt) */
         } else {
             *output_ptr = *input_ptr;
         }
@@ -440,170 +671,205 @@ static char* process_string(const char *input, size_t len) {
         input_ptr++;
     }
     *output_ptr = '\0';
-    if (try_realloc((void**)&output, strlen(output) + 1) == JSONFailure)
-        goto error;
+    return output_ptr;
+}
+
+/* Copies and processes passed string up to supplied length. */
+static char* copy_processed_string(const char *input, size_t len) {
+    char *output = (char*)PARSON_MALLOC((len + 1) * sizeof(char));
+    char *output_end = NULL;
+    if (output == NULL)
+        return NULL;
+    output_end = process_string(input, len, output);
+    if (output_end == NULL ||
+        try_realloc((void**)&output, len + 1, output_end - output + 1) == JSONFailure) {
+        PARSON_FREE(output);
+        return NULL;
+    }
     return output;
-error:
-    free(output);
-    return NULL;
 }
 
 /* Return processed contents of a string between quotes and
-   skips passed argument to a matching quote. */
-static const char * get_quoted_string(const char **string) {
-    const char *string_start = *string;
+   skips passed argument to a matching quote. In-place parser unescapes the
+   string right in the buffer and returns pointer into it. */
+static const char * get_quoted_string(JSON_Parser *parser) {
+    const char *string_start = parser->string;
     size_t string_len = 0;
-    skip_quotes(string);
-    if (**string == '\0')
+    skip_quotes(&parser->string);
+    if (*parser->string == '\0')
         return NULL;
-    string_len = *string - string_start - 2; /* length without quotes */
-    return process_string(string_start + 1, string_len);
+    string_len = parser->string - string_start - 2; /* length without quotes */
+    if (parser->buffer != NULL) {
+        char *output = (char*)string_start + 1;
+        if (process_string(output, string_len, output) == NULL)
+            return NULL;
+        return output;
+    }
+    return copy_processed_string(string_start + 1, string_len);
 }
 
-static JSON_Value * parse_value(const char **string, size_t nesting) {
+static JSON_Value * parse_value(JSON_Parser *parser, size_t nesting) {
     if (nesting > MAX_NESTING)
         return NULL;
-    SKIP_WHITESPACES(string);
-    switch (**string) {
+    skip_whitespaces(parser);
+    switch (*parser->string) {
         case '{':
-            return parse_object_value(string, nesting + 1);
+            return parse_object_value(parser, nesting + 1);
         case '[':
-            return parse_array_value(string, nesting + 1);
+            return parse_array_value(parser, nesting + 1);
         case '\'':
         case '\"':
-            return parse_string_value(string);
+            return parse_string_value(parser);
         case 'f': case 't':
-            return parse_boolean_value(string);
+            return parse_boolean_value(parser);
         case '-':
         case '0': case '1': case '2': case '3': case '4':
         case '5': case '6': case '7': case '8': case '9':
-            return parse_number_value(string);
+            return parse_number_value(parser);
         case 'n':
-            return parse_null_value(string);
+            return parse_null_value(parser);
         default:
             return NULL;
     }
 }
 
-static JSON_Value * parse_object_value(const char **string, size_t nesting) {
+static JSON_Value * parse_object_value(JSON_Parser *parser, size_t nesting) {
     JSON_Value *output_value = json_value_init_object(), *new_value = NULL;
     JSON_Object *output_object = json_value_get_object(output_value);
     const char *new_key = NULL;
     if (output_value == NULL)
         return NULL;
-    SKIP_CHAR(string);
-    SKIP_WHITESPACES(string);
-    if (**string == '}') { /* empty object */
-        SKIP_CHAR(string);
+    if (parser->buffer != NULL) {
+        output_object->borrowed_start = parser->buffer;
+        output_object->borrowed_end = parser->buffer + parser->size;
+    }
+    SKIP_CHAR(parser);
+    skip_whitespaces(parser);
+    if (*parser->string == '}') { /* empty object */
+        SKIP_CHAR(parser);
         return output_value;
     }
-    while (**string != '\0') {
-        new_key = get_quoted_string(string);
-        SKIP_WHITESPACES(string);
-        if (new_key == NULL || **string != ':') {
+    while (*parser->string != '\0') {
+        new_key = get_quoted_string(parser);
+        skip_whitespaces(parser);
+        if (new_key == NULL || *parser->string != ':') {
+            if (new_key != NULL && parser->buffer == NULL)
+                PARSON_FREE(new_key);
             json_value_free(output_value);
             return NULL;
         }
-        SKIP_CHAR(string);
-        new_value = parse_value(string, nesting);
+        SKIP_CHAR(parser);
+        new_value = parse_value(parser, nesting);
         if (new_value == NULL) {
-            PARSON_FREE(new_key);
+            if (parser->buffer == NULL)
+                PARSON_FREE(new_key);
             json_value_free(output_value);
             return NULL;
         }
-        if(json_object_add(output_object, new_key, new_value) == JSONFailure) {
-            PARSON_FREE(new_key);
-            PARSON_FREE(new_value);
+        if (json_object_add(output_object, new_key, new_value) == JSONFailure) {
+            if (parser->buffer == NULL)
+                PARSON_FREE(new_key);
+            json_value_free(new_value);
             json_value_free(output_value);
             return NULL;
         }
-        PARSON_FREE(new_key);
-        SKIP_WHITESPACES(string);
-        if (**string != ',')
+        if (parser->buffer == NULL)
+            PARSON_FREE(new_key);
+        skip_whitespaces(parser);
+        if (*parser->string != ',')
             break;
-        SKIP_CHAR(string);
-        SKIP_WHITESPACES(string);
+        SKIP_CHAR(parser);
+        skip_whitespaces(parser);
         /* Trailers */
-        if (**string == '}')
+        if (*parser->string == '}')
           break;
     }
-    SKIP_COMMAS(string);
-    if (**string != '}' || /* Trim object after parsing is over */
+    skip_commas(parser);
+    if (*parser->string != '}' || /* Trim object after parsing is over */
         json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure) {
             json_value_free(output_value);
             return NULL;
     }
-    SKIP_CHAR(string);
+    SKIP_CHAR(parser);
     return output_value;
 }
 
-static JSON_Value * parse_array_value(const char **string, size_t nesting) {
+static JSON_Value * parse_array_value(JSON_Parser *parser, size_t nesting) {
     JSON_Value *output_value = json_value_init_array(), *new_array_value = NULL;
     JSON_Array *output_array = json_value_get_array(output_value);
     if (!output_value)
         return NULL;
-    SKIP_CHAR(string);
-    SKIP_WHITESPACES(string);
-    if (**string == ']') { /* empty array */
-        SKIP_CHAR(string);
+    SKIP_CHAR(parser);
+    skip_whitespaces(parser);
+    if (*parser->string == ']') { /* empty array */
+        SKIP_CHAR(parser);
         return output_value;
     }
-    while (**string != '\0') {
-        new_array_value = parse_value(string, nesting);
+    while (*parser->string != '\0') {
+        new_array_value = parse_value(parser, nesting);
         if (!new_array_value) {
             json_value_free(output_value);
             return NULL;
         }
         if(json_array_add(output_array, new_array_value) == JSONFailure) {
-            PARSON_FREE(new_array_value);
+            json_value_free(new_array_value);
             json_value_free(output_value);
             return NULL;
         }
-        SKIP_WHITESPACES(string);
-        if (**string != ',')
+        skip_whitespaces(parser);
+        if (*parser->string != ',')
             break;
-        SKIP_CHAR(string);
-        SKIP_WHITESPACES(string);
+        SKIP_CHAR(parser);
+        skip_whitespaces(parser);
         /* Trailers */
-        if (**string == ']')
+        if (*parser->string == ']')
           break;
     }
-    SKIP_COMMAS(string);
-    if (**string != ']' || /* Trim array after parsing is over */
+    skip_commas(parser);
+    if (*parser->string != ']' || /* Trim array after parsing is over */
         json_array_resize(output_array, json_array_get_count(output_array)) == JSONFailure) {
             json_value_free(output_value);
             return NULL;
     }
-    SKIP_CHAR(string);
+    SKIP_CHAR(parser);
     return output_value;
 }
 
-static JSON_Value * parse_string_value(const char **string) {
-    const char *new_string = get_quoted_string(string);
+static JSON_Value * parse_string_value(JSON_Parser *parser) {
+    JSON_Value *output_value = NULL;
+    const char *new_string = get_quoted_string(parser);
     if (!new_string)
         return NULL;
-    return json_value_init_string_no_copy(new_string);
+    output_value = json_value_init_string_no_copy(new_string);
+    if (output_value == NULL) {
+        if (parser->buffer == NULL)
+            PARSON_FREE(new_string);
+        return NULL;
+    }
+    if (parser->buffer != NULL)
+        output_value->flags |= VALUE_BORROWED;
+    return output_value;
 }
 
-static JSON_Value * parse_boolean_value(const char **string) {
+static JSON_Value * parse_boolean_value(JSON_Parser *parser) {
     size_t true_token_size = SIZEOF_TOKEN("true");
     size_t false_token_size = SIZEOF_TOKEN("false");
-    if (strncmp("true", *string, true_token_size) == 0) {
-        *string += true_token_size;
+    if (strncmp("true", parser->string, true_token_size) == 0) {
+        parser->string += true_token_size;
         return json_value_init_boolean(1);
-    } else if (strncmp("false", *string, false_token_size) == 0) {
-        *string += false_token_size;
+    } else if (strncmp("false", parser->string, false_token_size) == 0) {
+        parser->string += false_token_size;
         return json_value_init_boolean(0);
     }
     return NULL;
 }
 
-static JSON_Value * parse_number_value(const char **string) {
+static JSON_Value * parse_number_value(JSON_Parser *parser) {
     char *end;
-    double number = strtod(*string, &end);
+    double number = strtod(parser->string, &end);
     JSON_Value *output_value;
-    if (is_decimal(*string, end - *string)) {
-        *string = end;
+    if (is_decimal(parser->string, end - parser->string)) {
+        parser->string = end;
         output_value = json_value_init_number(number);
     } else {
         output_value = NULL;
@@ -611,15 +877,31 @@ static JSON_Value * parse_number_value(const char **string) {
     return output_value;
 }
 
-static JSON_Value * parse_null_value(const char **string) {
+static JSON_Value * parse_null_value(JSON_Parser *parser) {
     size_t token_size = SIZEOF_TOKEN("null");
-    if (strncmp("null", *string, token_size) == 0) {
-        *string += token_size;
+    if (strncmp("null", parser->string, token_size) == 0) {
+        parser->string += token_size;
         return json_value_init_null();
     }
     return NULL;
 }
 
+static JSON_Value * parse_root(JSON_Parser *parser) {
+    skip_whitespaces(parser);
+    if (*parser->string != '{' && *parser->string != '[')
+        return NULL;
+    return parse_value(parser, 0);
+}
+
+static JSON_Value * parse_buffer(char *buffer, size_t size, void *arg) {
+    JSON_Parser parser;
+    parser.string = buffer;
+    parser.comments = *(int*)arg;
+    parser.buffer = buffer;
+    parser.size = size;
+    return parse_root(&parser);
+}
+
 /* Serialization */
 static size_t json_serialization_size_r(const JSON_Value *value, char *buf) {
     size_t result_size = 0;
@@ -760,64 +1042,105 @@ static char * json_serialize_string(const char *string, char *buf) {
     return buf;
 }
 
+/* Allocation */
+void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Function free_fun) {
+    parson_malloc = malloc_fun;
+    parson_free = free_fun;
+}
+
+void json_set_intern_function(JSON_Intern_Function intern_fun) {
+    parson_intern = intern_fun;
+}
+
 /* Parser API */
 JSON_Value * json_parse_file(const char *filename) {
-    char *file_contents = read_file(filename);
-    JSON_Value *output_value = NULL;
-    if (!file_contents)
-        return NULL;
-    output_value = json_parse_string(file_contents);
-    PARSON_FREE(file_contents);
-    return output_value;
+    int comments = 0;
+    return json_parse_file_with(filename, parse_buffer, &comments);
 }
 
 JSON_Value * json_parse_file_with_comments(const char *filename) {
-    char *file_contents = read_file(filename);
-    JSON_Value *output_value = NULL;
-    if (!file_contents)
+    int comments = 1;
+    return json_parse_file_with(filename, parse_buffer, &comments);
+}
+
+/* Parses mapped file in place, the root takes ownership of the buffer */
+JSON_Value * json_parse_file_with(const char *filename, JSON_Parse_Function parse, void *arg) {
+    JSON_Document *document = NULL;
+    JSON_Value *root_value = NULL;
+    char *buffer = NULL;
+    size_t size = 0;
+    size_t alloc_size = 0;
+    int mapped = 0;
+    buffer = map_file(filename, &size, &alloc_size, &mapped);
+    if (buffer == NULL)
         return NULL;
-    output_value = json_parse_string_with_comments(file_contents);
-    PARSON_FREE(file_contents);
-    return output_value;
+    root_value = parse(buffer, size, arg);
+    if (root_value == NULL)
+        goto error;
+    document = (JSON_Document*)PARSON_MALLOC(sizeof(JSON_Document));
+    if (document == NULL) {
+        json_value_free(root_value);
+        goto error;
+    }
+    document->value = *root_value;
+    document->value.flags |= VALUE_DOCUMENT;
+    document->buffer = buffer;
+    document->alloc_size = alloc_size;
+    document->mapped = mapped;
+    PARSON_FREE(root_value);
+    return &document->value;
+error:
+    unmap_file(buffer, alloc_size, mapped);
+    return NULL;
 }
 
 JSON_Value * json_parse_string(const char *string) {
+    JSON_Parser parser;
     if (!string)
         return NULL;
-    SKIP_WHITESPACES(&string);
-    if (*string != '{' && *string != '[')
-        return NULL;
-    return parse_value((const char**)&string, 0);
+    parser.string = string;
+    parser.comments = 0;
+    parser.buffer = NULL;
+    parser.size = 0;
+    return parse_root(&parser);
 }
 
 JSON_Value * json_parse_string_with_comments(const char *string) {
-    JSON_Value *result = NULL;
-    char *string_mutable_copy = NULL, *string_mutable_copy_ptr = NULL;
-    string_mutable_copy = parson_strdup(string);
-    if (!string_mutable_copy)
-        return NULL;
-    remove_comments(string_mutable_copy, "/*", "*/");
-    remove_comments(string_mutable_copy, "//", "\n");
-    /* GYP comments */
-    remove_comments(string_mutable_copy, "#", "\n");
-    string_mutable_copy_ptr = string_mutable_copy;
-    SKIP_WHITESPACES(&string_mutable_copy_ptr);
-    if (*string_mutable_copy_ptr != '{' && *string_mutable_copy_ptr != '[') {
-        PARSON_FREE(string_mutable_copy);
+    JSON_Parser parser;
+    if (!string)
         return NULL;
-    }
-    result = parse_value((const char**)&string_mutable_copy_ptr, 0);
-    PARSON_FREE(string_mutable_copy);
-    return result;
+    parser.string = string;
+    parser.comments = 1;
+    parser.buffer = NULL;
+    parser.size = 0;
+    return parse_root(&parser);
 }
 
 
 /* JSON Object API */
 
 JSON_Value * json_object_get_value(const JSON_Object *object, const char *name) {
+    if (name == NULL)
+        return NULL;
     return json_object_nget_value(object, name, strlen(name));
 }
 
+JSON_Value * json_object_get_interned_value(const JSON_Object *object, const char *name) {
+    size_t i;
+    if (object == NULL || name == NULL)
+        return NULL;
+    if (object->intern == NULL)
+        return json_object_get_value(object, name);
+    i = json_object_find(object, name, strlen(name), 1);
+    return i == object->count ? NULL : object->values[i];
+}
+
+JSON_Value * json_object_get_value_at(const JSON_Object *object, size_t index) {
+    if (object == NULL || index >= object->count)
+        return NULL;
+    return object->values[index];
+}
+
 const char * json_object_get_string(const JSON_Object *object, const char *name) {
     return json_value_get_string(json_object_get_value(object, name));
 }
@@ -933,12 +1256,21 @@ int json_value_get_boolean(const JSON_Value *value) {
 }
 
 void json_value_free(JSON_Value *value) {
+    if (parson_free == NULL) { /* Values are reclaimed in bulk, release only parsed files */
+        if (value != NULL && (value->flags & VALUE_DOCUMENT)) {
+            JSON_Document *document = (JSON_Document*)value;
+            unmap_file(document->buffer, document->alloc_size, document->mapped);
+        }
+        return;
+    }
     switch (json_value_get_type(value)) {
         case JSONObject:
             json_object_free(value->value.object);
             break;
         case JSONString:
-            if (value->value.string) { PARSON_FREE(value->value.string); }
+            if (value->value.string && !(value->flags & VALUE_BORROWED)) {
+                PARSON_FREE(value->value.string);
+            }
             break;
         case JSONArray:
             json_array_free(value->value.array);
@@ -946,6 +1278,10 @@ void json_value_free(JSON_Value *value) {
         default:
             break;
     }
+    if (value != NULL && (value->flags & VALUE_DOCUMENT)) {
+        JSON_Document *document = (JSON_Document*)value;
+        unmap_file(document->buffer, document->alloc_size, document->mapped);
+    }
     PARSON_FREE(value);
 }
 
@@ -954,6 +1290,7 @@ JSON_Value * json_value_init_object(void) {
     if (!new_value)
         return NULL;
     new_value->type = JSONObject;
+    new_value->flags = 0;
     new_value->value.object = json_object_init();
     if (!new_value->value.object) {
         PARSON_FREE(new_value);
@@ -967,6 +1304,7 @@ JSON_Value * json_value_init_array(void) {
     if (!new_value)
         return NULL;
     new_value->type = JSONArray;
+    new_value->flags = 0;
     new_value->value.array = json_array_init();
     if (!new_value->value.array) {
         PARSON_FREE(new_value);
@@ -976,17 +1314,35 @@ JSON_Value * json_value_init_array(void) {
 }
 
 JSON_Value * json_value_init_string(const char *string) {
-    char *processed_copy = process_string(string, strlen(string));
+    char *processed_copy = copy_processed_string(string, strlen(string));
     if (processed_copy == NULL)
         return NULL;
     return json_value_init_string_no_copy(processed_copy);
 }
 
+JSON_Value * json_value_init_string_in_place(const char *string) {
+    JSON_Value *new_value = json_value_init_string_no_copy(string);
+    if (!new_value)
+        return NULL;
+    new_value->flags |= VALUE_BORROWED;
+    return new_value;
+}
+
+JSON_Value * json_value_init_object_in_place(const char *start, const char *end) {
+    JSON_Value *new_value = json_value_init_object();
+    if (!new_value)
+        return NULL;
+    new_value->value.object->borrowed_start = start;
+    new_value->value.object->borrowed_end = end;
+    return new_value;
+}
+
 JSON_Value * json_value_init_number(double number) {
     JSON_Value *new_value = (JSON_Value*)PARSON_MALLOC(sizeof(JSON_Value));
     if (!new_value)
         return NULL;
     new_value->type = JSONNumber;
+    new_value->flags = 0;
     new_value->value.number = number;
     return new_value;
 }
@@ -996,6 +1352,7 @@ JSON_Value * json_value_init_boolean(int boolean) {
     if (!new_value)
         return NULL;
     new_value->type = JSONBoolean;
+    new_value->flags = 0;
     new_value->value.boolean = boolean ? 1 : 0;
     return new_value;
 }
@@ -1005,6 +1362,7 @@ JSON_Value * json_value_init_null(void) {
     if (!new_value)
         return NULL;
     new_value->type = JSONNull;
+    new_value->flags = 0;
     return new_value;
 }
 
@@ -1044,13 +1402,17 @@ JSON_Value * json_value_deep_copy(const JSON_Value *value) {
             temp_object_copy = json_value_get_object(return_value);
             for (i = 0; i < json_object_get_count(temp_object); i++) {
                 temp_key = json_object_get_name(temp_object, i);
-                temp_value = json_object_get_value(temp_object, temp_key);
+                temp_value = json_object_get_value_at(temp_object, i);
                 temp_value_copy = json_value_deep_copy(temp_value);
                 if (temp_value_copy == NULL) {
                     json_value_free(return_value);
                     return NULL;
                 }
-                if (json_object_add(temp_object_copy, temp_key, temp_value_copy) == JSONFailure) {
+                /* Names are unique already, interned ones can be shared */
+                if (json_object_append(temp_object_copy, temp_key,
+                                       temp_object_copy->intern != NULL &&
+                                           temp_object_copy->intern == temp_object->intern,
+                                       temp_value_copy) == JSONFailure) {
                     json_value_free(return_value);
                     json_value_free(temp_value_copy);
                     return NULL;
@@ -1169,6 +1531,38 @@ JSON_Status json_array_replace_null(JSON_Array *array, size_t i) {
     return json_array_replace_value(array, i, json_value_init_null());
 }
 
+JSON_Status json_array_splice_strings_in_place(JSON_Array *array, size_t ix, const char * const *strings, size_t count) {
+    JSON_Value *old_value = NULL;
+    size_t new_count = 0, tail = 0, i = 0;
+    if (array == NULL || ix >= json_array_get_count(array)) {
+        return JSONFailure;
+    }
+    new_count = array->count - 1 + count;
+    if (new_count > ARRAY_MAX_CAPACITY) {
+        return JSONFailure;
+    }
+    if (new_count > array->capacity &&
+        json_array_resize(array, MAX(array->capacity * 2, new_count)) == JSONFailure) {
+        return JSONFailure;
+    }
+    old_value = array->items[ix];
+    tail = array->count - ix - 1;
+    memmove(array->items + ix + count, array->items + ix + 1, tail * sizeof(JSON_Value*));
+    for (i = 0; i < count; i++) {
+        array->items[ix + i] = json_value_init_string_in_place(strings[i]);
+        if (array->items[ix + i] == NULL) { /* Undo, array is left intact */
+            while (i--)
+                json_value_free(array->items[ix + i]);
+            memmove(array->items + ix + 1, array->items + ix + count, tail * sizeof(JSON_Value*));
+            array->items[ix] = old_value;
+            return JSONFailure;
+        }
+    }
+    array->count = new_count;
+    json_value_free(old_value);
+    return JSONSuccess;
+}
+
 JSON_Status json_array_clear(JSON_Array *array) {
     size_t i = 0;
     if (array == NULL)
@@ -1204,21 +1598,30 @@ JSON_Status json_array_append_null(JSON_Array *array) {
 
 JSON_Status json_object_set_value(JSON_Object *object, const char *name, JSON_Value *value) {
     size_t i = 0;
-    JSON_Value *old_value;
-    if (object == NULL)
+    if (object == NULL || name == NULL || value == NULL)
         return JSONFailure;
-    old_value = json_object_get_value(object, name);
-    if (old_value != NULL) { /* free and overwrite old value */
-        json_value_free(old_value);
-        for (i = 0; i < json_object_get_count(object); i++) {
-            if (strcmp(object->names[i], name) == 0) {
-                object->values[i] = value;
-                return JSONSuccess;
-            }
-        }
+    i = json_object_find(object, name, strlen(name), 0);
+    if (i != object->count) { /* free and overwrite old value */
+        json_value_free(object->values[i]);
+        object->values[i] = value;
+        return JSONSuccess;
     }
-    json_object_add(object, name, value); /* add new key value pair */
-    return JSONSuccess;
+    return json_object_append(object, name, 0, value); /* add new key value pair */
+}
+
+JSON_Status json_object_set_interned_value(JSON_Object *object, const char *name, JSON_Value *value) {
+    size_t i;
+    if (object == NULL || name == NULL || value == NULL)
+        return JSONFailure;
+    if (object->intern == NULL)
+        return json_object_set_value(object, name, value);
+    i = json_object_find(object, name, strlen(name), 1);
+    if (i != object->count) {
+        json_value_free(object->values[i]);
+        object->values[i] = value;
+        return JSONSuccess;
+    }
+    return json_object_append(object, name, 1, value);
 }
 
 JSON_Status json_object_set_string(JSON_Object *object, const char *name, const char *string) {
@@ -1286,22 +1689,24 @@ JSON_Status json_object_dotset_null(JSON_Object *object, const char *name) {
 
 JSON_Status json_object_remove(JSON_Object *object, const char *name) {
     size_t i = 0, last_item_index = 0;
-    if (object == NULL || json_object_get_value(object, name) == NULL)
+    if (object == NULL || name == NULL)
         return JSONFailure;
-    last_item_index = json_object_get_count(object) - 1;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        if (strcmp(object->names[i], name) == 0) {
-            PARSON_FREE(object->names[i]);
-            json_value_free(object->values[i]);
-            if (i != last_item_index) { /* Replace key value pair with one from the end */
-                object->names[i] = object->names[last_item_index];
-                object->values[i] = object->values[last_item_index];
-            }
-            object->count -= 1;
-            return JSONSuccess;
-        }
+    i = json_object_find(object, name, strlen(name), 0);
+    if (i == object->count)
+        return JSONFailure;
+    last_item_index = object->count - 1;
+    if (json_object_owns_name(object, object->names[i]))
+        PARSON_FREE(object->names[i]);
+    json_value_free(object->values[i]);
+    if (i != last_item_index) { /* Replace key value pair with one from the end */
+        object->names[i] = object->names[last_item_index];
+        object->values[i] = object->values[last_item_index];
     }
-    return JSONFailure; /* No execution path should end here */
+    object->count -= 1;
+    /* Linear probing has no cheap deletion, removals are rare */
+    if (object->index != NULL)
+        json_object_reindex(object);
+    return JSONSuccess;
 }
 
 JSON_Status json_object_dotremove(JSON_Object *object, const char *name) {
@@ -1329,10 +1734,13 @@ JSON_Status json_object_clear(JSON_Object *object) {
         return JSONFailure;
     }
     for (i = 0; i < json_object_get_count(object); i++) {        
-        PARSON_FREE(object->names[i]);
+        if (json_object_owns_name(object, object->names[i]))
+            PARSON_FREE(object->names[i]);
         json_value_free(object->values[i]);
     }
     object->count = 0;
+    if (object->index != NULL)
+        json_object_reindex(object);
     return JSONSuccess;
 }
 
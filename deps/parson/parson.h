@@ -52,20 +52,46 @@ enum json_result_t {
     JSONFailure = -1
 };
 typedef int JSON_Status;
+
+typedef void * (*JSON_Malloc_Function)(size_t);
+typedef void   (*JSON_Free_Function)(void *);
+
+/* Sets allocation functions of the calling thread (malloc and free by default).
+   NULL `free_fun` means that the memory is reclaimed by the owner in bulk (e.g.
+   arena): json_value_free then does not walk the tree and only releases
+   buffers of the parsed files. */
+void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Function free_fun);
+
+/* Sets function interning names of objects created by the calling thread
+   (NULL by default - names are copied). Interned names are owned by the
+   intern pool: they are neither copied nor freed and may be compared by
+   pointer, see json_object_get_interned_value. */
+typedef const char * (*JSON_Intern_Function)(const char *string, size_t length);
+void json_set_intern_function(JSON_Intern_Function intern_fun);
    
-/* Parses first JSON value in a file, returns NULL in case of error */
+/* Parses first JSON value in a file, returns NULL in case of error.
+   File is mapped and parsed in place: strings of the tree point into the
+   mapping, which is released only when the returned root value is freed. */
 JSON_Value * json_parse_file(const char *filename);
 
-/* Parses first JSON value in a file and ignores comments (/ * * / and //),
+/* Parses first JSON value in a file and ignores comments (/ * * /, // and #),
    returns NULL in case of error */
 JSON_Value * json_parse_file_with_comments(const char *filename);
     
 /*  Parses first JSON value in a string, returns NULL in case of error */
 JSON_Value * json_parse_string(const char *string);
 
-/*  Parses first JSON value in a string and ignores comments (/ * * / and //),
+/*  Parses first JSON value in a string and ignores comments (/ * * /, // and #),
     returns NULL in case of error */
 JSON_Value * json_parse_string_with_comments(const char *string);
+
+/* Maps file and parses it with custom `parse` function, for JSON dialects.
+   `buffer` is writable and zero-terminated, so strings may be unescaped in
+   place and borrowed by the tree (see json_value_init_string_in_place and
+   json_value_init_object_in_place). `size` is the length of the contents,
+   without the trailing zero. Buffer is released with the root. */
+typedef JSON_Value * (*JSON_Parse_Function)(char *buffer, size_t size, void *arg);
+JSON_Value * json_parse_file_with(const char *filename, JSON_Parse_Function parse, void *arg);
     
 /* Serialization */
 size_t      json_serialization_size(const JSON_Value *value);
@@ -93,6 +119,9 @@ JSON_Status json_validate(const JSON_Value *schema, const JSON_Value *value);
  * JSON Object
  */
 JSON_Value  * json_object_get_value  (const JSON_Object *object, const char *name);
+JSON_Value  * json_object_get_value_at(const JSON_Object *object, size_t index);
+/* `name` must come from the object's intern function: compared by pointer */
+JSON_Value  * json_object_get_interned_value(const JSON_Object *object, const char *name);
 const char  * json_object_get_string (const JSON_Object *object, const char *name);
 JSON_Object * json_object_get_object (const JSON_Object *object, const char *name);
 JSON_Array  * json_object_get_array  (const JSON_Object *object, const char *name);
@@ -116,6 +145,7 @@ const char  * json_object_get_name (const JSON_Object *object, size_t index);
     
 /* Creates new name-value pair or frees and replaces old value with new one. */
 JSON_Status json_object_set_value(JSON_Object *object, const char *name, JSON_Value *value);
+JSON_Status json_object_set_interned_value(JSON_Object *object, const char *name, JSON_Value *value);
 JSON_Status json_object_set_string(JSON_Object *object, const char *name, const char *string);
 JSON_Status json_object_set_number(JSON_Object *object, const char *name, double number);
 JSON_Status json_object_set_boolean(JSON_Object *object, const char *name, int boolean);
@@ -160,6 +190,11 @@ JSON_Status json_array_replace_number(JSON_Array *array, size_t i, double number
 JSON_Status json_array_replace_boolean(JSON_Array *array, size_t i, int boolean);
 JSON_Status json_array_replace_null(JSON_Array *array, size_t i);
 
+/* Frees value at given index and replaces it with borrowed strings (see
+ * json_value_init_string_in_place), keeping order of values in array.
+ * Does nothing and returns JSONFailure if index doesn't exist. */
+JSON_Status json_array_splice_strings_in_place(JSON_Array *array, size_t i, const char * const *strings, size_t count);
+
 /* Frees and removes all values from array */
 JSON_Status json_array_clear(JSON_Array *array);
 
@@ -179,6 +214,8 @@ JSON_Value * json_value_init_string (const char *string); /* copies passed strin
 JSON_Value * json_value_init_number (double number);
 JSON_Value * json_value_init_boolean(int boolean);
 JSON_Value * json_value_init_null   (void);
+JSON_Value * json_value_init_string_in_place(const char *string); /* borrows string from parsed buffer */
+JSON_Value * json_value_init_object_in_place(const char *start, const char *end); /* borrows names within [start, end) */
 JSON_Value * json_value_deep_copy   (const JSON_Value *value);
 void         json_value_free        (JSON_Value *value);
 
@@ -1,6 +1,7 @@
 {
   "variables": {
-    "cflags": "-g3 -O0 -std=c99 -Wall -Wextra -Wno-unused-parameter -pedantic"
+    "cflags": "-g3 -O0 -std=c99 -Wall -Wextra -Wno-unused-parameter -pedantic",
+    "bench_cflags": "-O2 -std=c99 -Wall -Wextra -Wno-unused-parameter -pedantic"
   },
   "targets": [{
     "target_name": "pyg",
@@ -15,8 +16,16 @@
       "deps/parson",
     ],
 
+    "defines": [
+      "_DEFAULT_SOURCE",
+    ],
+
     "cflags": "<(cflags)",
 
+    "libraries": [
+      "-lpthread",
+    ],
+
     "sources": [
       "src/common.c",
       "src/error.c",
@@ -26,6 +35,60 @@
       "src/json.c",
       "src/eval.c",
       "src/unroll.c",
+      "src/loader.c",
+      "src/gyp.c",
+      "src/arena.c",
+      "src/intern.c",
+      "src/cache.c",
+      "src/scan.c",
+      "src/include.c",
+      "src/exists.c",
+      "src/scope.c",
+      "src/keywords.c",
+      "src/command.c",
+    ]
+  }, {
+    "target_name": "hashmap_bench",
+    "type": "executable",
+
+    "dependencies": [
+      "parson",
+    ],
+
+    "include_dirs": [
+      ".",
+      "deps/parson",
+    ],
+
+    "defines": [
+      "_DEFAULT_SOURCE",
+    ],
+
+    "cflags": "<(bench_cflags)",
+
+    "libraries": [
+      "-lpthread",
+    ],
+
+    "sources": [
+      "bench/hashmap.c",
+      "src/common.c",
+      "src/error.c",
+      "src/intern.c",
+      "src/arena.c",
+    ]
+  }, {
+    "target_name": "keywords",
+    "type": "executable",
+
+    "defines": [
+      "_DEFAULT_SOURCE",
+    ],
+
+    "cflags": "<(cflags)",
+
+    "sources": [
+      "tools/keywords.c",
     ]
   }, {
     "target_name": "parson",
@@ -0,0 +1,112 @@
+#include "src/arena.h"
+#include "src/common.h"
+
+#include "parson.h"
+
+#include <stdlib.h>
+
+union pyg_arena_align_u {
+  void* ptr;
+  double num;
+  long int val;
+  size_t size;
+};
+
+#define PYG_ARENA_ALIGN(size)                                                 \
+    (((size) + sizeof(union pyg_arena_align_u) - 1) &                         \
+        ~(sizeof(union pyg_arena_align_u) - 1))
+#define PYG_ARENA_HEADER PYG_ARENA_ALIGN(sizeof(pyg_arena_chunk_t))
+
+static const size_t kPygArenaChunkSize = 64 * 1024;
+
+static pyg_arena_chunk_t* pyg_arena_add_chunk(pyg_arena_t* arena,
+                                              size_t size,
+                                              int dedicated);
+static void* pyg_arena_json_malloc(size_t size);
+
+/* Arena of the file being loaded by the current thread */
+static PYG_THREAD_LOCAL pyg_arena_t* pyg_arena_current;
+
+
+void pyg_arena_init(pyg_arena_t* arena) {
+  arena->chunks = NULL;
+}
+
+
+void pyg_arena_destroy(pyg_arena_t* arena) {
+  pyg_arena_chunk_t* chunk;
+  pyg_arena_chunk_t* next;
+
+  for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+    next = chunk->next;
+    free(chunk);
+  }
+  arena->chunks = NULL;
+}
+
+
+pyg_arena_chunk_t* pyg_arena_add_chunk(pyg_arena_t* arena,
+                                       size_t size,
+                                       int dedicated) {
+  pyg_arena_chunk_t* chunk;
+
+  chunk = malloc(PYG_ARENA_HEADER + size);
+  if (chunk == NULL)
+    return NULL;
+
+  chunk->size = size;
+  chunk->used = 0;
+
+  /* Keep the partially used head chunk in front of the big allocations */
+  if (dedicated && arena->chunks != NULL) {
+    chunk->next = arena->chunks->next;
+    arena->chunks->next = chunk;
+  } else {
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+  }
+
+  return chunk;
+}
+
+
+void* pyg_arena_alloc(pyg_arena_t* arena, size_t size) {
+  pyg_arena_chunk_t* chunk;
+  void* res;
+
+  size = PYG_ARENA_ALIGN(size);
+
+  chunk = arena->chunks;
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    /* Big allocations get chunks of their own */
+    if (size > kPygArenaChunkSize / 4)
+      chunk = pyg_arena_add_chunk(arena, size, 1);
+    else
+      chunk = pyg_arena_add_chunk(arena, kPygArenaChunkSize, 0);
+    if (chunk == NULL)
+      return NULL;
+  }
+
+  res = (char*) chunk + PYG_ARENA_HEADER + chunk->used;
+  chunk->used += size;
+  return res;
+}
+
+
+pyg_arena_t* pyg_arena_enter(pyg_arena_t* arena) {
+  pyg_arena_t* prev;
+
+  prev = pyg_arena_current;
+  pyg_arena_current = arena;
+  if (arena == NULL)
+    json_set_allocation_functions(malloc, free);
+  else
+    json_set_allocation_functions(pyg_arena_json_malloc, NULL);
+
+  return prev;
+}
+
+
+void* pyg_arena_json_malloc(size_t size) {
+  return pyg_arena_alloc(pyg_arena_current, size);
+}
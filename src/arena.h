@@ -0,0 +1,32 @@
+#ifndef SRC_ARENA_H_
+#define SRC_ARENA_H_
+
+#include <stddef.h>
+
+typedef struct pyg_arena_s pyg_arena_t;
+typedef struct pyg_arena_chunk_s pyg_arena_chunk_t;
+
+struct pyg_arena_chunk_s {
+  pyg_arena_chunk_t* next;
+  size_t size;
+  size_t used;
+};
+
+/* Bump-pointer allocator, everything is released at once on destroy */
+struct pyg_arena_s {
+  pyg_arena_chunk_t* chunks;
+};
+
+void pyg_arena_init(pyg_arena_t* arena);
+void pyg_arena_destroy(pyg_arena_t* arena);
+
+void* pyg_arena_alloc(pyg_arena_t* arena, size_t size);
+
+/*
+ * Route parson allocations of the calling thread to `arena` (NULL - back to
+ * malloc/free). Returns previously entered arena, which should be restored
+ * by the caller.
+ */
+pyg_arena_t* pyg_arena_enter(pyg_arena_t* arena);
+
+#endif  /* SRC_ARENA_H_ */
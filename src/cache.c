@@ -0,0 +1,652 @@
+#include "src/cache.h"
+#include "src/common.h"
+#include "src/gyp.h"
+#include "src/intern.h"
+
+#include "parson.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+# define PYG_ST_MTIM(st) ((st)->st_mtimespec)
+#else
+# define PYG_ST_MTIM(st) ((st)->st_mtim)
+#endif  /* __APPLE__ */
+
+typedef struct pyg_cache_header_s pyg_cache_header_t;
+typedef struct pyg_cache_reader_s pyg_cache_reader_t;
+typedef struct pyg_cache_writer_s pyg_cache_writer_t;
+
+/*
+ * Entry is: header, NUL-terminated path of the source, pre-order dump of the
+ * tree. Everything is in native byte order, the cache is never shared between
+ * machines.
+ */
+struct pyg_cache_header_s {
+  char magic[4];
+  uint32_t version;
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t hash;
+  uint64_t path_len;
+};
+
+/*
+ * Values are prefixed by the tag. Numbers are followed by raw `double`,
+ * strings - by `uint32_t` length and NUL-terminated data, arrays - by
+ * `uint32_t` count and the values, objects - by `uint32_t` count and pairs of
+ * string (without tag) and value.
+ */
+enum pyg_cache_tag_e {
+  kPygCacheNull = 'z',
+  kPygCacheTrue = 't',
+  kPygCacheFalse = 'f',
+  kPygCacheNumber = 'n',
+  kPygCacheString = 's',
+  kPygCacheArray = 'a',
+  kPygCacheObject = 'o'
+};
+
+struct pyg_cache_reader_s {
+  const char* path;
+  struct stat* st;
+  pyg_cache_header_t header;
+
+  char* pos;
+  char* end;
+  unsigned int depth;
+
+  /* Contents are the same, but the mtime in the header should be updated */
+  int stale_mtime;
+};
+
+struct pyg_cache_writer_s {
+  char* data;
+  size_t off;
+  size_t size;
+};
+
+static const char kPygCacheMagic[4] = { 'P', 'Y', 'G', 'C' };
+static const uint32_t kPygCacheVersion = 2;
+static const unsigned int kPygCacheMaxDepth = 256;
+static const size_t kPygCacheWriterSize = 64 * 1024;
+
+static int pyg_cache_mkdir(char* path);
+static char* pyg_cache_entry_path(pyg_cache_t* cache, const char* path);
+static int pyg_cache_hash_file(const char* path, uint64_t* out);
+
+static JSON_Value* pyg_cache_read_root(char* buffer, size_t size, void* arg);
+static JSON_Value* pyg_cache_read_value(pyg_cache_reader_t* r);
+static JSON_Value* pyg_cache_read_array(pyg_cache_reader_t* r);
+static JSON_Value* pyg_cache_read_object(pyg_cache_reader_t* r);
+static char* pyg_cache_read_str(pyg_cache_reader_t* r, uint32_t* len);
+static int pyg_cache_read_u32(pyg_cache_reader_t* r, uint32_t* out);
+static void pyg_cache_touch(const char* entry, pyg_cache_reader_t* r);
+
+static void pyg_cache_store(const char* entry,
+                            const char* path,
+                            struct stat* st,
+                            uint64_t hash,
+                            JSON_Value* value);
+static int pyg_cache_write(pyg_cache_writer_t* w,
+                           const void* data,
+                           size_t len);
+static int pyg_cache_write_u32(pyg_cache_writer_t* w, size_t val);
+static int pyg_cache_write_str(pyg_cache_writer_t* w, const char* str);
+static int pyg_cache_write_value(pyg_cache_writer_t* w, JSON_Value* value);
+static int pyg_cache_write_fd(int fd, const char* data, size_t len);
+
+
+pyg_error_t pyg_cache_init(pyg_cache_t* cache, const char* dir) {
+  cache->dir = strdup(dir);
+  if (cache->dir == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_cache_t.dir");
+
+  if (pyg_cache_mkdir(cache->dir) != 0) {
+    free(cache->dir);
+    cache->dir = NULL;
+    return pyg_error_str(kPygErrFS, "Failed to create cache dir: %s", dir);
+  }
+
+  return pyg_ok();
+}
+
+
+void pyg_cache_destroy(pyg_cache_t* cache) {
+  free(cache->dir);
+  cache->dir = NULL;
+}
+
+
+int pyg_cache_mkdir(char* path) {
+  char* p;
+
+  for (p = path + 1; *p != '\0'; p++) {
+    int r;
+
+    if (*p != '/')
+      continue;
+
+    *p = '\0';
+    r = mkdir(path, 0755);
+    *p = '/';
+    if (r != 0 && errno != EEXIST)
+      return -1;
+  }
+
+  if (mkdir(path, 0755) != 0 && errno != EEXIST)
+    return -1;
+
+  return 0;
+}
+
+
+char* pyg_cache_entry_path(pyg_cache_t* cache, const char* path) {
+  char* res;
+  size_t len;
+
+  /* dir + '/' + 16 hex digits + ".pygc" */
+  len = strlen(cache->dir) + 1 + 16 + 5 + 1;
+  res = malloc(len);
+  if (res == NULL)
+    return NULL;
+
+  snprintf(res,
+           len,
+           "%s/%016" PRIx64 ".pygc",
+           cache->dir,
+           pyg_hash64(path, strlen(path)));
+  return res;
+}
+
+
+pyg_error_t pyg_cache_parse_file(pyg_cache_t* cache,
+                                 const char* path,
+                                 JSON_Value** out) {
+  pyg_error_t err;
+  pyg_cache_reader_t r;
+  struct stat st;
+  char* entry;
+  JSON_Value* res;
+  uint64_t hash;
+
+  /* Let the parser report errors */
+  if (cache == NULL || stat(path, &st) != 0)
+    return pyg_gyp_parse_file(path, NULL, out);
+
+  entry = pyg_cache_entry_path(cache, path);
+  if (entry == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_cache_entry_path(%s)", path);
+
+  r.path = path;
+  r.st = &st;
+  r.stale_mtime = 0;
+  res = json_parse_file_with(entry, pyg_cache_read_root, &r);
+  if (res != NULL) {
+    if (r.stale_mtime)
+      pyg_cache_touch(entry, &r);
+    free(entry);
+
+    *out = res;
+    return pyg_ok();
+  }
+
+  err = pyg_gyp_parse_file(path, &hash, out);
+  if (pyg_is_ok(err))
+    pyg_cache_store(entry, path, &st, hash, *out);
+  free(entry);
+
+  return err;
+}
+
+
+int pyg_cache_hash_file(const char* path, uint64_t* out) {
+  int fd;
+  struct stat st;
+  void* data;
+
+  fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return -1;
+
+  if (fstat(fd, &st) != 0)
+    goto failed_fstat;
+
+  if (st.st_size == 0) {
+    *out = pyg_hash64(NULL, 0);
+    close(fd);
+    return 0;
+  }
+
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+    goto failed_fstat;
+  close(fd);
+
+  *out = pyg_hash64(data, st.st_size);
+  munmap(data, st.st_size);
+  return 0;
+
+failed_fstat:
+  close(fd);
+  return -1;
+}
+
+
+JSON_Value* pyg_cache_read_root(char* buffer, size_t size, void* arg) {
+  pyg_cache_reader_t* r;
+  pyg_cache_header_t* h;
+  size_t path_len;
+  JSON_Value* res;
+
+  r = arg;
+  h = &r->header;
+
+  if (size < sizeof(*h))
+    return NULL;
+  memcpy(h, buffer, sizeof(*h));
+
+  if (memcmp(h->magic, kPygCacheMagic, sizeof(kPygCacheMagic)) != 0 ||
+      h->version != kPygCacheVersion ||
+      h->size != (uint64_t) r->st->st_size) {
+    return NULL;
+  }
+
+  /* Different file with the same hash of the path */
+  path_len = strlen(r->path);
+  if (h->path_len != path_len ||
+      size - sizeof(*h) < path_len + 1 ||
+      memcmp(buffer + sizeof(*h), r->path, path_len + 1) != 0) {
+    return NULL;
+  }
+
+  /* Touched, but not necessarily modified */
+  if (h->mtime_sec != (int64_t) PYG_ST_MTIM(r->st).tv_sec ||
+      h->mtime_nsec != (int64_t) PYG_ST_MTIM(r->st).tv_nsec) {
+    uint64_t hash;
+
+    if (pyg_cache_hash_file(r->path, &hash) != 0 || hash != h->hash)
+      return NULL;
+    r->stale_mtime = 1;
+  }
+
+  r->pos = buffer + sizeof(*h) + path_len + 1;
+  r->end = buffer + size;
+  r->depth = 0;
+
+  res = pyg_cache_read_value(r);
+  if (res != NULL && r->pos != r->end) {
+    json_value_free(res);
+    return NULL;
+  }
+
+  return res;
+}
+
+
+JSON_Value* pyg_cache_read_value(pyg_cache_reader_t* r) {
+  char tag;
+
+  if (r->pos == r->end)
+    return NULL;
+
+  tag = *r->pos++;
+  switch (tag) {
+    case kPygCacheNull:
+      return json_value_init_null();
+    case kPygCacheTrue:
+      return json_value_init_boolean(1);
+    case kPygCacheFalse:
+      return json_value_init_boolean(0);
+    case kPygCacheNumber:
+      {
+        double num;
+
+        if ((size_t) (r->end - r->pos) < sizeof(num))
+          return NULL;
+        memcpy(&num, r->pos, sizeof(num));
+        r->pos += sizeof(num);
+        return json_value_init_number(num);
+      }
+    case kPygCacheString:
+      {
+        char* str;
+        uint32_t len;
+
+        str = pyg_cache_read_str(r, &len);
+        if (str == NULL)
+          return NULL;
+        return json_value_init_string_in_place(str);
+      }
+    case kPygCacheArray:
+      return pyg_cache_read_array(r);
+    case kPygCacheObject:
+      return pyg_cache_read_object(r);
+    default:
+      return NULL;
+  }
+}
+
+
+JSON_Value* pyg_cache_read_array(pyg_cache_reader_t* r) {
+  JSON_Value* res;
+  JSON_Array* arr;
+  uint32_t count;
+  uint32_t i;
+
+  if (++r->depth > kPygCacheMaxDepth)
+    return NULL;
+
+  if (pyg_cache_read_u32(r, &count) != 0)
+    return NULL;
+
+  res = json_value_init_array();
+  if (res == NULL)
+    return NULL;
+  arr = json_value_get_array(res);
+
+  for (i = 0; i < count; i++) {
+    JSON_Value* value;
+
+    value = pyg_cache_read_value(r);
+    if (value == NULL)
+      goto failed_item;
+
+    if (json_array_append_value(arr, value) != JSONSuccess) {
+      json_value_free(value);
+      goto failed_item;
+    }
+  }
+
+  r->depth--;
+  return res;
+
+failed_item:
+  json_value_free(res);
+  return NULL;
+}
+
+
+JSON_Value* pyg_cache_read_object(pyg_cache_reader_t* r) {
+  JSON_Value* res;
+  JSON_Object* obj;
+  uint32_t count;
+  uint32_t i;
+
+  if (++r->depth > kPygCacheMaxDepth)
+    return NULL;
+
+  if (pyg_cache_read_u32(r, &count) != 0)
+    return NULL;
+
+  res = json_value_init_object();
+  if (res == NULL)
+    return NULL;
+  obj = json_value_get_object(res);
+
+  for (i = 0; i < count; i++) {
+    const char* key;
+    char* str;
+    uint32_t len;
+    JSON_Value* value;
+
+    str = pyg_cache_read_str(r, &len);
+    if (str == NULL)
+      goto failed_member;
+
+    key = pyg_intern(str, len);
+    if (key == NULL)
+      goto failed_member;
+
+    value = pyg_cache_read_value(r);
+    if (value == NULL)
+      goto failed_member;
+
+    if (json_object_set_interned_value(obj, key, value) != JSONSuccess) {
+      json_value_free(value);
+      goto failed_member;
+    }
+  }
+
+  r->depth--;
+  return res;
+
+failed_member:
+  json_value_free(res);
+  return NULL;
+}
+
+
+char* pyg_cache_read_str(pyg_cache_reader_t* r, uint32_t* len) {
+  char* res;
+
+  if (pyg_cache_read_u32(r, len) != 0)
+    return NULL;
+
+  if ((size_t) (r->end - r->pos) <= *len || r->pos[*len] != '\0')
+    return NULL;
+
+  res = r->pos;
+  r->pos += *len + 1;
+  return res;
+}
+
+
+int pyg_cache_read_u32(pyg_cache_reader_t* r, uint32_t* out) {
+  if ((size_t) (r->end - r->pos) < sizeof(*out))
+    return -1;
+
+  memcpy(out, r->pos, sizeof(*out));
+  r->pos += sizeof(*out);
+  return 0;
+}
+
+
+void pyg_cache_touch(const char* entry, pyg_cache_reader_t* r) {
+  int fd;
+
+  /* Not fatal, hash will be checked again on the next run */
+  fd = open(entry, O_WRONLY);
+  if (fd == -1)
+    return;
+
+  r->header.mtime_sec = PYG_ST_MTIM(r->st).tv_sec;
+  r->header.mtime_nsec = PYG_ST_MTIM(r->st).tv_nsec;
+  if (pwrite(fd, &r->header, sizeof(r->header), 0) < 0) {
+    /* Ignore */
+  }
+  close(fd);
+}
+
+
+void pyg_cache_store(const char* entry,
+                     const char* path,
+                     struct stat* st,
+                     uint64_t hash,
+                     JSON_Value* value) {
+  pyg_cache_writer_t w;
+  pyg_cache_header_t h;
+  char tmp[PATH_MAX];
+  int fd;
+  int r;
+
+  w.size = kPygCacheWriterSize;
+  w.off = 0;
+  w.data = malloc(w.size);
+  if (w.data == NULL)
+    return;
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, kPygCacheMagic, sizeof(kPygCacheMagic));
+  h.version = kPygCacheVersion;
+  h.size = st->st_size;
+  h.mtime_sec = PYG_ST_MTIM(st).tv_sec;
+  h.mtime_nsec = PYG_ST_MTIM(st).tv_nsec;
+  h.hash = hash;
+  h.path_len = strlen(path);
+
+  if (pyg_cache_write(&w, &h, sizeof(h)) != 0 ||
+      pyg_cache_write(&w, path, h.path_len + 1) != 0 ||
+      pyg_cache_write_value(&w, value) != 0) {
+    goto failed_write;
+  }
+
+  /* Other processes should never see partially written entry */
+  r = snprintf(tmp, sizeof(tmp), "%s.%d.tmp", entry, (int) getpid());
+  if (r < 0 || (size_t) r >= sizeof(tmp))
+    goto failed_write;
+
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    goto failed_write;
+
+  r = pyg_cache_write_fd(fd, w.data, w.off);
+  if (close(fd) != 0)
+    r = -1;
+  if (r != 0 || rename(tmp, entry) != 0)
+    unlink(tmp);
+
+failed_write:
+  free(w.data);
+}
+
+
+int pyg_cache_write(pyg_cache_writer_t* w, const void* data, size_t len) {
+  if (w->size - w->off < len) {
+    char* tmp;
+    size_t size;
+
+    size = w->size;
+    while (size - w->off < len)
+      size *= 2;
+
+    tmp = realloc(w->data, size);
+    if (tmp == NULL)
+      return -1;
+    w->data = tmp;
+    w->size = size;
+  }
+
+  memcpy(w->data + w->off, data, len);
+  w->off += len;
+  return 0;
+}
+
+
+int pyg_cache_write_u32(pyg_cache_writer_t* w, size_t val) {
+  uint32_t v;
+
+  if (val > UINT32_MAX)
+    return -1;
+
+  v = val;
+  return pyg_cache_write(w, &v, sizeof(v));
+}
+
+
+int pyg_cache_write_str(pyg_cache_writer_t* w, const char* str) {
+  size_t len;
+
+  len = strlen(str);
+  if (pyg_cache_write_u32(w, len) != 0)
+    return -1;
+  return pyg_cache_write(w, str, len + 1);
+}
+
+
+int pyg_cache_write_value(pyg_cache_writer_t* w, JSON_Value* value) {
+  char tag;
+  size_t i;
+  size_t count;
+
+  switch (json_value_get_type(value)) {
+    case JSONNull:
+      tag = kPygCacheNull;
+      return pyg_cache_write(w, &tag, 1);
+    case JSONBoolean:
+      tag = json_value_get_boolean(value) ? kPygCacheTrue : kPygCacheFalse;
+      return pyg_cache_write(w, &tag, 1);
+    case JSONNumber:
+      {
+        double num;
+
+        tag = kPygCacheNumber;
+        num = json_value_get_number(value);
+        if (pyg_cache_write(w, &tag, 1) != 0)
+          return -1;
+        return pyg_cache_write(w, &num, sizeof(num));
+      }
+    case JSONString:
+      tag = kPygCacheString;
+      if (pyg_cache_write(w, &tag, 1) != 0)
+        return -1;
+      return pyg_cache_write_str(w, json_value_get_string(value));
+    case JSONArray:
+      {
+        JSON_Array* arr;
+
+        tag = kPygCacheArray;
+        arr = json_value_get_array(value);
+        count = json_array_get_count(arr);
+        if (pyg_cache_write(w, &tag, 1) != 0 ||
+            pyg_cache_write_u32(w, count) != 0) {
+          return -1;
+        }
+
+        for (i = 0; i < count; i++)
+          if (pyg_cache_write_value(w, json_array_get_value(arr, i)) != 0)
+            return -1;
+        return 0;
+      }
+    case JSONObject:
+      {
+        JSON_Object* obj;
+
+        tag = kPygCacheObject;
+        obj = json_value_get_object(value);
+        count = json_object_get_count(obj);
+        if (pyg_cache_write(w, &tag, 1) != 0 ||
+            pyg_cache_write_u32(w, count) != 0) {
+          return -1;
+        }
+
+        for (i = 0; i < count; i++) {
+          if (pyg_cache_write_str(w, json_object_get_name(obj, i)) != 0)
+            return -1;
+          if (pyg_cache_write_value(w, json_object_get_value_at(obj, i)) != 0)
+            return -1;
+        }
+        return 0;
+      }
+    default:
+      return -1;
+  }
+}
+
+
+int pyg_cache_write_fd(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t r;
+
+    r = write(fd, data, len);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return -1;
+
+    data += r;
+    len -= r;
+  }
+
+  return 0;
+}
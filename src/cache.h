@@ -0,0 +1,35 @@
+#ifndef SRC_CACHE_H_
+#define SRC_CACHE_H_
+
+#include "src/error.h"
+
+#include "parson.h"
+
+typedef struct pyg_cache_s pyg_cache_t;
+
+/*
+ * On-disk cache of parsed .gyp files, one binary file per source.
+ *
+ * Entry is valid if size and mtime of the source did not change, or (when
+ * only mtime did) if the hash of its contents is still the same. Valid
+ * entries are mapped and turned into the tree without any tokenizing,
+ * strings are borrowed from the mapping.
+ */
+struct pyg_cache_s {
+  char* dir;
+};
+
+/* Creates `dir` if it does not exist */
+pyg_error_t pyg_cache_init(pyg_cache_t* cache, const char* dir);
+void pyg_cache_destroy(pyg_cache_t* cache);
+
+/*
+ * Same as `pyg_gyp_parse_file()`, but goes through the cache. `cache` may be
+ * NULL. Failures to read or write the cache are not errors - the file is
+ * just parsed as usual.
+ */
+pyg_error_t pyg_cache_parse_file(pyg_cache_t* cache,
+                                 const char* path,
+                                 JSON_Value** out);
+
+#endif  /* SRC_CACHE_H_ */
@@ -11,16 +11,81 @@
 
 static const int kPygBufferSize = 1024 * 1024;
 
+/* Loader threads mostly parse, more than this only adds contention */
+static const long kPygMaxJobs = 256;
+
+static struct option pyg_long_options[] = {
+  { "parse-cache", required_argument, NULL, 'c' },
+  { "command-cache", no_argument, NULL, 'x' },
+  { "root-target", required_argument, NULL, 'r' },
+  { "strict-paths", no_argument, NULL, 's' },
+  { "stats", no_argument, NULL, 't' },
+  { NULL, 0, NULL, 0 }
+};
+
+static void pyg_print_stats(pyg_t* pyg);
+static int pyg_parse_jobs(const char* arg, unsigned int* out);
+
+static void pyg_print_usage(const char* name) {
+  fprintf(stderr,
+          "Usage:\n  %s [-j jobs] [--parse-cache dir [--command-cache]] "
+          "[--root-target name] [--strict-paths] [--stats] file.gyp\n",
+          name);
+}
+
+
 int main(int argc, char** argv) {
   pyg_t* pyg;
   pyg_buf_t buf;
   pyg_settings_t settings;
+  pyg_options_t options;
   pyg_error_t err;
+  int stats;
   int r;
+  int c;
 
   r = -1;
-  if (argc < 2) {
-    fprintf(stderr, "Usage:\n  %s file.gyp\n", argv[0]);
+  stats = 0;
+
+  options.jobs = 0;
+  options.parse_cache = NULL;
+  options.command_cache = 0;
+  options.root_target = NULL;
+  options.strict_paths = 0;
+  while ((c = getopt_long(argc, argv, "j:", pyg_long_options, NULL)) != -1) {
+    switch (c) {
+      case 'j':
+        if (pyg_parse_jobs(optarg, &options.jobs) != 0) {
+          fprintf(stderr,
+                  "Invalid -j `%s`, expected a positive number\n",
+                  optarg);
+          pyg_print_usage(argv[0]);
+          goto fail;
+        }
+        break;
+      case 'c':
+        options.parse_cache = optarg;
+        break;
+      case 'x':
+        options.command_cache = 1;
+        break;
+      case 'r':
+        options.root_target = optarg;
+        break;
+      case 's':
+        options.strict_paths = 1;
+        break;
+      case 't':
+        stats = 1;
+        break;
+      default:
+        pyg_print_usage(argv[0]);
+        goto fail;
+    }
+  }
+
+  if (optind >= argc) {
+    pyg_print_usage(argv[0]);
     goto fail;
   }
 
@@ -30,7 +95,7 @@ int main(int argc, char** argv) {
     goto fail;
   }
 
-  err = pyg_new(argv[1], &pyg);
+  err = pyg_new(argv[optind], &options, &pyg);
   if (!pyg_is_ok(err)) {
     pyg_error_print(err, stderr);
     goto failed_pyg_new;
@@ -56,6 +121,9 @@ int main(int argc, char** argv) {
   /* Print output */
   pyg_buf_print(&buf, stdout);
 
+  if (stats)
+    pyg_print_stats(pyg);
+
   r = 0;
 
 failed_pyg_translate:
@@ -70,3 +138,46 @@ failed_pyg_new:
 fail:
   return r;
 }
+
+
+static int pyg_parse_jobs(const char* arg, unsigned int* out) {
+  char* end;
+  long jobs;
+
+  /* Overflow saturates at LONG_MAX, which is capped like any large value */
+  jobs = strtol(arg, &end, 10);
+  if (end == arg || *end != '\0' || jobs < 1)
+    return -1;
+
+  *out = jobs > kPygMaxJobs ? kPygMaxJobs : jobs;
+  return 0;
+}
+
+
+static void pyg_print_stats(pyg_t* pyg) {
+  pyg_stats_t stats;
+  unsigned int total;
+
+  pyg_get_stats(pyg, &stats);
+
+  total = stats.unroll.hits + stats.unroll.misses;
+  fprintf(stderr,
+          "expansions: %u templates, %u hits, %u misses (%.1f%% hit rate)\n",
+          stats.unroll.templates,
+          stats.unroll.hits,
+          stats.unroll.misses,
+          total == 0 ? 0.0 : 100.0 * stats.unroll.hits / total);
+  fprintf(stderr,
+          "variables: %u defined, %u evaluated\n",
+          stats.unroll.variables,
+          stats.unroll.evaluated);
+  fprintf(stderr,
+          "conditions: %u compiled, %u evaluated\n",
+          stats.conditions.conditions,
+          stats.conditions.evaluated);
+  fprintf(stderr,
+          "commands: %u run, %u cached, %u deduplicated\n",
+          stats.commands.run,
+          stats.commands.cached,
+          stats.commands.deduped);
+}
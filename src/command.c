@@ -0,0 +1,881 @@
+#include "src/command.h"
+#include "src/common.h"
+#include "src/intern.h"
+#include "src/queue.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+# define PYG_ST_MTIM(st) ((st)->st_mtimespec)
+#else
+# define PYG_ST_MTIM(st) ((st)->st_mtim)
+#endif  /* __APPLE__ */
+
+extern char** environ;
+
+typedef struct pyg_command_header_s pyg_command_header_t;
+typedef struct pyg_command_input_s pyg_command_input_t;
+typedef struct pyg_command_output_s pyg_command_output_t;
+
+/*
+ * Entry of the on-disk cache is: header, key ("<cwd>\0<command>"), inputs
+ * (each followed by NUL-terminated path), output. Native byte order, as in
+ * src/cache.c.
+ */
+struct pyg_command_header_s {
+  char magic[4];
+  uint32_t version;
+  uint64_t env_hash;
+  uint64_t key_len;
+  uint64_t out_len;
+  uint64_t input_count;
+};
+
+struct pyg_command_input_s {
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t path_len;
+};
+
+struct pyg_command_output_s {
+  char* data;
+  size_t len;
+  size_t size;
+};
+
+static const unsigned int kPygCommandCount = 64;
+static const char kPygCommandMagic[4] = { 'P', 'Y', 'G', 'X' };
+static const uint32_t kPygCommandVersion = 2;
+static const unsigned int kPygCommandMaxInputs = 64;
+static const size_t kPygCommandOutputSize = 4096;
+
+static pyg_command_t* pyg_commands_find(pyg_commands_t* commands,
+                                        const char* cwd,
+                                        const char* cmd,
+                                        unsigned int len,
+                                        int enqueue);
+static pyg_error_t pyg_commands_start(pyg_commands_t* commands);
+static void* pyg_commands_worker(void* arg);
+static void pyg_commands_exec(pyg_commands_t* commands, pyg_command_t* cmd);
+static pyg_error_t pyg_commands_free_cmd(pyg_hashmap_item_t* item, void* arg);
+static uint64_t pyg_commands_env_hash(void);
+
+static pyg_error_t pyg_command_spawn(pyg_commands_t* commands,
+                                     pyg_command_t* cmd,
+                                     pyg_command_output_t* out);
+static pyg_error_t pyg_command_finish(pyg_command_t* cmd,
+                                      const char* data,
+                                      size_t len);
+static int pyg_command_append(pyg_command_output_t* out,
+                              const void* data,
+                              size_t len);
+
+static char* pyg_command_entry_path(pyg_commands_t* commands,
+                                    pyg_command_t* cmd);
+static int pyg_command_inputs(pyg_command_t* cmd, pyg_command_output_t* out);
+static int pyg_command_load(pyg_commands_t* commands,
+                            const char* entry,
+                            pyg_command_t* cmd,
+                            pyg_command_output_t* out);
+static void pyg_command_store(pyg_commands_t* commands,
+                              const char* entry,
+                              pyg_command_t* cmd,
+                              pyg_command_output_t* inputs,
+                              unsigned int input_count,
+                              pyg_command_output_t* out);
+
+
+pyg_error_t pyg_commands_init(pyg_commands_t* commands,
+                              unsigned int jobs,
+                              pyg_cache_t* cache) {
+  pyg_error_t err;
+
+  commands->jobs = jobs;
+  commands->threads = NULL;
+  commands->thread_count = 0;
+  commands->closing = 0;
+  commands->cache = cache;
+  commands->env_hash = cache == NULL ? 0 : pyg_commands_env_hash();
+  memset(&commands->stats, 0, sizeof(commands->stats));
+  QUEUE_INIT(&commands->pending);
+
+  err = pyg_hashmap_init_owned(&commands->map, kPygCommandCount);
+  if (!pyg_is_ok(err))
+    return err;
+
+  if (pthread_mutex_init(&commands->mutex, NULL) != 0) {
+    err = pyg_error_str(kPygErrNoMem, "pthread_mutex_init()");
+    goto failed_mutex_init;
+  }
+  if (pthread_mutex_init(&commands->spawn_mutex, NULL) != 0) {
+    err = pyg_error_str(kPygErrNoMem, "pthread_mutex_init()");
+    goto failed_spawn_init;
+  }
+  if (pthread_cond_init(&commands->pending_cond, NULL) != 0) {
+    err = pyg_error_str(kPygErrNoMem, "pthread_cond_init()");
+    goto failed_pending_init;
+  }
+  if (pthread_cond_init(&commands->done_cond, NULL) != 0) {
+    err = pyg_error_str(kPygErrNoMem, "pthread_cond_init()");
+    goto failed_done_init;
+  }
+
+  return pyg_ok();
+
+failed_done_init:
+  pthread_cond_destroy(&commands->pending_cond);
+
+failed_pending_init:
+  pthread_mutex_destroy(&commands->spawn_mutex);
+
+failed_spawn_init:
+  pthread_mutex_destroy(&commands->mutex);
+
+failed_mutex_init:
+  pyg_hashmap_destroy(&commands->map);
+  return err;
+}
+
+
+void pyg_commands_destroy(pyg_commands_t* commands) {
+  unsigned int i;
+
+  pthread_mutex_lock(&commands->mutex);
+  commands->closing = 1;
+  pthread_cond_broadcast(&commands->pending_cond);
+  pthread_mutex_unlock(&commands->mutex);
+
+  for (i = 0; i < commands->thread_count; i++)
+    pthread_join(commands->threads[i], NULL);
+  free(commands->threads);
+  commands->threads = NULL;
+  commands->thread_count = 0;
+
+  pyg_hashmap_iterate(&commands->map, pyg_commands_free_cmd, NULL);
+  pyg_hashmap_destroy(&commands->map);
+
+  pthread_cond_destroy(&commands->done_cond);
+  pthread_cond_destroy(&commands->pending_cond);
+  pthread_mutex_destroy(&commands->spawn_mutex);
+  pthread_mutex_destroy(&commands->mutex);
+}
+
+
+pyg_error_t pyg_commands_free_cmd(pyg_hashmap_item_t* item, void* arg) {
+  pyg_command_t* cmd;
+
+  cmd = item->value;
+  free(cmd->words.items);
+  free(cmd);
+  return pyg_ok();
+}
+
+
+/* NOTE: Should be called with mutex held */
+pyg_command_t* pyg_commands_find(pyg_commands_t* commands,
+                                 const char* cwd,
+                                 const char* cmd,
+                                 unsigned int len,
+                                 int enqueue) {
+  pyg_command_t* res;
+  char* key;
+  unsigned int cwd_len;
+  unsigned int key_len;
+
+  cwd_len = strlen(cwd);
+  key_len = cwd_len + 1 + len;
+  key = malloc(key_len);
+  if (key == NULL)
+    return NULL;
+  memcpy(key, cwd, cwd_len + 1);
+  memcpy(key + cwd_len + 1, cmd, len);
+
+  res = pyg_hashmap_get(&commands->map, key, key_len);
+  if (res != NULL) {
+    free(key);
+    return res;
+  }
+
+  res = calloc(1, sizeof(*res));
+  if (res == NULL)
+    goto failed_calloc;
+
+  res->state = kPygCommandPending;
+  res->code = kPygOk;
+  QUEUE_INIT(&res->member);
+
+  if (!pyg_is_ok(pyg_hashmap_insert(&commands->map, key, key_len, res)))
+    goto failed_insert;
+
+  /* Owned copy is NUL-terminated, so both parts are C strings */
+  res->key = pyg_hashmap_get_key(&commands->map, key, key_len);
+  res->key_len = key_len;
+  res->cwd = res->key;
+  res->cmd = res->key + cwd_len + 1;
+  free(key);
+
+  if (enqueue) {
+    QUEUE_INSERT_TAIL(&commands->pending, &res->member);
+    pthread_cond_signal(&commands->pending_cond);
+  }
+
+  return res;
+
+failed_insert:
+  free(res);
+
+failed_calloc:
+  free(key);
+  return NULL;
+}
+
+
+/* NOTE: Should be called with mutex held */
+pyg_error_t pyg_commands_start(pyg_commands_t* commands) {
+  unsigned int i;
+
+  if (commands->threads != NULL || commands->jobs <= 1)
+    return pyg_ok();
+
+  commands->threads = calloc(commands->jobs, sizeof(*commands->threads));
+  if (commands->threads == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_commands_t.threads");
+
+  for (i = 0; i < commands->jobs; i++) {
+    if (pthread_create(&commands->threads[i],
+                       NULL,
+                       pyg_commands_worker,
+                       commands) != 0) {
+      break;
+    }
+  }
+  commands->thread_count = i;
+
+  /* Could not start any thread - fallback to running on demand */
+  if (i == 0)
+    commands->jobs = 0;
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_commands_submit(pyg_commands_t* commands,
+                                const char* cwd,
+                                const char* cmd,
+                                unsigned int len) {
+  pyg_error_t err;
+  pyg_command_t* res;
+
+  pthread_mutex_lock(&commands->mutex);
+  err = pyg_commands_start(commands);
+
+  /* Nobody to pick it up, `pyg_commands_run` will do it */
+  if (pyg_is_ok(err) && commands->thread_count != 0 && !commands->closing) {
+    res = pyg_commands_find(commands, cwd, cmd, len, 1);
+    if (res == NULL)
+      err = pyg_error_str(kPygErrNoMem, "pyg_command_t");
+  }
+  pthread_mutex_unlock(&commands->mutex);
+
+  return err;
+}
+
+
+pyg_error_t pyg_commands_run(pyg_commands_t* commands,
+                             const char* cwd,
+                             const char* cmd,
+                             unsigned int len,
+                             pyg_command_t** out) {
+  pyg_error_t err;
+  pyg_command_t* res;
+
+  pthread_mutex_lock(&commands->mutex);
+
+  res = pyg_commands_find(commands, cwd, cmd, len, 0);
+  if (res == NULL) {
+    pthread_mutex_unlock(&commands->mutex);
+    return pyg_error_str(kPygErrNoMem, "pyg_command_t");
+  }
+
+  if (res->requested)
+    commands->stats.deduped++;
+  res->requested = 1;
+
+  /* Nobody has started it yet - do it ourselves instead of waiting */
+  if (res->state == kPygCommandPending) {
+    QUEUE_REMOVE(&res->member);
+    QUEUE_INIT(&res->member);
+    pyg_commands_exec(commands, res);
+  }
+
+  while (res->state != kPygCommandDone)
+    pthread_cond_wait(&commands->done_cond, &commands->mutex);
+
+  if (res->code != kPygOk) {
+    err = pyg_error_str(res->code, "%s", res->msg);
+  } else {
+    *out = res;
+    err = pyg_ok();
+  }
+
+  pthread_mutex_unlock(&commands->mutex);
+  return err;
+}
+
+
+void* pyg_commands_worker(void* arg) {
+  pyg_commands_t* commands;
+
+  commands = arg;
+
+  pthread_mutex_lock(&commands->mutex);
+  for (;;) {
+    QUEUE* q;
+    pyg_command_t* cmd;
+
+    while (QUEUE_EMPTY(&commands->pending) && !commands->closing)
+      pthread_cond_wait(&commands->pending_cond, &commands->mutex);
+    if (commands->closing)
+      break;
+
+    q = QUEUE_HEAD(&commands->pending);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);
+
+    cmd = container_of(q, pyg_command_t, member);
+    pyg_commands_exec(commands, cmd);
+  }
+  pthread_mutex_unlock(&commands->mutex);
+
+  return NULL;
+}
+
+
+/* NOTE: Should be called with mutex held */
+void pyg_commands_exec(pyg_commands_t* commands, pyg_command_t* cmd) {
+  pyg_error_t err;
+  pyg_command_output_t out;
+  pyg_command_output_t inputs;
+  char* entry;
+  int input_count;
+  int cached;
+
+  cmd->state = kPygCommandRunning;
+  pthread_mutex_unlock(&commands->mutex);
+
+  memset(&out, 0, sizeof(out));
+  memset(&inputs, 0, sizeof(inputs));
+  entry = NULL;
+  input_count = -1;
+  cached = 0;
+
+  if (commands->cache != NULL) {
+    entry = pyg_command_entry_path(commands, cmd);
+    if (entry != NULL)
+      cached = pyg_command_load(commands, entry, cmd, &out) == 0;
+
+    /* Stat inputs before running, so changes made meanwhile are noticed */
+    if (entry != NULL && !cached)
+      input_count = pyg_command_inputs(cmd, &inputs);
+  }
+
+  if (cached) {
+    err = pyg_ok();
+  } else {
+    err = pyg_command_spawn(commands, cmd, &out);
+    if (pyg_is_ok(err) && input_count >= 0)
+      pyg_command_store(commands, entry, cmd, &inputs, input_count, &out);
+  }
+
+  if (pyg_is_ok(err))
+    err = pyg_command_finish(cmd, out.data, out.len);
+
+  free(inputs.data);
+  free(out.data);
+  free(entry);
+
+  pthread_mutex_lock(&commands->mutex);
+  if (cached)
+    commands->stats.cached++;
+  else
+    commands->stats.run++;
+
+  cmd->state = kPygCommandDone;
+  cmd->code = err.code;
+  if (!pyg_is_ok(err)) {
+    /* Error string is thread-local, copy it out */
+    snprintf(cmd->msg,
+             sizeof(cmd->msg),
+             "%s",
+             err.str == NULL ? "" : err.str);
+  }
+  pthread_cond_broadcast(&commands->done_cond);
+}
+
+
+pyg_error_t pyg_command_spawn(pyg_commands_t* commands,
+                              pyg_command_t* cmd,
+                              pyg_command_output_t* out) {
+  int fds[2];
+  pid_t pid;
+  int status;
+  int failed;
+  char buf[4096];
+
+  /* Keep other children from inheriting the write end and delaying EOF */
+  pthread_mutex_lock(&commands->spawn_mutex);
+  if (pipe(fds) != 0) {
+    pthread_mutex_unlock(&commands->spawn_mutex);
+    return pyg_error_str(kPygErrFS, "pipe() failed for `%s`", cmd->cmd);
+  }
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+  pid = fork();
+  if (pid == 0) {
+    int null;
+
+    /* Only async-signal-safe calls from here */
+    null = open("/dev/null", O_RDONLY);
+    if (null != -1)
+      dup2(null, 0);
+    dup2(fds[1], 1);
+    if (chdir(cmd->cwd) != 0)
+      _exit(127);
+    execl("/bin/sh", "sh", "-c", cmd->cmd, (char*) NULL);
+    _exit(127);
+  }
+  pthread_mutex_unlock(&commands->spawn_mutex);
+
+  close(fds[1]);
+  if (pid == -1) {
+    close(fds[0]);
+    return pyg_error_str(kPygErrFS, "fork() failed for `%s`", cmd->cmd);
+  }
+
+  failed = 0;
+  for (;;) {
+    ssize_t r;
+
+    r = read(fds[0], buf, sizeof(buf));
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      break;
+
+    /* Keep reading on allocation failure, so the child does not block */
+    if (!failed && pyg_command_append(out, buf, r) != 0)
+      failed = 1;
+  }
+  close(fds[0]);
+
+  while (waitpid(pid, &status, 0) == -1) {
+    if (errno != EINTR)
+      return pyg_error_str(kPygErrFS, "waitpid() failed for `%s`", cmd->cmd);
+  }
+
+  if (WIFSIGNALED(status)) {
+    return pyg_error_str(kPygErrGYP,
+                         "Command `%s` killed by signal %d",
+                         cmd->cmd,
+                         WTERMSIG(status));
+  }
+  if (WEXITSTATUS(status) != 0) {
+    return pyg_error_str(kPygErrGYP,
+                         "Command `%s` failed with exit code %d",
+                         cmd->cmd,
+                         WEXITSTATUS(status));
+  }
+  if (failed)
+    return pyg_error_str(kPygErrNoMem, "Output of `%s`", cmd->cmd);
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_command_finish(pyg_command_t* cmd,
+                               const char* data,
+                               size_t len) {
+  pyg_list_t* list;
+  char* words;
+  size_t i;
+  size_t j;
+  unsigned int count;
+
+  if (data == NULL)
+    data = "";
+
+  /* Same as GYP, trailing newline and spaces are not part of the value */
+  while (len > 0 && (data[len - 1] == ' ' || data[len - 1] == '\t' ||
+                     data[len - 1] == '\r' || data[len - 1] == '\n')) {
+    len--;
+  }
+
+  words = malloc(len + 1);
+  if (words == NULL)
+    return pyg_error_str(kPygErrNoMem, "Words of `%s`", cmd->cmd);
+
+  /* Every run of whitespace is replaced by a single space */
+  for (i = 0, j = 0, count = 0; i < len; i++) {
+    int space;
+
+    space = data[i] == ' ' || data[i] == '\t' || data[i] == '\r' ||
+            data[i] == '\n';
+    if (!space) {
+      if (j == 0 || words[j - 1] == ' ')
+        count++;
+      words[j++] = data[i];
+    } else if (j != 0 && words[j - 1] != ' ') {
+      words[j++] = ' ';
+    }
+  }
+
+  cmd->value.type = kPygValueStr;
+  cmd->value.str = pyg_intern(data, len);
+  cmd->value.len = len;
+
+  list = &cmd->words;
+  list->count = count;
+  list->paths = NULL;
+  list->resolved = 0;
+  list->items = malloc(count * sizeof(*list->items) + 1);
+  cmd->list.type = kPygValueList;
+  cmd->list.str = pyg_intern(words, j);
+  cmd->list.len = j;
+  cmd->list.value.list = list;
+
+  if (list->items != NULL) {
+    const char* p;
+    const char* end;
+
+    p = words;
+    end = words + j;
+    for (i = 0; i < count; i++) {
+      const char* space;
+
+      space = memchr(p, ' ', end - p);
+      if (space == NULL)
+        space = end;
+      list->items[i] = pyg_intern(p, space - p);
+      if (list->items[i] == NULL)
+        break;
+      p = space + 1;
+    }
+  }
+  free(words);
+
+  if (cmd->value.str == NULL || cmd->list.str == NULL ||
+      list->items == NULL || i != count) {
+    return pyg_error_str(kPygErrNoMem, "Output of `%s`", cmd->cmd);
+  }
+
+  return pyg_ok();
+}
+
+
+int pyg_command_append(pyg_command_output_t* out,
+                       const void* data,
+                       size_t len) {
+  if (len == 0)
+    return 0;
+
+  if (out->size - out->len < len) {
+    char* tmp;
+    size_t size;
+
+    size = out->size == 0 ? kPygCommandOutputSize : out->size;
+    while (size - out->len < len)
+      size *= 2;
+
+    tmp = realloc(out->data, size);
+    if (tmp == NULL)
+      return -1;
+    out->data = tmp;
+    out->size = size;
+  }
+
+  memcpy(out->data + out->len, data, len);
+  out->len += len;
+  return 0;
+}
+
+
+uint64_t pyg_commands_env_hash(void) {
+  char** p;
+  uint64_t res;
+
+  /* Commands see all of it: PATH, PKG_CONFIG_*, variables they echo... */
+  res = 0;
+  for (p = environ; p != NULL && *p != NULL; p++)
+    res = res * 31 + pyg_hash64(*p, strlen(*p));
+  return res;
+}
+
+
+char* pyg_command_entry_path(pyg_commands_t* commands, pyg_command_t* cmd) {
+  char* res;
+  size_t len;
+
+  /* dir + '/' + 16 hex digits + ".pygx" */
+  len = strlen(commands->cache->dir) + 1 + 16 + 5 + 1;
+  res = malloc(len);
+  if (res == NULL)
+    return NULL;
+
+  /* Different environments should not evict each other's entries */
+  snprintf(res,
+           len,
+           "%s/%016" PRIx64 ".pygx",
+           commands->cache->dir,
+           pyg_hash64(cmd->key, cmd->key_len) ^ commands->env_hash);
+  return res;
+}
+
+
+/*
+ * Working directory and every argument that names an existing file or
+ * directory (relative to it), with redirections (`<file`, `>file`) and
+ * trailing separators stripped. Returns number of inputs, or -1 on failure
+ * or if there are more than `kPygCommandMaxInputs` of them (such commands
+ * are not cached).
+ */
+int pyg_command_inputs(pyg_command_t* cmd, pyg_command_output_t* out) {
+  const char* p;
+  unsigned int count;
+
+  count = 0;
+  for (p = NULL;;) {
+    pyg_command_input_t input;
+    struct stat st;
+    char path[PATH_MAX];
+    const char* word;
+    size_t len;
+    int r;
+
+    if (p == NULL) {
+      /* The directory itself goes first */
+      r = snprintf(path, sizeof(path), "%s", cmd->cwd);
+      p = cmd->cmd;
+    } else {
+      p += strspn(p, " \t\r\n");
+      if (*p == '\0')
+        break;
+
+      word = p;
+      len = strcspn(p, " \t\r\n");
+      p += len;
+
+      /* Strip redirections and separators, then quotes, skip flags */
+      while (len > 0 && (word[0] == '<' || word[0] == '>')) {
+        word++;
+        len--;
+      }
+      while (len > 0 && (word[len - 1] == ';' || word[len - 1] == ')'))
+        len--;
+      if (len >= 2 && (word[0] == '\'' || word[0] == '"') &&
+          word[len - 1] == word[0]) {
+        word++;
+        len -= 2;
+      }
+      if (len == 0 || word[0] == '-')
+        continue;
+
+      if (word[0] == '/') {
+        r = snprintf(path, sizeof(path), "%.*s", (int) len, word);
+      } else {
+        r = snprintf(path,
+                     sizeof(path),
+                     "%s/%.*s",
+                     cmd->cwd,
+                     (int) len,
+                     word);
+      }
+    }
+    if (r < 0 || (size_t) r >= sizeof(path) || stat(path, &st) != 0)
+      continue;
+
+    /* Partial set of inputs would miss changes to the rest */
+    if (count == kPygCommandMaxInputs)
+      return -1;
+
+    input.size = st.st_size;
+    input.mtime_sec = PYG_ST_MTIM(&st).tv_sec;
+    input.mtime_nsec = PYG_ST_MTIM(&st).tv_nsec;
+    input.path_len = r;
+    if (pyg_command_append(out, &input, sizeof(input)) != 0 ||
+        pyg_command_append(out, path, r + 1) != 0) {
+      return -1;
+    }
+    count++;
+  }
+
+  return count;
+}
+
+
+int pyg_command_load(pyg_commands_t* commands,
+                     const char* entry,
+                     pyg_command_t* cmd,
+                     pyg_command_output_t* out) {
+  pyg_command_header_t h;
+  pyg_command_output_t data;
+  char buf[4096];
+  const char* p;
+  const char* end;
+  uint64_t i;
+  int fd;
+
+  fd = open(entry, O_RDONLY);
+  if (fd == -1)
+    return -1;
+
+  memset(&data, 0, sizeof(data));
+  for (;;) {
+    ssize_t r;
+
+    r = read(fd, buf, sizeof(buf));
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0)
+      goto fail;
+    if (r == 0)
+      break;
+    if (pyg_command_append(&data, buf, r) != 0)
+      goto fail;
+  }
+  close(fd);
+  fd = -1;
+
+  p = data.data;
+  end = p + data.len;
+  if ((size_t) (end - p) < sizeof(h))
+    goto fail;
+  memcpy(&h, p, sizeof(h));
+  p += sizeof(h);
+
+  if (memcmp(h.magic, kPygCommandMagic, sizeof(kPygCommandMagic)) != 0 ||
+      h.version != kPygCommandVersion ||
+      h.env_hash != commands->env_hash ||
+      h.key_len != cmd->key_len ||
+      (uint64_t) (end - p) < h.key_len ||
+      memcmp(p, cmd->key, cmd->key_len) != 0) {
+    goto fail;
+  }
+  p += h.key_len;
+
+  /* Every input should be intact */
+  for (i = 0; i < h.input_count; i++) {
+    pyg_command_input_t input;
+    struct stat st;
+
+    if ((size_t) (end - p) < sizeof(input))
+      goto fail;
+    memcpy(&input, p, sizeof(input));
+    p += sizeof(input);
+
+    if ((uint64_t) (end - p) <= input.path_len || p[input.path_len] != '\0')
+      goto fail;
+    if (stat(p, &st) != 0 ||
+        input.size != (int64_t) st.st_size ||
+        input.mtime_sec != (int64_t) PYG_ST_MTIM(&st).tv_sec ||
+        input.mtime_nsec != (int64_t) PYG_ST_MTIM(&st).tv_nsec) {
+      goto fail;
+    }
+    p += input.path_len + 1;
+  }
+
+  if ((uint64_t) (end - p) != h.out_len)
+    goto fail;
+
+  /* Output is at the end, move it to the front */
+  memmove(data.data, p, h.out_len);
+  data.len = h.out_len;
+  *out = data;
+  return 0;
+
+fail:
+  if (fd != -1)
+    close(fd);
+  free(data.data);
+  return -1;
+}
+
+
+void pyg_command_store(pyg_commands_t* commands,
+                       const char* entry,
+                       pyg_command_t* cmd,
+                       pyg_command_output_t* inputs,
+                       unsigned int input_count,
+                       pyg_command_output_t* out) {
+  pyg_command_header_t h;
+  pyg_command_output_t data;
+  char tmp[PATH_MAX];
+  const char* p;
+  size_t len;
+  int fd;
+  int r;
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, kPygCommandMagic, sizeof(kPygCommandMagic));
+  h.version = kPygCommandVersion;
+  h.env_hash = commands->env_hash;
+  h.key_len = cmd->key_len;
+  h.out_len = out->len;
+  h.input_count = input_count;
+
+  memset(&data, 0, sizeof(data));
+  if (pyg_command_append(&data, &h, sizeof(h)) != 0 ||
+      pyg_command_append(&data, cmd->key, cmd->key_len) != 0 ||
+      pyg_command_append(&data, inputs->data, inputs->len) != 0 ||
+      pyg_command_append(&data, out->data, out->len) != 0) {
+    goto failed_append;
+  }
+
+  /* Other processes should never see partially written entry */
+  r = snprintf(tmp,
+               sizeof(tmp),
+               "%s.%d.%p.tmp",
+               entry,
+               (int) getpid(),
+               (void*) cmd);
+  if (r < 0 || (size_t) r >= sizeof(tmp))
+    goto failed_append;
+
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1)
+    goto failed_append;
+
+  r = 0;
+  for (p = data.data, len = data.len; len > 0;) {
+    ssize_t w;
+
+    w = write(fd, p, len);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0) {
+      r = -1;
+      break;
+    }
+    p += w;
+    len -= w;
+  }
+  if (close(fd) != 0)
+    r = -1;
+  if (r != 0 || rename(tmp, entry) != 0)
+    unlink(tmp);
+
+failed_append:
+  free(data.data);
+}
@@ -0,0 +1,116 @@
+#ifndef SRC_COMMAND_H_
+#define SRC_COMMAND_H_
+
+#include "src/cache.h"
+#include "src/common.h"
+#include "src/error.h"
+#include "src/queue.h"
+
+#include <pthread.h>
+
+typedef struct pyg_commands_s pyg_commands_t;
+typedef struct pyg_command_s pyg_command_t;
+typedef struct pyg_command_stats_s pyg_command_stats_t;
+
+enum pyg_command_state_e {
+  kPygCommandPending,
+  kPygCommandRunning,
+  kPygCommandDone
+};
+typedef enum pyg_command_state_e pyg_command_state_t;
+
+struct pyg_command_s {
+  /* "<cwd>\0<command>", owned by `pyg_commands_t.map` */
+  const char* key;
+  unsigned int key_len;
+  const char* cwd;
+  const char* cmd;
+
+  pyg_command_state_t state;
+  int requested;
+  pyg_error_code_t code;
+  char msg[1024];
+
+  /* Interned stdout without trailing whitespace */
+  pyg_value_t value;
+
+  /* Interned words of stdout, `list` points to `words` */
+  pyg_value_t list;
+  pyg_list_t words;
+
+  QUEUE member;
+};
+
+struct pyg_command_stats_s {
+  /* Processes spawned */
+  unsigned int run;
+
+  /* Results reused from the on-disk cache */
+  unsigned int cached;
+
+  /* Requests answered by a command that was already known */
+  unsigned int deduped;
+};
+
+/*
+ * Output of `<!(command)` expansions. Every distinct command (and working
+ * directory) is run once per `pyg_new()`, by a pool of at most `jobs`
+ * threads, each waiting for one `/bin/sh -c` child. Commands can be
+ * submitted as soon as they are seen and picked up later, so independent
+ * commands run concurrently.
+ *
+ * With `cache` (`--command-cache`, opt-in), results are stored next to the
+ * parsed files and reused while the environment stays the same, and the
+ * working directory and the arguments of the command that name existing
+ * files or directories (`<file` redirections included) keep their size and
+ * mtime. Anything else the command reads is not tracked.
+ */
+struct pyg_commands_s {
+  unsigned int jobs;
+  pthread_t* threads;
+  unsigned int thread_count;
+  int closing;
+
+  /* May be NULL */
+  pyg_cache_t* cache;
+
+  /* `pyg_hash64()` of the whole environment, part of every cache entry */
+  uint64_t env_hash;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t pending_cond;
+  pthread_cond_t done_cond;
+
+  /* Held from `pipe()` to `fork()`, so children inherit no foreign pipes */
+  pthread_mutex_t spawn_mutex;
+
+  /* "<cwd>\0<command>" => pyg_command_t */
+  pyg_hashmap_t map;
+  QUEUE pending;
+
+  pyg_command_stats_t stats;
+};
+
+/* `jobs` <= 1 - no threads, commands are run on demand in `run` */
+pyg_error_t pyg_commands_init(pyg_commands_t* commands,
+                              unsigned int jobs,
+                              pyg_cache_t* cache);
+void pyg_commands_destroy(pyg_commands_t* commands);
+
+/* Start `cmd` in background, no-op if already seen. Thread-safe. */
+pyg_error_t pyg_commands_submit(pyg_commands_t* commands,
+                                const char* cwd,
+                                const char* cmd,
+                                unsigned int len);
+
+/*
+ * Wait for (or run) `cmd` in `cwd`. Result is owned by `commands` and lives
+ * until `pyg_commands_destroy()`. Thread-safe.
+ */
+pyg_error_t pyg_commands_run(pyg_commands_t* commands,
+                             const char* cwd,
+                             const char* cmd,
+                             unsigned int len,
+                             pyg_command_t** out);
+
+#endif  /* SRC_COMMAND_H_ */
@@ -1,17 +1,21 @@
 #include "src/common.h"
 #include "src/error.h"
+#include "src/intern.h"
 
 #include "parson.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-#define PYG_MURMUR3_C1 0xcc9e2d51
-#define PYG_MURMUR3_C2 0x1b873593
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif  /* __SSE2__ */
 
 #ifdef _MSC_VER
 static const char dir_sep = '\\';
@@ -19,69 +23,224 @@ static const char dir_sep = '\\';
 static const char dir_sep = '/';
 #endif
 
+static const unsigned int kPygPathDirCount = 64;
 
-static uint32_t pyg_murmur3(const char* key, uint32_t len) {
-  uint32_t hash;
-  const uint32_t* chunks;
-  int chunk_count;
-  int i;
-  uint32_t tail;
+static unsigned int pyg_path_normalize(char* path, unsigned int len);
+static pyg_error_t pyg_path_realdir(const char* dir,
+                                    unsigned int len,
+                                    const char** out);
 
-  hash = 0;
+static pthread_mutex_t pyg_path_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t pyg_path_lock = PTHREAD_RWLOCK_INITIALIZER;
+static unsigned int pyg_path_refs;
 
-  /* FIXME(indutny): this leads to unaligned loads for some keys */
-  chunks = (const uint32_t*) key;
-  chunk_count = len / 4;
-  for (i = 0; i < chunk_count; i++) {
-    uint32_t k;
+/* Interned normalized directory => interned realpath */
+static pyg_hashmap_t pyg_path_dirs;
 
-    k = chunks[i];
-    k *= PYG_MURMUR3_C1;
-    k = (k << 15) | (k >> 17);
-    k *= PYG_MURMUR3_C2;
 
-    hash ^= k;
-    hash = (hash << 13) | (hash >> 19);
-    hash *= 5;
-    hash += 0xe6546b64;
-  }
+/*
+ * wyhash (final version 4), seed is always zero. All loads go through
+ * `memcpy()`, so keys do not have to be aligned.
+ */
+static const uint64_t kPygWySecret[4] = {
+  0x2d358dccaa6c78a5ULL,
+  0x8bb84b93962eacc9ULL,
+  0x4b33a62ed433d4a3ULL,
+  0x4d5a2da51de1aa47ULL
+};
 
-  tail = 0;
-  chunk_count *= 4;
-  for (i = len - 1; i >= chunk_count; i--) {
-    tail <<= 8;
-    tail += key[i];
-  }
-  if (tail != 0) {
-    tail *= PYG_MURMUR3_C1;
-    tail = (tail << 15) | (tail >> 17);
-    tail *= PYG_MURMUR3_C2;
 
-    hash ^= tail;
+/* 64x64 => 128 bit product, `*a` receives low and `*b` - high half */
+static void pyg_wymum(uint64_t* a, uint64_t* b) {
+#ifdef __SIZEOF_INT128__
+  __extension__ unsigned __int128 r;
+
+  r = *a;
+  r *= *b;
+  *a = (uint64_t) r;
+  *b = (uint64_t) (r >> 64);
+#else
+  uint64_t ha;
+  uint64_t hb;
+  uint64_t la;
+  uint64_t lb;
+  uint64_t rh;
+  uint64_t rm0;
+  uint64_t rm1;
+  uint64_t rl;
+  uint64_t t;
+  uint64_t c;
+
+  ha = *a >> 32;
+  hb = *b >> 32;
+  la = (uint32_t) *a;
+  lb = (uint32_t) *b;
+  rh = ha * hb;
+  rm0 = ha * lb;
+  rm1 = hb * la;
+  rl = la * lb;
+  t = rl + (rm0 << 32);
+  c = t < rl;
+  *a = t + (rm1 << 32);
+  c += *a < t;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif  /* __SIZEOF_INT128__ */
+}
+
+
+static uint64_t pyg_wymix(uint64_t a, uint64_t b) {
+  pyg_wymum(&a, &b);
+  return a ^ b;
+}
+
+
+static uint64_t pyg_wyr8(const uint8_t* p) {
+  uint64_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+
+static uint64_t pyg_wyr4(const uint8_t* p) {
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+
+/* 1-3 bytes */
+static uint64_t pyg_wyr3(const uint8_t* p, size_t k) {
+  return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) | p[k - 1];
+}
+
+
+static uint64_t pyg_wyhash(const void* key, size_t len) {
+  const uint8_t* p;
+  const uint64_t* s;
+  uint64_t seed;
+  uint64_t a;
+  uint64_t b;
+
+  p = key;
+  s = kPygWySecret;
+  seed = pyg_wymix(s[0], s[1]);
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (pyg_wyr4(p) << 32) | pyg_wyr4(p + ((len >> 3) << 2));
+      b = (pyg_wyr4(p + len - 4) << 32) |
+          pyg_wyr4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = pyg_wyr3(p, len);
+      b = 0;
+    } else {
+      a = 0;
+      b = 0;
+    }
+  } else {
+    size_t i;
+
+    i = len;
+    if (i > 48) {
+      uint64_t see1;
+      uint64_t see2;
+
+      see1 = seed;
+      see2 = seed;
+      do {
+        seed = pyg_wymix(pyg_wyr8(p) ^ s[1], pyg_wyr8(p + 8) ^ seed);
+        see1 = pyg_wymix(pyg_wyr8(p + 16) ^ s[2], pyg_wyr8(p + 24) ^ see1);
+        see2 = pyg_wymix(pyg_wyr8(p + 32) ^ s[3], pyg_wyr8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+
+    while (i > 16) {
+      seed = pyg_wymix(pyg_wyr8(p) ^ s[1], pyg_wyr8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+
+    a = pyg_wyr8(p + i - 16);
+    b = pyg_wyr8(p + i - 8);
   }
 
-  hash ^= len;
+  a ^= s[1];
+  b ^= seed;
+  pyg_wymum(&a, &b);
+  return pyg_wymix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+
+uint64_t pyg_hash(const char* key, unsigned int len) {
+  return pyg_wyhash(key, len);
+}
 
-  hash ^= hash >> 16;
-  hash *= 0x85ebca6b;
-  hash ^= hash >> 13;
-  hash *= 0xc2b2ae35;
-  hash ^= hash >> 16;
 
-  return hash;
+/* Same function, for file contents and other long data */
+uint64_t pyg_hash64(const void* data, size_t len) {
+  return pyg_wyhash(data, len);
 }
 
 
-#undef PYG_MURMUR3_C1
-#undef PYG_MURMUR3_C2
+/*
+ * SwissTable-style open addressing. Every slot has a control byte: empty,
+ * deleted, or low 7 bits of the hash for full slots. Probing goes over groups
+ * of `PYG_HASHMAP_GROUP` control bytes, compared at once (with SSE2 when
+ * available), and stops at the first group with an empty slot. First
+ * `PYG_HASHMAP_GROUP` control bytes are mirrored past the end, so groups can
+ * be loaded from any position without wrapping.
+ */
+#define PYG_HASHMAP_GROUP 16
+#define PYG_HASHMAP_EMPTY 0x80
+#define PYG_HASHMAP_DELETED 0xfe
+#define PYG_HASHMAP_H1(hash) ((hash) >> 7)
+#define PYG_HASHMAP_H2(hash) ((uint8_t) ((hash) & 0x7f))
+
+/* Maximum load factor is 7/8, including deleted slots */
+#define PYG_HASHMAP_MAX_LOAD(size) ((size) - (size) / 8)
+
+
+static pyg_error_t pyg_hashmap_alloc(pyg_hashmap_t* hashmap,
+                                     unsigned int size);
+static pyg_error_t pyg_hashmap_resize(pyg_hashmap_t* hashmap,
+                                      unsigned int size);
+static unsigned int pyg_hashmap_match(const uint8_t* group, uint8_t byte);
+static unsigned int pyg_hashmap_find_free(pyg_hashmap_t* hashmap,
+                                          uint64_t hash);
+static void pyg_hashmap_set_ctrl(pyg_hashmap_t* hashmap,
+                                 unsigned int i,
+                                 uint8_t ctrl);
+static pyg_hashmap_item_t* pyg_hashmap_get_int(pyg_hashmap_t* hashmap,
+                                               const char* key,
+                                               unsigned int key_len,
+                                               uint64_t hash);
 
 
 pyg_error_t pyg_hashmap_init(pyg_hashmap_t* hashmap, unsigned int size) {
-  hashmap->size = size;
-  hashmap->space = calloc(size, sizeof(*hashmap->space));
-  if (hashmap->space == NULL)
-    return pyg_error_str(kPygErrNoMem, "pyg_hashmap_item_t");
+  unsigned int pow2;
+
+  /* Power of two, not less than a group */
+  for (pow2 = PYG_HASHMAP_GROUP; pow2 < size; pow2 <<= 1) {
+  }
+
+  hashmap->owns_keys = 0;
+  pyg_arena_init(&hashmap->keys);
+  return pyg_hashmap_alloc(hashmap, pow2);
+}
+
+
+pyg_error_t pyg_hashmap_init_owned(pyg_hashmap_t* hashmap, unsigned int size) {
+  pyg_error_t err;
 
+  err = pyg_hashmap_init(hashmap, size);
+  if (!pyg_is_ok(err))
+    return err;
+
+  hashmap->owns_keys = 1;
   return pyg_ok();
 }
 
@@ -91,110 +250,277 @@ void pyg_hashmap_destroy(pyg_hashmap_t* hashmap) {
     return;
 
   free(hashmap->space);
+  free(hashmap->ctrl);
   hashmap->space = NULL;
+  hashmap->ctrl = NULL;
+
+  pyg_arena_destroy(&hashmap->keys);
 }
 
 
-/* A bit sparse, but should be fast */
-#define PYG_HASHMAP_MAX_ITER 3
-#define PYG_HASHMAP_GROW_DELTA 1024
+pyg_error_t pyg_hashmap_alloc(pyg_hashmap_t* hashmap, unsigned int size) {
+  hashmap->ctrl = malloc(size + PYG_HASHMAP_GROUP);
+  if (hashmap->ctrl == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_hashmap_t ctrl");
 
+  hashmap->space = malloc(size * sizeof(*hashmap->space));
+  if (hashmap->space == NULL) {
+    free(hashmap->ctrl);
+    hashmap->ctrl = NULL;
+    return pyg_error_str(kPygErrNoMem, "pyg_hashmap_item_t");
+  }
 
-static pyg_hashmap_item_t* pyg_hashmap_get_int(pyg_hashmap_t* hashmap,
-                                               const char* key,
-                                               unsigned int key_len,
-                                               int insert) {
-  do {
-    uint32_t i;
-    uint32_t iter;
-    pyg_hashmap_item_t* space;
-    unsigned int size;
-    pyg_hashmap_t old_map;
-
-    i = pyg_murmur3(key, key_len) % hashmap->size;
-    for (iter = 0;
-         iter < PYG_HASHMAP_MAX_ITER;
-         iter++, i = (i + 1) % hashmap->size) {
-      if (hashmap->space[i].key == NULL)
-        break;
-      if (!insert) {
-        if (hashmap->space[i].key_len == key_len &&
-            memcmp(hashmap->space[i].key, key, key_len) == 0) {
-          break;
-        }
-      }
-    }
+  memset(hashmap->ctrl, PYG_HASHMAP_EMPTY, size + PYG_HASHMAP_GROUP);
+  hashmap->size = size;
+  hashmap->count = 0;
+  hashmap->deleted = 0;
 
-    if (!insert && hashmap->space[i].key == NULL)
-      return NULL;
+  return pyg_ok();
+}
 
-    /* Found a spot */
-    if (iter != PYG_HASHMAP_MAX_ITER)
-      return &hashmap->space[i];
 
-    /* No match */
-    if (!insert)
-      return NULL;
+/* Reinsert everything into new space, deleted slots are dropped */
+pyg_error_t pyg_hashmap_resize(pyg_hashmap_t* hashmap, unsigned int size) {
+  pyg_error_t err;
+  pyg_hashmap_t old_map;
+  unsigned int i;
 
-    /* Grow and retry */
-    size = hashmap->size += PYG_HASHMAP_GROW_DELTA;
-    space = calloc(size, sizeof(*space));
-    if (space == NULL)
-      return NULL;
+  old_map = *hashmap;
+  err = pyg_hashmap_alloc(hashmap, size);
+  if (!pyg_is_ok(err)) {
+    *hashmap = old_map;
+    return err;
+  }
+
+  for (i = 0; i < old_map.size; i++) {
+    pyg_hashmap_item_t* item;
+    unsigned int j;
+
+    if ((old_map.ctrl[i] & PYG_HASHMAP_EMPTY) != 0)
+      continue;
+
+    item = &old_map.space[i];
+    j = pyg_hashmap_find_free(hashmap, item->hash);
+    pyg_hashmap_set_ctrl(hashmap, j, PYG_HASHMAP_H2(item->hash));
+    hashmap->space[j] = *item;
+    hashmap->count++;
+  }
+
+  free(old_map.space);
+  free(old_map.ctrl);
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_hashmap_clone(pyg_hashmap_t* hashmap, pyg_hashmap_t* from) {
+  pyg_error_t err;
+
+  hashmap->owns_keys = 0;
+  pyg_arena_init(&hashmap->keys);
+
+  /* Same size and hashes - same slots, no need to reinsert */
+  err = pyg_hashmap_alloc(hashmap, from->size);
+  if (!pyg_is_ok(err))
+    return err;
+
+  memcpy(hashmap->ctrl, from->ctrl, from->size + PYG_HASHMAP_GROUP);
+  memcpy(hashmap->space, from->space, from->size * sizeof(*from->space));
+  hashmap->count = from->count;
+  hashmap->deleted = from->deleted;
+
+  return pyg_ok();
+}
+
+
+/* Bit mask of bytes in the group equal to `byte` */
+unsigned int pyg_hashmap_match(const uint8_t* group, uint8_t byte) {
+#ifdef __SSE2__
+  __m128i v;
+
+  v = _mm_loadu_si128((const __m128i*) group);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char) byte)));
+#else
+  unsigned int mask;
+  unsigned int i;
+
+  mask = 0;
+  for (i = 0; i < PYG_HASHMAP_GROUP; i++)
+    if (group[i] == byte)
+      mask |= 1U << i;
+  return mask;
+#endif  /* __SSE2__ */
+}
 
-    /* Rehash */
-    old_map = *hashmap;
-    hashmap->space = space;
-    hashmap->size = size;
-    for (i = 0; i < old_map.size; i++) {
+
+/* NOTE: There is always an empty slot, the load factor is below 1 */
+unsigned int pyg_hashmap_find_free(pyg_hashmap_t* hashmap, uint64_t hash) {
+  unsigned int mask;
+  unsigned int pos;
+  unsigned int stride;
+
+  mask = hashmap->size - 1;
+  pos = (unsigned int) (PYG_HASHMAP_H1(hash) & mask);
+  for (stride = PYG_HASHMAP_GROUP; ; stride += PYG_HASHMAP_GROUP) {
+    const uint8_t* group;
+    unsigned int free_mask;
+
+    group = &hashmap->ctrl[pos];
+    free_mask = pyg_hashmap_match(group, PYG_HASHMAP_EMPTY) |
+                pyg_hashmap_match(group, PYG_HASHMAP_DELETED);
+    if (free_mask != 0)
+      return (pos + __builtin_ctz(free_mask)) & mask;
+
+    /* Triangular numbers visit every group of a power of two table */
+    pos = (pos + stride) & mask;
+  }
+}
+
+
+void pyg_hashmap_set_ctrl(pyg_hashmap_t* hashmap,
+                          unsigned int i,
+                          uint8_t ctrl) {
+  hashmap->ctrl[i] = ctrl;
+  if (i < PYG_HASHMAP_GROUP)
+    hashmap->ctrl[hashmap->size + i] = ctrl;
+}
+
+
+pyg_hashmap_item_t* pyg_hashmap_get_int(pyg_hashmap_t* hashmap,
+                                        const char* key,
+                                        unsigned int key_len,
+                                        uint64_t hash) {
+  unsigned int mask;
+  unsigned int pos;
+  unsigned int stride;
+  uint8_t h2;
+
+  mask = hashmap->size - 1;
+  pos = (unsigned int) (PYG_HASHMAP_H1(hash) & mask);
+  h2 = PYG_HASHMAP_H2(hash);
+  for (stride = PYG_HASHMAP_GROUP; ; stride += PYG_HASHMAP_GROUP) {
+    const uint8_t* group;
+    unsigned int match;
+
+    group = &hashmap->ctrl[pos];
+    for (match = pyg_hashmap_match(group, h2);
+         match != 0;
+         match &= match - 1) {
       pyg_hashmap_item_t* item;
-      pyg_error_t err;
-
-      item = &old_map.space[i];
-      err = pyg_hashmap_insert(hashmap, item->key, item->key_len, item->value);
-      if (!pyg_is_ok(err)) {
-        free(space);
-        *hashmap = old_map;
-        return NULL;
+
+      /* Interned keys are equal by pointer */
+      item = &hashmap->space[(pos + __builtin_ctz(match)) & mask];
+      if (item->hash == hash &&
+          item->key_len == key_len &&
+          (item->key == key || memcmp(item->key, key, key_len) == 0)) {
+        return item;
       }
     }
 
-  /* Retry */
-  } while (1);
+    /* Key would have been put into this empty slot */
+    if (pyg_hashmap_match(group, PYG_HASHMAP_EMPTY) != 0)
+      return NULL;
+
+    pos = (pos + stride) & mask;
+  }
 }
 
 
-#undef PYG_HASHMAP_GROW_DELTA
-#undef PYG_HASHMAP_MAX_ITER
+/* Replaces value if the key is already present */
+pyg_error_t pyg_hashmap_hinsert(pyg_hashmap_t* hashmap,
+                                const char* key,
+                                unsigned int key_len,
+                                uint64_t hash,
+                                void* value) {
+  pyg_hashmap_item_t* item;
+  unsigned int i;
 
+  item = pyg_hashmap_get_int(hashmap, key, key_len, hash);
+  if (item != NULL) {
+    item->value = value;
+    return pyg_ok();
+  }
 
-pyg_error_t pyg_hashmap_insert(pyg_hashmap_t* hashmap,
-                               const char* key,
-                               unsigned int key_len,
-                               void* value) {
-  pyg_hashmap_item_t* item;
+  /* Double, or just drop deleted slots if they take much of the space */
+  if (hashmap->count + hashmap->deleted + 1 >
+      PYG_HASHMAP_MAX_LOAD(hashmap->size)) {
+    pyg_error_t err;
+    unsigned int size;
 
-  item = pyg_hashmap_get_int(hashmap, key, key_len, 1);
-  if (item == NULL)
-    return pyg_error_str(kPygErrNoMem, "pyg_hashmap_t space");
+    size = hashmap->size;
+    if (hashmap->count + 1 > PYG_HASHMAP_MAX_LOAD(size) / 2)
+      size *= 2;
 
+    err = pyg_hashmap_resize(hashmap, size);
+    if (!pyg_is_ok(err))
+      return err;
+  }
+
+  if (hashmap->owns_keys) {
+    char* copy;
+
+    copy = pyg_arena_alloc(&hashmap->keys, key_len + 1);
+    if (copy == NULL)
+      return pyg_error_str(kPygErrNoMem, "pyg_hashmap_t key");
+    memcpy(copy, key, key_len);
+    copy[key_len] = '\0';
+    key = copy;
+  }
+
+  i = pyg_hashmap_find_free(hashmap, hash);
+  if (hashmap->ctrl[i] == PYG_HASHMAP_DELETED)
+    hashmap->deleted--;
+  pyg_hashmap_set_ctrl(hashmap, i, PYG_HASHMAP_H2(hash));
+  hashmap->count++;
+
+  item = &hashmap->space[i];
   item->key = key;
   item->key_len = key_len;
+  item->hash = hash;
   item->value = value;
 
   return pyg_ok();
 }
 
 
+pyg_error_t pyg_hashmap_insert(pyg_hashmap_t* hashmap,
+                               const char* key,
+                               unsigned int key_len,
+                               void* value) {
+  return pyg_hashmap_hinsert(hashmap,
+                             key,
+                             key_len,
+                             pyg_hash(key, key_len),
+                             value);
+}
+
+
+pyg_error_t pyg_hashmap_iinsert(pyg_hashmap_t* hashmap,
+                                const char* key,
+                                void* value) {
+  return pyg_hashmap_hinsert(hashmap,
+                             key,
+                             pyg_intern_len(key),
+                             pyg_intern_hash(key),
+                             value);
+}
+
+
 void pyg_hashmap_delete(pyg_hashmap_t* hashmap,
                         const char* key,
                         unsigned int key_len) {
   pyg_hashmap_item_t* item;
 
-  item = pyg_hashmap_get_int(hashmap, key, key_len, 0);
+  item = pyg_hashmap_get_int(hashmap, key, key_len, pyg_hash(key, key_len));
   if (item == NULL)
     return;
 
+  /* Tombstone keeps probe sequences of other keys intact */
+  pyg_hashmap_set_ctrl(hashmap,
+                       item - hashmap->space,
+                       PYG_HASHMAP_DELETED);
+  hashmap->count--;
+  hashmap->deleted++;
+
   item->key = NULL;
   item->key_len = 0;
   item->value = NULL;
@@ -206,7 +532,7 @@ void* pyg_hashmap_get(pyg_hashmap_t* hashmap,
                       unsigned int key_len) {
   pyg_hashmap_item_t* item;
 
-  item = pyg_hashmap_get_int(hashmap, key, key_len, 0);
+  item = pyg_hashmap_get_int(hashmap, key, key_len, pyg_hash(key, key_len));
   if (item == NULL)
     return NULL;
 
@@ -214,20 +540,44 @@ void* pyg_hashmap_get(pyg_hashmap_t* hashmap,
 }
 
 
-void* pyg_proto_hashmap_get(pyg_proto_hashmap_t* hashmap,
-                            const char* key,
-                            unsigned int key_len) {
-  pyg_proto_hashmap_t* current;
+const char* pyg_hashmap_get_key(pyg_hashmap_t* hashmap,
+                                const char* key,
+                                unsigned int key_len) {
+  pyg_hashmap_item_t* item;
 
-  for (current = hashmap; current != NULL; current = current->parent) {
-    void* res;
+  item = pyg_hashmap_get_int(hashmap, key, key_len, pyg_hash(key, key_len));
+  if (item == NULL)
+    return NULL;
+
+  return item->key;
+}
 
-    res = pyg_hashmap_get(&current->map, key, key_len);
-    if (res != NULL)
-      return res;
-  }
 
-  return NULL;
+void* pyg_hashmap_hget(pyg_hashmap_t* hashmap,
+                       const char* key,
+                       unsigned int key_len,
+                       uint64_t hash) {
+  pyg_hashmap_item_t* item;
+
+  item = pyg_hashmap_get_int(hashmap, key, key_len, hash);
+  if (item == NULL)
+    return NULL;
+
+  return item->value;
+}
+
+
+void* pyg_hashmap_iget(pyg_hashmap_t* hashmap, const char* key) {
+  pyg_hashmap_item_t* item;
+
+  item = pyg_hashmap_get_int(hashmap,
+                             key,
+                             pyg_intern_len(key),
+                             pyg_intern_hash(key));
+  if (item == NULL)
+    return NULL;
+
+  return item->value;
 }
 
 
@@ -241,7 +591,7 @@ pyg_error_t pyg_hashmap_iterate(pyg_hashmap_t* hashmap,
     return pyg_ok();
 
   for (i = 0; i < hashmap->size; i++) {
-    if (hashmap->space[i].key != NULL) {
+    if ((hashmap->ctrl[i] & PYG_HASHMAP_EMPTY) == 0) {
       err = cb(&hashmap->space[i], arg);
       if (!pyg_is_ok(err))
         return err;
@@ -252,6 +602,14 @@ pyg_error_t pyg_hashmap_iterate(pyg_hashmap_t* hashmap,
 }
 
 
+#undef PYG_HASHMAP_MAX_LOAD
+#undef PYG_HASHMAP_H2
+#undef PYG_HASHMAP_H1
+#undef PYG_HASHMAP_DELETED
+#undef PYG_HASHMAP_EMPTY
+#undef PYG_HASHMAP_GROUP
+
+
 pyg_error_t pyg_buf_init(pyg_buf_t* buf, unsigned int size) {
   buf->size = size;
   buf->off = 0;
@@ -361,9 +719,11 @@ char* pyg_resolve(const char* p1, const char* p2) {
 char* pyg_nresolve(const char* p1, int len1, const char* p2, int len2) {
   char buf[PATH_MAX];
 
-  /* Absolute path */
-  if (len2 >= 1 && p2[0] == dir_sep)
-    return pyg_realpath(p2);
+  /* Absolute path, may be followed by `:target` */
+  if (len2 >= 1 && p2[0] == dir_sep) {
+    snprintf(buf, sizeof(buf), "%.*s", len2, p2);
+    return pyg_realpath(buf);
+  }
 
   /* Library :( */
   if (len2 >= 1 && (p2[0] == '-' || p2[0] == '$'))
@@ -375,6 +735,214 @@ char* pyg_nresolve(const char* p1, int len1, const char* p2, int len2) {
 }
 
 
+pyg_error_t pyg_path_ref(void) {
+  pyg_error_t err;
+
+  err = pyg_ok();
+  pthread_mutex_lock(&pyg_path_mutex);
+  if (pyg_path_refs == 0)
+    err = pyg_hashmap_init(&pyg_path_dirs, kPygPathDirCount);
+  if (pyg_is_ok(err))
+    pyg_path_refs++;
+  pthread_mutex_unlock(&pyg_path_mutex);
+
+  return err;
+}
+
+
+void pyg_path_unref(void) {
+  pthread_mutex_lock(&pyg_path_mutex);
+  if (--pyg_path_refs == 0)
+    pyg_hashmap_destroy(&pyg_path_dirs);
+  pthread_mutex_unlock(&pyg_path_mutex);
+}
+
+
+pyg_error_t pyg_path_resolve(const char* dir,
+                             const char* path,
+                             unsigned int len,
+                             int strict,
+                             const char** out) {
+  pyg_error_t err;
+  char buf[PATH_MAX];
+  char res_buf[PATH_MAX];
+  const char* name;
+  const char* rdir;
+  const char* res;
+  char* sep;
+  int n;
+
+  /* Library :( */
+  if (len >= 1 && (path[0] == '-' || path[0] == '$')) {
+    res = pyg_intern(path, len);
+    goto done;
+  }
+
+  if (len >= 1 && path[0] == dir_sep)
+    n = snprintf(buf, sizeof(buf), "%.*s", (int) len, path);
+  else
+    n = snprintf(buf, sizeof(buf), "%s%c%.*s", dir, dir_sep, (int) len, path);
+  if (n < 0 || (size_t) n >= sizeof(buf))
+    return pyg_error_str(kPygErrFS, "Path too long: %.*s", (int) len, path);
+
+  n = pyg_path_normalize(buf, n);
+
+  /* Split into directory and name */
+  sep = strrchr(buf, dir_sep);
+  if (sep == NULL) {
+    name = buf;
+    err = pyg_path_realdir(".", 1, &rdir);
+  } else {
+    name = sep + 1;
+    err = pyg_path_realdir(buf, sep == buf ? 1 : sep - buf, &rdir);
+  }
+
+  /*
+   * Missing directory - keep the path as it is, so that missing files are
+   * reported by the caller (or `strict`) together with the rest
+   */
+  if (err.code == kPygErrFS) {
+    res = pyg_intern(buf, n);
+    goto check;
+  }
+  if (!pyg_is_ok(err))
+    return err;
+
+  /* `/`, `..` or `../..` - the path is a directory itself */
+  if (name[0] == '\0' || strcmp(name, "..") == 0) {
+    err = pyg_path_realdir(buf, n, &res);
+    if (pyg_is_ok(err))
+      goto done;
+    if (err.code != kPygErrFS)
+      return err;
+    res = pyg_intern(buf, n);
+    goto check;
+  }
+
+  /* NOTE: `name` points into `buf` */
+  n = snprintf(res_buf,
+               sizeof(res_buf),
+               "%s%s%s",
+               rdir,
+               rdir[1] == '\0' ? "" : "/",
+               name);
+  if (n < 0 || (size_t) n >= sizeof(res_buf))
+    return pyg_error_str(kPygErrFS, "Path too long: %s/%s", rdir, name);
+
+  res = pyg_intern(res_buf, n);
+
+check:
+  if (res == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_intern(%.*s)", (int) len, path);
+
+  if (strict && access(res, F_OK) != 0)
+    return pyg_error_str(kPygErrFS, "File not found: %s", res);
+
+done:
+  if (res == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_intern(%.*s)", (int) len, path);
+
+  *out = res;
+  return pyg_ok();
+}
+
+
+/* Collapse `//`, `/./` and `dir/../` in place, returns new length */
+unsigned int pyg_path_normalize(char* path, unsigned int len) {
+  unsigned int root;
+  unsigned int r;
+  unsigned int w;
+
+  root = len > 0 && path[0] == dir_sep;
+  r = root;
+  w = root;
+  while (r < len) {
+    unsigned int start;
+    unsigned int seg;
+    unsigned int last;
+
+    start = r;
+    while (r < len && path[r] != dir_sep)
+      r++;
+    seg = r - start;
+    r++;
+
+    if (seg == 0 || (seg == 1 && path[start] == '.'))
+      continue;
+
+    if (seg == 2 && path[start] == '.' && path[start + 1] == '.') {
+      /* Start of the last written segment */
+      for (last = w; last > root && path[last - 1] != dir_sep; last--) {
+      }
+
+      /* Can't go above `/`, but can go above relative `..` */
+      if (root && w == root)
+        continue;
+      if (w != last && !(w - last == 2 && path[last] == '.' &&
+                         path[last + 1] == '.')) {
+        w = last > root ? last - 1 : root;
+        continue;
+      }
+    }
+
+    /* NOTE: `w` never passes `start`, `memmove` is safe */
+    if (w > root)
+      path[w++] = dir_sep;
+    memmove(path + w, path + start, seg);
+    w += seg;
+  }
+
+  if (w == 0)
+    path[w++] = '.';
+  path[w] = '\0';
+  return w;
+}
+
+
+pyg_error_t pyg_path_realdir(const char* dir,
+                             unsigned int len,
+                             const char** out) {
+  pyg_error_t err;
+  const char* key;
+  const char* res;
+  char* real;
+
+  key = pyg_intern(dir, len);
+  if (key == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_intern(%.*s)", (int) len, dir);
+
+  pthread_rwlock_rdlock(&pyg_path_lock);
+  res = pyg_hashmap_iget(&pyg_path_dirs, key);
+  pthread_rwlock_unlock(&pyg_path_lock);
+  if (res != NULL) {
+    *out = res;
+    return pyg_ok();
+  }
+
+  /* Interned strings are NUL-terminated */
+  real = pyg_realpath(key);
+  if (real == NULL)
+    return pyg_error_str(kPygErrFS, "pyg_realpath(%s)", key);
+
+  res = pyg_cintern(real);
+  free(real);
+  if (res == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_intern(%s)", key);
+
+  /* Another thread may have resolved it too, the result is the same */
+  err = pyg_ok();
+  pthread_rwlock_wrlock(&pyg_path_lock);
+  if (pyg_hashmap_iget(&pyg_path_dirs, key) == NULL)
+    err = pyg_hashmap_iinsert(&pyg_path_dirs, key, (void*) res);
+  pthread_rwlock_unlock(&pyg_path_lock);
+  if (!pyg_is_ok(err))
+    return err;
+
+  *out = res;
+  return pyg_ok();
+}
+
+
 const char* pyg_basename(const char* path) {
   const char* p;
 
@@ -413,7 +981,9 @@ int pyg_value_to_bool(pyg_value_t* val) {
     case kPygValueInt:
       return val->value.num != 0;
     case kPygValueStr:
-      return val->value.str.len != 0;
+      return val->len != 0;
+    case kPygValueList:
+      return val->value.list->count != 0;
     default:
       UNREACHABLE();
       return -1;
@@ -421,37 +991,26 @@ int pyg_value_to_bool(pyg_value_t* val) {
 }
 
 
-pyg_error_t pyg_value_to_str(pyg_value_t* val, char** out) {
-  char* res;
+const char* pyg_value_str(pyg_value_t* val) {
+  char num[16];
+  int len;
+
+  if (val->str != NULL)
+    return val->str;
+
   switch (val->type) {
     case kPygValueBool:
-      res = strdup(val->value.num ? "true" : "false");
-      break;
+      val->str = val->value.num ? "true" : "false";
+      val->len = strlen(val->str);
+      return val->str;
     case kPygValueInt:
-      {
-        int n;
-
-        n = snprintf(NULL, 0, "%d", val->value.num);
-        res = malloc(n + 1);
-        if (res != NULL)
-          snprintf(res, n, "%d", val->value.num);
-      }
-      break;
-    case kPygValueStr:
-      res = malloc(val->value.str.len + 1);
-      if (res != NULL) {
-        memcpy(res, val->value.str.str, val->value.str.len);
-        res[val->value.str.len] = '\0';
-      }
-      break;
+      /* Formatted once, integers are rarely used as strings */
+      len = snprintf(num, sizeof(num), "%d", val->value.num);
+      val->str = pyg_intern(num, len);
+      val->len = len;
+      return val->str;
     default:
       UNREACHABLE();
-      return pyg_ok();
+      return NULL;
   }
-
-  if (res == NULL)
-    return pyg_error_str(kPygErrNoMem, "pyg_value_t to str");
-
-  *out = res;
-  return pyg_ok();
 }
@@ -1,10 +1,12 @@
 #ifndef SRC_COMMON_H_
 #define SRC_COMMON_H_
 
+#include "src/arena.h"
 #include "src/error.h"
 
 #include "parson.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #ifdef __linux__
@@ -14,7 +16,6 @@
 #endif  /* __linux__ */
 
 typedef struct pyg_hashmap_s pyg_hashmap_t;
-typedef struct pyg_proto_hashmap_s pyg_proto_hashmap_t;
 typedef struct pyg_hashmap_item_s pyg_hashmap_item_t;
 typedef void (*pyg_hashmap_free_cb)(void*);
 typedef pyg_error_t (*pyg_hashmap_iterate_cb)(pyg_hashmap_item_t* item,
@@ -27,6 +28,7 @@ typedef void* (*pyg_iter_array_get_cb)(JSON_Array* arr, size_t i);
 typedef struct pyg_buf_s pyg_buf_t;
 typedef struct pyg_str_s pyg_str_t;
 typedef struct pyg_value_s pyg_value_t;
+typedef struct pyg_list_s pyg_list_t;
 
 struct pyg_str_s {
   const char* str;
@@ -36,37 +38,83 @@ struct pyg_str_s {
 enum pyg_value_type_e {
   kPygValueStr,
   kPygValueInt,
-  kPygValueBool
+  kPygValueBool,
+  kPygValueList
 };
 typedef enum pyg_value_type_e pyg_value_type_t;
 
+/*
+ * Values are copied by assignment and never own their text, so reading a
+ * value as a string does not allocate.
+ */
 struct pyg_value_s {
   pyg_value_type_t type;
+  int len;
+
+  /*
+   * The string itself, `true`/`false`, or list items separated by spaces.
+   * Borrowed from the .gyp tree or interned. NULL for integers until
+   * `pyg_value_str()` caches their decimal form.
+   */
+  const char* str;
+
   union {
-    pyg_str_t str;
     int num;
+    pyg_list_t* list;
   } value;
 };
 
+/* Items are interned strings, shared by every array the list is spliced in */
+struct pyg_list_s {
+  const char** items;
+  unsigned int count;
+
+  /*
+   * Items resolved relative to the .gyp file, filled on first use. Lists
+   * that are not owned by a single file have no room for them (NULL).
+   */
+  const char** paths;
+  int resolved;
+};
+
+/* See src/common.c for the layout */
 struct pyg_hashmap_s {
   pyg_hashmap_item_t* space;
+  uint8_t* ctrl;
   unsigned int size;
-};
+  unsigned int count;
+  unsigned int deleted;
 
-struct pyg_proto_hashmap_s {
-  pyg_hashmap_t map;
-  pyg_proto_hashmap_t* parent;
+  /* Copies of keys, only in maps created by `pyg_hashmap_init_owned()` */
+  int owns_keys;
+  pyg_arena_t keys;
 };
 
 struct pyg_hashmap_item_s {
   const char* key;
   unsigned int key_len;
+
+  /* Compared before the key itself */
+  uint64_t hash;
   void* value;
 };
 
+uint64_t pyg_hash(const char* key, unsigned int len);
+uint64_t pyg_hash64(const void* data, size_t len);
+
 pyg_error_t pyg_hashmap_init(pyg_hashmap_t* hashmap, unsigned int size);
+
+/*
+ * Map that copies every new key (with a trailing NUL) into its own arena, so
+ * it does not depend on the lifetime of the caller's strings. Copies are
+ * released only with the map.
+ */
+pyg_error_t pyg_hashmap_init_owned(pyg_hashmap_t* hashmap, unsigned int size);
 void pyg_hashmap_destroy(pyg_hashmap_t* hashmap);
 
+/* Shallow copy, keys (even owned) and values are shared with `from` */
+pyg_error_t pyg_hashmap_clone(pyg_hashmap_t* hashmap, pyg_hashmap_t* from);
+
 pyg_error_t pyg_hashmap_insert(pyg_hashmap_t* hashmap,
                                const char* key,
                                unsigned int key_len,
@@ -77,9 +125,32 @@ void pyg_hashmap_delete(pyg_hashmap_t* hashmap,
 void* pyg_hashmap_get(pyg_hashmap_t* hashmap,
                       const char* key,
                       unsigned int key_len);
-void* pyg_proto_hashmap_get(pyg_proto_hashmap_t* hashmap,
-                            const char* key,
-                            unsigned int key_len);
+
+/* Stored key equal to `key` (a copy in owned maps), NULL if not found */
+const char* pyg_hashmap_get_key(pyg_hashmap_t* hashmap,
+                                const char* key,
+                                unsigned int key_len);
+
+/* Same as above, but for interned keys (see src/intern.h) */
+pyg_error_t pyg_hashmap_iinsert(pyg_hashmap_t* hashmap,
+                                const char* key,
+                                void* value);
+void* pyg_hashmap_iget(pyg_hashmap_t* hashmap, const char* key);
+
+/*
+ * Same as above, but with `hash` precomputed by `pyg_hash()`, for callers
+ * looking up the same key many times
+ */
+pyg_error_t pyg_hashmap_hinsert(pyg_hashmap_t* hashmap,
+                                const char* key,
+                                unsigned int key_len,
+                                uint64_t hash,
+                                void* value);
+void* pyg_hashmap_hget(pyg_hashmap_t* hashmap,
+                       const char* key,
+                       unsigned int key_len,
+                       uint64_t hash);
+
 pyg_error_t pyg_hashmap_iterate(pyg_hashmap_t* hashmap,
                                 pyg_hashmap_iterate_cb cb,
                                 void* arg);
@@ -88,8 +159,8 @@ pyg_error_t pyg_hashmap_iterate(pyg_hashmap_t* hashmap,
     pyg_hashmap_insert((h), (k), strlen((k)), (v))
 #define pyg_hashmap_cdelete(h, k) pyg_hashmap_delete((h), (k), strlen((k)))
 #define pyg_hashmap_cget(h, k) pyg_hashmap_get((h), (k), strlen((k)))
-#define pyg_proto_hashmap_cget(h, k)                                          \
-    pyg_proto_hashmap_get((h), (k), strlen((k)))
+#define pyg_hashmap_cget_key(h, k)                                            \
+    pyg_hashmap_get_key((h), (k), strlen((k)))
 
 
 struct pyg_buf_s {
@@ -111,11 +182,40 @@ char* pyg_realpath(const char* path);
 char* pyg_resolve(const char* p1, const char* p2);
 char* pyg_nresolve(const char* p1, int len1, const char* p2, int len2);
 
+/*
+ * Path service. `.` and `..` are normalized lexically (like GYP does), only
+ * the directory part is passed to realpath(3), once per directory. Results
+ * are interned (see src/intern.h).
+ *
+ * NOTE: The final component is not resolved, symlinks to files keep their
+ * name. `..` following a symlinked directory is applied lexically.
+ *
+ * Cache is created by the first `pyg_path_ref()` and destroyed by the last
+ * `pyg_path_unref()`, which should happen before the intern pool is gone.
+ */
+pyg_error_t pyg_path_ref(void);
+void pyg_path_unref(void);
+
+/* `strict` - fail if the resulting file does not exist */
+pyg_error_t pyg_path_resolve(const char* dir,
+                             const char* path,
+                             unsigned int len,
+                             int strict,
+                             const char** out);
+
 int pyg_value_to_bool(pyg_value_t* val);
-pyg_error_t pyg_value_to_str(pyg_value_t* val, char** out);
+
+/* Text of `val` (see `pyg_value_t.str`), NULL on OOM */
+const char* pyg_value_str(pyg_value_t* val);
 
 #define UNREACHABLE() do { abort(); } while (0)
 
+#if defined(_MSC_VER)
+# define PYG_THREAD_LOCAL __declspec(thread)
+#else
+# define PYG_THREAD_LOCAL __thread
+#endif  /* defined(_MSC_VER) */
+
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
 #define container_of(ptr, type, member) \
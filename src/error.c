@@ -9,7 +9,8 @@ pyg_error_t pyg_error(pyg_error_code_t code) {
 
 
 pyg_error_t pyg_error_str(pyg_error_code_t code, const char* fmt, ...) {
-  static char buf[1024];
+  /* Loader threads may fail concurrently */
+  static PYG_THREAD_LOCAL char buf[1024];
   va_list ap;
 
   va_start(ap, fmt);
@@ -1,9 +1,19 @@
 #include "src/eval.h"
 #include "src/common.h"
+#include "src/intern.h"
+#include "src/keywords.h"
+#include "src/unroll.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <string.h>
 
+/* Variables of a condition resolved without heap allocation */
+#define PYG_EVAL_INLINE 8
+
+/* Stack of the condition VM that does not need heap allocation */
+#define PYG_EVAL_STACK 16
+
 enum pyg_lex_type_e {
   kPygLexNone,
   kPygLexWS,
@@ -11,13 +21,44 @@ enum pyg_lex_type_e {
   kPygLexBinary,
   kPygLexDStr,
   kPygLexSStr,
-  kPygLexInt
+  kPygLexInt,
+  kPygLexLParen,
+  kPygLexRParen,
+  kPygLexLBracket,
+  kPygLexRBracket,
+  kPygLexComma
 };
 typedef enum pyg_lex_type_e pyg_lex_type_t;
 
+/* Static type of a compiled expression, variables are checked at runtime */
+enum pyg_cond_type_e {
+  kPygCondAny,
+  kPygCondBool,
+  kPygCondInt,
+  kPygCondStr
+};
+typedef enum pyg_cond_type_e pyg_cond_type_t;
+
+typedef struct pyg_cond_compiler_s pyg_cond_compiler_t;
+
+struct pyg_cond_compiler_s {
+  pyg_cond_t* cond;
+  unsigned int code_len;
+  unsigned int const_count;
+
+  /* Values on the stack after the last emitted instruction */
+  unsigned int depth;
+};
+
+static const unsigned int kPygEvalCacheSize = 64;
+
+/* Lists with at least this many items are looked up in a hashmap */
+static const unsigned int kPygEvalSetMinHashed = 8;
+
 static pyg_error_t pyg_ast_lex(const char* str,
                                pyg_lex_type_t* out,
                                int* out_len);
+static int pyg_ast_name_char(char ch);
 static pyg_error_t pyg_ast_consume_lex(const char** str,
                                        const char** out,
                                        pyg_lex_type_t* out_type,
@@ -30,9 +71,59 @@ static pyg_error_t pyg_ast_parse_binary(const char** str,
                                         pyg_ast_binary_op_t priority,
                                         pyg_ast_t** out);
 static pyg_error_t pyg_ast_parse_literal(const char** str, pyg_ast_t** out);
-static pyg_error_t pyg_eval_ast(pyg_proto_hashmap_t* vars,
-                                pyg_ast_t* ast,
-                                pyg_value_t* out);
+static pyg_error_t pyg_ast_parse_not(const char** str, pyg_ast_t** out);
+static pyg_error_t pyg_ast_parse_paren(const char** str, pyg_ast_t** out);
+static pyg_error_t pyg_ast_parse_list(const char** str,
+                                      pyg_lex_type_t close,
+                                      pyg_ast_t* first,
+                                      pyg_ast_t** out);
+static pyg_error_t pyg_ast_list_push(pyg_ast_list_t* list, pyg_ast_t* item);
+static pyg_error_t pyg_cond_compile(const char* str, pyg_cond_t** out);
+static void pyg_cond_free(pyg_cond_t* cond);
+static void pyg_cond_count(pyg_ast_t* ast,
+                           unsigned int* nodes,
+                           unsigned int* names,
+                           unsigned int* lists);
+static unsigned int pyg_cond_ref(pyg_cond_t* cond, pyg_ast_name_t* name);
+static pyg_error_t pyg_cond_const(pyg_cond_compiler_t* c,
+                                  pyg_ast_t* ast,
+                                  unsigned int* out);
+static pyg_error_t pyg_cond_set(pyg_cond_compiler_t* c,
+                                pyg_ast_list_t* list,
+                                unsigned int* out);
+static void pyg_cond_emit_insn(pyg_cond_compiler_t* c,
+                               pyg_op_t op,
+                               unsigned int a,
+                               unsigned int b);
+static pyg_error_t pyg_cond_emit(pyg_cond_compiler_t* c,
+                                 pyg_ast_t* ast,
+                                 pyg_cond_type_t* type);
+static pyg_error_t pyg_cond_emit_binary(pyg_cond_compiler_t* c,
+                                        pyg_ast_binary_t* b,
+                                        pyg_cond_type_t* type);
+static pyg_error_t pyg_cond_run(pyg_cond_t* cond,
+                                pyg_scope_t* vars,
+                                pyg_value_t** values,
+                                int* out);
+static pyg_error_t pyg_cond_load(pyg_cond_t* cond,
+                                 pyg_scope_t* vars,
+                                 pyg_value_t** values,
+                                 unsigned int index);
+static pyg_error_t pyg_cond_equal(pyg_value_t* left,
+                                  pyg_value_t* right,
+                                  int* out);
+static int pyg_cond_set_has(pyg_cond_set_t* set, pyg_value_t* val);
+static pyg_error_t pyg_eval_free_cond(pyg_hashmap_item_t* item, void* arg);
+
+static pthread_mutex_t pyg_eval_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t pyg_eval_lock = PTHREAD_RWLOCK_INITIALIZER;
+static unsigned int pyg_eval_refs;
+
+/* Interned test string => pyg_cond_t */
+static pyg_hashmap_t pyg_eval_conds;
+
+/* Updated atomically, readers only take a snapshot */
+static pyg_eval_stats_t pyg_eval_counters;
 
 
 pyg_error_t pyg_ast_lex(const char* str, pyg_lex_type_t* out, int* out_len) {
@@ -67,6 +158,11 @@ pyg_error_t pyg_ast_lex(const char* str, pyg_lex_type_t* out, int* out_len) {
           case '\'':
             st = kPygLexSStr;
             continue;
+          case '(': st = kPygLexLParen; p++; goto done;
+          case ')': st = kPygLexRParen; p++; goto done;
+          case '[': st = kPygLexLBracket; p++; goto done;
+          case ']': st = kPygLexRBracket; p++; goto done;
+          case ',': st = kPygLexComma; p++; goto done;
           default:
             break;
         }
@@ -85,26 +181,22 @@ pyg_error_t pyg_ast_lex(const char* str, pyg_lex_type_t* out, int* out_len) {
       case kPygLexBinary:
         switch (p[-1]) {
           case 'o':
-            if (ch != 'r') {
-              st = kPygLexName;
-              goto done;
-            }
+            if (ch != 'r')
+              goto name;
             break;
-          case 'r':
-            goto done;
           case 'a':
-            if (ch != 'n') {
-              st = kPygLexName;
-              goto done;
-            }
+            if (ch != 'n')
+              goto name;
             break;
           case 'n':
-            if (ch != 'd') {
-              st = kPygLexName;
-              goto done;
-            }
+            if (ch != 'd')
+              goto name;
             break;
+          case 'r':
           case 'd':
+            /* `order`, `android` */
+            if (pyg_ast_name_char(ch))
+              goto name;
             goto done;
           default:
             if (ch != '!' && ch != '=' && ch != '>' && ch != '<' &&
@@ -135,14 +227,24 @@ pyg_error_t pyg_ast_lex(const char* str, pyg_lex_type_t* out, int* out_len) {
         break;
 
       case kPygLexName:
-        if (ch == ' ' || ch == '\t' || ch == '!' || ch == '>' || ch == '<' ||
-            ch == '=' || ch == '|' || ch == '&' || ch == '"' || ch == '\'') {
+      name:
+        /* Names may start like `or` and `and` */
+        st = kPygLexName;
+        if (!pyg_ast_name_char(ch))
           goto done;
-        }
+        break;
+
+      default:
+        /* Punctuation ends right after its only character */
+        UNREACHABLE();
         break;
     }
   }
 
+  /* `o`, `a`, `an` at the end of input */
+  if (st == kPygLexBinary && (p[-1] == 'o' || p[-1] == 'a' || p[-1] == 'n'))
+    st = kPygLexName;
+
 done:
   *out_len = p - str;
   *out = st;
@@ -150,6 +252,14 @@ done:
 }
 
 
+int pyg_ast_name_char(char ch) {
+  return ch != ' ' && ch != '\t' && ch != '!' && ch != '>' && ch != '<' &&
+         ch != '=' && ch != '|' && ch != '&' && ch != '"' && ch != '\'' &&
+         ch != '(' && ch != ')' && ch != '[' && ch != ']' && ch != ',' &&
+         ch != '\0';
+}
+
+
 pyg_error_t pyg_ast_consume_lex(const char** str,
                                 const char** out,
                                 pyg_lex_type_t* out_type,
@@ -179,29 +289,25 @@ pyg_error_t pyg_ast_classify_binary(const char* op,
                                     pyg_ast_binary_op_t* out) {
   pyg_ast_binary_op_t res;
 
-  /* TODO(indutny): could be moved to lexer */
-  res = kPygAstBinaryInvalid;
-  if (len == 1) {
-    if (op[0] == '<')
-      res = kPygAstBinaryLT;
-    else if (op[0] == '>')
-      res = kPygAstBinaryGT;
-  } else if (len == 2) {
-    if (strncmp(op, "==", 2) == 0)
-      res = kPygAstBinaryEq;
-    else if (strncmp(op, "!=", 2) == 0)
-      res = kPygAstBinaryNotEq;
-    else if (strncmp(op, "<=", 2) == 0)
-      res = kPygAstBinaryLTE;
-    else if (strncmp(op, ">=", 2) == 0)
-      res = kPygAstBinaryGTE;
-    else if (strncmp(op, "||", 2) == 0 || strncmp(op, "or", 2) == 0)
-      res = kPygAstBinaryOr;
-    else if (strncmp(op, "&&", 2) == 0)
-      res = kPygAstBinaryAnd;
-  } else if (len == 3) {
-    if (strncmp(op, "and", 3) == 0)
+  switch (pyg_keyword(op, len)) {
+    case kPygKwOpEq: res = kPygAstBinaryEq; break;
+    case kPygKwOpNotEq: res = kPygAstBinaryNotEq; break;
+    case kPygKwOpLT: res = kPygAstBinaryLT; break;
+    case kPygKwOpGT: res = kPygAstBinaryGT; break;
+    case kPygKwOpLTE: res = kPygAstBinaryLTE; break;
+    case kPygKwOpGTE: res = kPygAstBinaryGTE; break;
+    case kPygKwOpAnd:
+    case kPygKwOpAndWord:
       res = kPygAstBinaryAnd;
+      break;
+    case kPygKwOpOr:
+    case kPygKwOpOrWord:
+      res = kPygAstBinaryOr;
+      break;
+    case kPygKwOpIn: res = kPygAstBinaryIn; break;
+    /* Followed by `in` */
+    case kPygKwOpNot: res = kPygAstBinaryNotIn; break;
+    default: res = kPygAstBinaryInvalid; break;
   }
 
   if (res == kPygAstBinaryInvalid) {
@@ -241,18 +347,21 @@ pyg_error_t pyg_ast_parse_binary(const char** str,
     if (!pyg_is_ok(err))
       goto fatal_after_left;
 
-    /* End of the string */
-    if (lex == kPygLexNone) {
+    /* End of the string, or of the parenthesized expression or list item */
+    if (lex == kPygLexNone || lex == kPygLexRParen ||
+        lex == kPygLexRBracket || lex == kPygLexComma) {
       *out = left;
       return pyg_ok();
     }
 
-    /* Invalid token */
-    if (lex != kPygLexBinary) {
+    /* Invalid token, `in` and `not in` are the only named operators */
+    if (lex != kPygLexBinary && lex != kPygLexName) {
       err = pyg_error_str(kPygErrASTWarn, "Invalid token when expected binary");
       goto fatal_after_left;
     }
 
+    /* Only written on success, which -O2 cannot see through */
+    op = kPygAstBinaryInvalid;
     err = pyg_ast_classify_binary(op_str, op_len, &op);
     if (!pyg_is_ok(err))
       goto fatal_after_left;
@@ -263,6 +372,16 @@ pyg_error_t pyg_ast_parse_binary(const char** str,
       return pyg_ok();
     }
 
+    if (op == kPygAstBinaryNotIn) {
+      err = pyg_ast_consume_lex(&tmp, &op_str, &lex, &op_len);
+      if (!pyg_is_ok(err))
+        goto fatal_after_left;
+      if (lex != kPygLexName || pyg_keyword(op_str, op_len) != kPygKwOpIn) {
+        err = pyg_error_str(kPygErrASTFatal, "Expected `in` after `not`");
+        goto fatal_after_left;
+      }
+    }
+
     /* Consume token */
     *str = tmp;
 
@@ -314,31 +433,19 @@ pyg_error_t pyg_ast_parse_literal(const char** str, pyg_ast_t** out) {
   if (!pyg_is_ok(err))
     return err;
 
-  res = malloc(sizeof(*res));
-  if (res == NULL)
-    return pyg_error_str(kPygErrNoMem, "pyg_ast_t");
-
   switch (lex) {
+    case kPygLexLParen:
+      return pyg_ast_parse_paren(str, out);
+    case kPygLexLBracket:
+      return pyg_ast_parse_list(str, kPygLexRBracket, NULL, out);
     case kPygLexName:
-      res->type = kPygAstName;
-      res->value.str.str = op_str;
-      res->value.str.len = op_len;
+      if (pyg_keyword(op_str, op_len) == kPygKwOpNot)
+        return pyg_ast_parse_not(str, out);
       break;
     case kPygLexDStr:
     case kPygLexSStr:
-      res->type = kPygAstStr;
-      res->value.str.str = op_str + 1;
-      res->value.str.len = op_len - 2;
-      break;
     case kPygLexInt:
-      {
-        char st[1024];
-
-        res->type = kPygAstInt;
-        snprintf(st, sizeof(st), "%.*s", op_len, op_str);
-        res->value.num = atoi(st);
-        break;
-      }
+      break;
     default:
       return pyg_error_str(kPygErrASTFatal,
                            "Invalid literal/name token: %.*s",
@@ -346,151 +453,874 @@ pyg_error_t pyg_ast_parse_literal(const char** str, pyg_ast_t** out) {
                            op_str);
   }
 
+  res = malloc(sizeof(*res));
+  if (res == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_ast_t");
+
+  if (lex == kPygLexName) {
+    res->type = kPygAstName;
+    res->value.name.str.str = op_str;
+    res->value.name.str.len = op_len;
+    res->value.name.ref = 0;
+  } else if (lex == kPygLexInt) {
+    char st[1024];
+
+    res->type = kPygAstInt;
+    snprintf(st, sizeof(st), "%.*s", op_len, op_str);
+    res->value.num = atoi(st);
+  } else {
+    res->type = kPygAstStr;
+    res->value.str.str = op_str + 1;
+    res->value.str.len = op_len - 2;
+  }
+
+  *out = res;
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_ast_parse_not(const char** str, pyg_ast_t** out) {
+  pyg_error_t err;
+  pyg_ast_t* arg;
+  pyg_ast_t* res;
+
+  /* Binds weaker than comparisons, but stronger than `and` and `or` */
+  err = pyg_ast_parse_binary(str, kPygAstBinaryMiddle, &arg);
+  if (!pyg_is_ok(err))
+    return err;
+
+  res = malloc(sizeof(*res));
+  if (res == NULL) {
+    pyg_ast_free(arg);
+    return pyg_error_str(kPygErrNoMem, "pyg_ast_t");
+  }
+
+  res->type = kPygAstNot;
+  res->value.arg = arg;
+  *out = res;
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_ast_parse_paren(const char** str, pyg_ast_t** out) {
+  pyg_error_t err;
+  pyg_ast_t* res;
+  const char* tok;
+  pyg_lex_type_t lex;
+  int len;
+
+  err = pyg_ast_parse_expr(str, &res);
+  if (!pyg_is_ok(err))
+    return err;
+
+  err = pyg_ast_consume_lex(str, &tok, &lex, &len);
+  if (!pyg_is_ok(err))
+    goto failed_consume;
+
+  /* `(a, b)` */
+  if (lex == kPygLexComma)
+    return pyg_ast_parse_list(str, kPygLexRParen, res, out);
+
+  if (lex != kPygLexRParen) {
+    err = pyg_error_str(kPygErrASTFatal, "Expected `)`");
+    goto failed_consume;
+  }
+
   *out = res;
   return pyg_ok();
+
+failed_consume:
+  pyg_ast_free(res);
+  return err;
+}
+
+
+/* Items after `[`, or after `(first,` */
+pyg_error_t pyg_ast_parse_list(const char** str,
+                               pyg_lex_type_t close,
+                               pyg_ast_t* first,
+                               pyg_ast_t** out) {
+  pyg_error_t err;
+  pyg_ast_t* res;
+  pyg_ast_t* item;
+  const char* tok;
+  const char* tmp;
+  pyg_lex_type_t lex;
+  int len;
+
+  res = malloc(sizeof(*res));
+  if (res == NULL) {
+    if (first != NULL)
+      pyg_ast_free(first);
+    return pyg_error_str(kPygErrNoMem, "pyg_ast_t");
+  }
+  res->type = kPygAstList;
+  res->value.list.items = NULL;
+  res->value.list.count = 0;
+
+  item = first;
+  for (;;) {
+    if (item != NULL) {
+      if (item->type != kPygAstStr && item->type != kPygAstInt) {
+        pyg_ast_free(item);
+        err = pyg_error_str(kPygErrGYP,
+                            "List items should be strings or integers");
+        goto fatal;
+      }
+
+      err = pyg_ast_list_push(&res->value.list, item);
+      if (!pyg_is_ok(err)) {
+        pyg_ast_free(item);
+        goto fatal;
+      }
+    }
+
+    /* `,` after `first` is already consumed */
+    if (item != NULL && item != first) {
+      err = pyg_ast_consume_lex(str, &tok, &lex, &len);
+      if (!pyg_is_ok(err))
+        goto fatal;
+      if (lex == close)
+        break;
+      if (lex != kPygLexComma) {
+        err = pyg_error_str(kPygErrASTFatal, "Expected `,` in list");
+        goto fatal;
+      }
+    }
+
+    /* Empty list, or trailing comma */
+    tmp = *str;
+    err = pyg_ast_consume_lex(&tmp, &tok, &lex, &len);
+    if (!pyg_is_ok(err))
+      goto fatal;
+    if (lex == close) {
+      *str = tmp;
+      break;
+    }
+
+    err = pyg_ast_parse_literal(str, &item);
+    if (!pyg_is_ok(err))
+      goto fatal;
+  }
+
+  *out = res;
+  return pyg_ok();
+
+fatal:
+  pyg_ast_free(res);
+  return err;
+}
+
+
+pyg_error_t pyg_ast_list_push(pyg_ast_list_t* list, pyg_ast_t* item) {
+  /* Capacity doubles at every power of two */
+  if (list->count == 0 ||
+      (list->count >= 4 && (list->count & (list->count - 1)) == 0)) {
+    pyg_ast_t** items;
+
+    items = realloc(list->items,
+                    (list->count < 4 ? 4 : list->count * 2) * sizeof(*items));
+    if (items == NULL)
+      return pyg_error_str(kPygErrNoMem, "Failed to realloc() list items");
+    list->items = items;
+  }
+
+  list->items[list->count++] = item;
+  return pyg_ok();
 }
 
 
 pyg_error_t pyg_ast_parse(const char* str, pyg_ast_t** out) {
-  return pyg_ast_parse_expr(&str, out);
+  pyg_error_t err;
+  const char* tok;
+  pyg_lex_type_t lex;
+  int len;
+
+  err = pyg_ast_parse_expr(&str, out);
+  if (!pyg_is_ok(err))
+    return err;
+
+  /* `)`, `]` or `,` that does not close anything */
+  err = pyg_ast_consume_lex(&str, &tok, &lex, &len);
+  if (pyg_is_ok(err) && lex != kPygLexNone)
+    err = pyg_error_str(kPygErrASTFatal, "Unexpected token: %.*s", len, tok);
+  if (!pyg_is_ok(err))
+    pyg_ast_free(*out);
+  return err;
 }
 
 
 void pyg_ast_free(pyg_ast_t* ast) {
+  unsigned int i;
+
   if (ast->type == kPygAstBinary) {
     pyg_ast_free(ast->value.binary.left);
     pyg_ast_free(ast->value.binary.right);
+  } else if (ast->type == kPygAstNot) {
+    pyg_ast_free(ast->value.arg);
+  } else if (ast->type == kPygAstList) {
+    for (i = 0; i < ast->value.list.count; i++)
+      pyg_ast_free(ast->value.list.items[i]);
+    free(ast->value.list.items);
   }
   free(ast);
 }
 
 
-pyg_error_t pyg_eval_test(pyg_proto_hashmap_t* vars,
-                          const char* str,
-                          int* out) {
+pyg_error_t pyg_eval_ref(void) {
+  pyg_error_t err;
+
+  err = pyg_ok();
+  pthread_mutex_lock(&pyg_eval_mutex);
+  if (pyg_eval_refs == 0) {
+    memset(&pyg_eval_counters, 0, sizeof(pyg_eval_counters));
+    err = pyg_hashmap_init(&pyg_eval_conds, kPygEvalCacheSize);
+  }
+  if (pyg_is_ok(err))
+    pyg_eval_refs++;
+  pthread_mutex_unlock(&pyg_eval_mutex);
+
+  return err;
+}
+
+
+void pyg_eval_unref(void) {
+  pthread_mutex_lock(&pyg_eval_mutex);
+  if (--pyg_eval_refs == 0) {
+    pyg_hashmap_iterate(&pyg_eval_conds, pyg_eval_free_cond, NULL);
+    pyg_hashmap_destroy(&pyg_eval_conds);
+  }
+  pthread_mutex_unlock(&pyg_eval_mutex);
+}
+
+
+pyg_error_t pyg_eval_free_cond(pyg_hashmap_item_t* item, void* arg) {
+  pyg_cond_free(item->value);
+  return pyg_ok();
+}
+
+
+void pyg_eval_stats(pyg_eval_stats_t* stats) {
+  stats->conditions = __atomic_load_n(&pyg_eval_counters.conditions,
+                                      __ATOMIC_RELAXED);
+  stats->evaluated = __atomic_load_n(&pyg_eval_counters.evaluated,
+                                     __ATOMIC_RELAXED);
+}
+
+
+pyg_error_t pyg_eval_test(pyg_scope_t* vars, const char* str, int* out) {
+  pyg_error_t err;
+  pyg_cond_t* cond;
+  pyg_cond_t* existing;
+  pyg_value_t* inline_values[PYG_EVAL_INLINE];
+  pyg_value_t** values;
+
+  pthread_rwlock_rdlock(&pyg_eval_lock);
+  cond = pyg_hashmap_iget(&pyg_eval_conds, str);
+  pthread_rwlock_unlock(&pyg_eval_lock);
+
+  if (cond == NULL) {
+    err = pyg_cond_compile(str, &cond);
+    if (!pyg_is_ok(err))
+      return err;
+
+    /* Another thread may have compiled the same string meanwhile */
+    pthread_rwlock_wrlock(&pyg_eval_lock);
+    existing = pyg_hashmap_iget(&pyg_eval_conds, str);
+    if (existing == NULL)
+      err = pyg_hashmap_iinsert(&pyg_eval_conds, str, cond);
+    pthread_rwlock_unlock(&pyg_eval_lock);
+
+    if (existing != NULL) {
+      pyg_cond_free(cond);
+      cond = existing;
+    } else if (!pyg_is_ok(err)) {
+      pyg_cond_free(cond);
+      return err;
+    } else {
+      __atomic_fetch_add(&pyg_eval_counters.conditions, 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  /* Variables are looked up on first use */
+  values = inline_values;
+  if (cond->ref_count > PYG_EVAL_INLINE) {
+    values = malloc(cond->ref_count * sizeof(*values));
+    if (values == NULL) {
+      values = inline_values;
+      err = pyg_error_str(kPygErrNoMem, "Failed to malloc() condition values");
+      goto done;
+    }
+  }
+  memset(values, 0, cond->ref_count * sizeof(*values));
+
+  err = pyg_cond_run(cond, vars, values, out);
+  if (pyg_is_ok(err))
+    __atomic_fetch_add(&pyg_eval_counters.evaluated, 1, __ATOMIC_RELAXED);
+
+done:
+  if (values != inline_values)
+    free(values);
+  return err;
+}
+
+
+pyg_error_t pyg_cond_compile(const char* str, pyg_cond_t** out) {
   pyg_error_t err;
   pyg_ast_t* ast;
-  pyg_value_t val;
+  pyg_cond_t* cond;
+  pyg_cond_compiler_t c;
+  pyg_cond_type_t type;
+  unsigned int nodes;
+  unsigned int names;
+  unsigned int lists;
 
   err = pyg_ast_parse(str, &ast);
   if (!pyg_is_ok(err))
     return err;
 
-  err = pyg_eval_ast(vars, ast, &val);
-  pyg_ast_free(ast);
+  /* Upper bounds, every node emits at most one instruction or constant */
+  nodes = 0;
+  names = 0;
+  lists = 0;
+  pyg_cond_count(ast, &nodes, &names, &lists);
+
+  cond = malloc(sizeof(*cond) + names * sizeof(*cond->refs));
+  if (cond == NULL) {
+    err = pyg_error_str(kPygErrNoMem, "pyg_cond_t");
+    goto failed_alloc_cond;
+  }
+
+  cond->code = malloc((nodes + 1) * sizeof(*cond->code));
+  cond->consts = malloc(nodes * sizeof(*cond->consts));
+  cond->sets = malloc((lists == 0 ? 1 : lists) * sizeof(*cond->sets));
+  cond->set_count = 0;
+  cond->depth = 0;
+  cond->ref_count = 0;
+  if (cond->code == NULL || cond->consts == NULL || cond->sets == NULL) {
+    err = pyg_error_str(kPygErrNoMem, "pyg_cond_t code");
+    goto failed_compile;
+  }
+
+  c.cond = cond;
+  c.code_len = 0;
+  c.const_count = 0;
+  c.depth = 0;
+  err = pyg_cond_emit(&c, ast, &type);
   if (!pyg_is_ok(err))
-    return err;
+    goto failed_compile;
+  pyg_cond_emit_insn(&c, kPygOpReturn, 0, 0);
+
+  /*
+   * `refs` keep the names, which point into `str`. That is fine only because
+   * `str` is interned and outlives the cache (see `pyg_eval_test()`).
+   */
+  pyg_ast_free(ast);
+
+  *out = cond;
+  return pyg_ok();
 
-  *out = pyg_value_to_bool(&val);
+failed_compile:
+  pyg_cond_free(cond);
+
+failed_alloc_cond:
+  pyg_ast_free(ast);
   return err;
 }
 
 
-pyg_error_t pyg_eval_ast(pyg_proto_hashmap_t* vars,
-                         pyg_ast_t* ast,
-                         pyg_value_t* out) {
+void pyg_cond_free(pyg_cond_t* cond) {
+  unsigned int i;
+
+  for (i = 0; i < cond->set_count; i++)
+    if (cond->sets[i].hashed)
+      pyg_hashmap_destroy(&cond->sets[i].map);
+
+  free(cond->code);
+  free(cond->consts);
+  free(cond->sets);
+  free(cond);
+}
+
+
+void pyg_cond_count(pyg_ast_t* ast,
+                    unsigned int* nodes,
+                    unsigned int* names,
+                    unsigned int* lists) {
+  (*nodes)++;
+  switch (ast->type) {
+    case kPygAstBinary:
+      pyg_cond_count(ast->value.binary.left, nodes, names, lists);
+      pyg_cond_count(ast->value.binary.right, nodes, names, lists);
+      break;
+    case kPygAstNot:
+      pyg_cond_count(ast->value.arg, nodes, names, lists);
+      break;
+    case kPygAstName:
+      (*names)++;
+      break;
+    case kPygAstList:
+      *nodes += ast->value.list.count;
+      (*lists)++;
+      break;
+    default:
+      break;
+  }
+}
+
+
+unsigned int pyg_cond_ref(pyg_cond_t* cond, pyg_ast_name_t* name) {
+  pyg_cond_ref_t* ref;
+  unsigned int i;
+
+  for (i = 0; i < cond->ref_count; i++) {
+    ref = &cond->refs[i];
+    if (ref->len == (unsigned int) name->str.len &&
+        memcmp(ref->name, name->str.str, ref->len) == 0) {
+      return i;
+    }
+  }
+
+  ref = &cond->refs[cond->ref_count];
+  ref->name = name->str.str;
+  ref->len = name->str.len;
+  ref->hash = pyg_hash(ref->name, ref->len);
+  return cond->ref_count++;
+}
+
+
+pyg_error_t pyg_cond_const(pyg_cond_compiler_t* c,
+                           pyg_ast_t* ast,
+                           unsigned int* out) {
+  pyg_value_t* val;
+
+  val = &c->cond->consts[c->const_count];
+  if (ast->type == kPygAstInt) {
+    val->type = kPygValueInt;
+    val->len = 0;
+    val->str = NULL;
+    val->value.num = ast->value.num;
+  } else {
+    val->type = kPygValueStr;
+    val->len = ast->value.str.len;
+    val->str = pyg_intern(ast->value.str.str, ast->value.str.len);
+    val->value.num = 0;
+    if (val->str == NULL)
+      return pyg_error_str(kPygErrNoMem, "Failed to intern condition string");
+  }
+
+  *out = c->const_count++;
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_cond_set(pyg_cond_compiler_t* c,
+                         pyg_ast_list_t* list,
+                         unsigned int* out) {
   pyg_error_t err;
-  pyg_value_t left;
-  pyg_value_t right;
-  pyg_ast_binary_t* b;
-  int res;
+  pyg_cond_set_t* set;
+  unsigned int i;
+  unsigned int index;
+
+  set = &c->cond->sets[c->cond->set_count];
+  set->items = &c->cond->consts[c->const_count];
+  set->count = list->count;
+  set->hashed = 0;
+  for (i = 0; i < list->count; i++) {
+    err = pyg_cond_const(c, list->items[i], &index);
+    if (!pyg_is_ok(err))
+      return err;
+  }
 
-  if (ast->type == kPygAstName) {
-    pyg_value_t* res;
-    const char* key;
-    int len;
+  if (set->count >= kPygEvalSetMinHashed) {
+    err = pyg_hashmap_init(&set->map, kPygEvalCacheSize);
+    if (!pyg_is_ok(err))
+      return err;
 
-    key = ast->value.str.str;
-    len = ast->value.str.len;
+    for (i = 0; i < set->count; i++) {
+      if (set->items[i].type != kPygValueStr)
+        continue;
 
-    res = pyg_proto_hashmap_get(vars, key, len);
-    if (res == NULL) {
-      return pyg_error_str(kPygErrGYP,
-                           "Variable `%.*s` not found",
-                           len,
-                           key);
+      err = pyg_hashmap_iinsert(&set->map, set->items[i].str, &set->items[i]);
+      if (!pyg_is_ok(err)) {
+        pyg_hashmap_destroy(&set->map);
+        return err;
+      }
     }
+    set->hashed = 1;
+  }
 
-    *out = *res;
-    return pyg_ok();
+  *out = c->cond->set_count++;
+  return pyg_ok();
+}
+
+
+void pyg_cond_emit_insn(pyg_cond_compiler_t* c,
+                        pyg_op_t op,
+                        unsigned int a,
+                        unsigned int b) {
+  pyg_insn_t* insn;
+
+  insn = &c->cond->code[c->code_len++];
+  insn->op = op;
+  insn->a = a;
+  insn->b = b;
+
+  switch (op) {
+    case kPygOpLoad:
+    case kPygOpConst:
+    case kPygOpEqConst:
+    case kPygOpNotEqConst:
+      c->depth++;
+      break;
+    case kPygOpEq:
+    case kPygOpNotEq:
+    case kPygOpLT:
+    case kPygOpGT:
+    case kPygOpLTE:
+    case kPygOpGTE:
+    /* Value is kept only when jumping over the right side */
+    case kPygOpJumpIfFalse:
+    case kPygOpJumpIfTrue:
+      c->depth--;
+      break;
+    default:
+      break;
+  }
+
+  if (c->depth > c->cond->depth)
+    c->cond->depth = c->depth;
+}
+
+
+pyg_error_t pyg_cond_emit(pyg_cond_compiler_t* c,
+                          pyg_ast_t* ast,
+                          pyg_cond_type_t* type) {
+  pyg_error_t err;
+  unsigned int index;
+
+  switch (ast->type) {
+    case kPygAstBinary:
+      return pyg_cond_emit_binary(c, &ast->value.binary, type);
+    case kPygAstNot:
+      err = pyg_cond_emit(c, ast->value.arg, type);
+      if (!pyg_is_ok(err))
+        return err;
+      pyg_cond_emit_insn(c, kPygOpNot, 0, 0);
+      *type = kPygCondBool;
+      return pyg_ok();
+    case kPygAstName:
+      index = pyg_cond_ref(c->cond, &ast->value.name);
+      pyg_cond_emit_insn(c, kPygOpLoad, index, 0);
+      *type = kPygCondAny;
+      return pyg_ok();
+    case kPygAstStr:
+    case kPygAstInt:
+      err = pyg_cond_const(c, ast, &index);
+      if (!pyg_is_ok(err))
+        return err;
+      pyg_cond_emit_insn(c, kPygOpConst, index, 0);
+      *type = ast->type == kPygAstStr ? kPygCondStr : kPygCondInt;
+      return pyg_ok();
+    case kPygAstList:
+      return pyg_error_str(kPygErrGYP, "List can only be used with `in`");
+    default:
+      UNREACHABLE();
+      return pyg_ok();
   }
+}
+
+
+pyg_error_t pyg_cond_emit_binary(pyg_cond_compiler_t* c,
+                                 pyg_ast_binary_t* b,
+                                 pyg_cond_type_t* type) {
+  pyg_error_t err;
+  pyg_cond_type_t left;
+  pyg_cond_type_t right;
+  pyg_ast_t* name;
+  pyg_ast_t* literal;
+  unsigned int index;
+  unsigned int jump;
+  pyg_op_t op;
+
+  *type = kPygCondBool;
+
+  /* Right side is skipped if the left one decides the result */
+  if (b->op == kPygAstBinaryAnd || b->op == kPygAstBinaryOr) {
+    err = pyg_cond_emit(c, b->left, &left);
+    if (!pyg_is_ok(err))
+      return err;
+
+    jump = c->code_len;
+    pyg_cond_emit_insn(c,
+                       b->op == kPygAstBinaryAnd ? kPygOpJumpIfFalse :
+                                                   kPygOpJumpIfTrue,
+                       0,
+                       0);
+
+    err = pyg_cond_emit(c, b->right, &right);
+    if (!pyg_is_ok(err))
+      return err;
+    c->cond->code[jump].a = c->code_len;
 
-  if (ast->type == kPygAstStr) {
-    out->type = kPygValueStr;
-    out->value.str = ast->value.str;
+    if (left != kPygCondBool || right != kPygCondBool)
+      return pyg_error_str(kPygErrGYP, "Invalid input for and/or");
     return pyg_ok();
   }
 
-  if (ast->type == kPygAstInt) {
-    out->type = kPygValueInt;
-    out->value.num = ast->value.num;
+  if (b->op == kPygAstBinaryIn || b->op == kPygAstBinaryNotIn) {
+    if (b->right->type != kPygAstList)
+      return pyg_error_str(kPygErrGYP, "`in` expects a list");
+
+    err = pyg_cond_emit(c, b->left, &left);
+    if (!pyg_is_ok(err))
+      return err;
+
+    err = pyg_cond_set(c, &b->right->value.list, &index);
+    if (!pyg_is_ok(err))
+      return err;
+
+    pyg_cond_emit_insn(c,
+                       b->op == kPygAstBinaryIn ? kPygOpIn : kPygOpNotIn,
+                       index,
+                       0);
     return pyg_ok();
   }
 
-  b = &ast->value.binary;
-  err = pyg_eval_ast(vars, b->left, &left);
+  /* `name == "literal"`, the most common condition, in one instruction */
+  if (b->op == kPygAstBinaryEq || b->op == kPygAstBinaryNotEq) {
+    name = NULL;
+    literal = NULL;
+    if (b->left->type == kPygAstName) {
+      name = b->left;
+      literal = b->right;
+    } else if (b->right->type == kPygAstName) {
+      name = b->right;
+      literal = b->left;
+    }
+
+    if (name != NULL &&
+        (literal->type == kPygAstStr || literal->type == kPygAstInt)) {
+      err = pyg_cond_const(c, literal, &index);
+      if (!pyg_is_ok(err))
+        return err;
+
+      pyg_cond_emit_insn(c,
+                         b->op == kPygAstBinaryEq ? kPygOpEqConst :
+                                                    kPygOpNotEqConst,
+                         pyg_cond_ref(c->cond, &name->value.name),
+                         index);
+      return pyg_ok();
+    }
+  }
+
+  err = pyg_cond_emit(c, b->left, &left);
   if (!pyg_is_ok(err))
     return err;
 
-  err = pyg_eval_ast(vars, b->right, &right);
+  err = pyg_cond_emit(c, b->right, &right);
   if (!pyg_is_ok(err))
     return err;
 
-  /* Can't compare different types */
-  if (left.type != right.type)
+  /* Variables are checked when evaluated */
+  if (left != kPygCondAny && right != kPygCondAny && left != right)
     return pyg_error_str(kPygErrGYP, "Can\'t operate on different types");
 
   switch (b->op) {
-    case kPygAstBinaryEq:
-    case kPygAstBinaryNotEq:
-      if (left.type == kPygValueStr) {
-        int len;
-
-        len = left.value.str.len;
-        if (len != right.value.str.len)
-          res = 0;
+    case kPygAstBinaryEq: op = kPygOpEq; break;
+    case kPygAstBinaryNotEq: op = kPygOpNotEq; break;
+    case kPygAstBinaryLT: op = kPygOpLT; break;
+    case kPygAstBinaryGT: op = kPygOpGT; break;
+    case kPygAstBinaryLTE: op = kPygOpLTE; break;
+    case kPygAstBinaryGTE: op = kPygOpGTE; break;
+    default: UNREACHABLE(); op = kPygOpReturn; break;
+  }
+
+  if (op != kPygOpEq && op != kPygOpNotEq) {
+    if ((left != kPygCondAny && left != kPygCondInt) ||
+        (right != kPygCondAny && right != kPygCondInt)) {
+      return pyg_error_str(kPygErrGYP, "Invalid input for comparison");
+    }
+  }
+
+  pyg_cond_emit_insn(c, op, 0, 0);
+  return pyg_ok();
+}
+
+
+/* `values` are values of `pyg_cond_t.refs`, NULL until loaded */
+pyg_error_t pyg_cond_run(pyg_cond_t* cond,
+                         pyg_scope_t* vars,
+                         pyg_value_t** values,
+                         int* out) {
+  pyg_error_t err;
+  pyg_value_t inline_stack[PYG_EVAL_STACK];
+  pyg_value_t* stack;
+  pyg_value_t* sp;
+  pyg_insn_t* pc;
+  int res;
+
+  stack = inline_stack;
+  if (cond->depth > PYG_EVAL_STACK) {
+    stack = malloc(cond->depth * sizeof(*stack));
+    if (stack == NULL)
+      return pyg_error_str(kPygErrNoMem, "Failed to malloc() condition stack");
+  }
+
+  err = pyg_ok();
+  sp = stack;
+  for (pc = cond->code; ; pc++) {
+    switch (pc->op) {
+      case kPygOpLoad:
+        if (values[pc->a] == NULL) {
+          err = pyg_cond_load(cond, vars, values, pc->a);
+          if (!pyg_is_ok(err))
+            goto done;
+        }
+
+        /* Lists are compared by their string form */
+        *sp = *values[pc->a];
+        if (sp->type == kPygValueList)
+          sp->type = kPygValueStr;
+        sp++;
+        continue;
+      case kPygOpConst:
+        *sp++ = cond->consts[pc->a];
+        continue;
+      case kPygOpEqConst:
+      case kPygOpNotEqConst:
+        if (values[pc->a] == NULL) {
+          err = pyg_cond_load(cond, vars, values, pc->a);
+          if (!pyg_is_ok(err))
+            goto done;
+        }
+
+        err = pyg_cond_equal(values[pc->a], &cond->consts[pc->b], &res);
+        if (!pyg_is_ok(err))
+          goto done;
+        sp->type = kPygValueBool;
+        sp->value.num = res ^ (pc->op == kPygOpNotEqConst);
+        sp++;
+        continue;
+      case kPygOpEq:
+      case kPygOpNotEq:
+        sp--;
+        err = pyg_cond_equal(&sp[-1], sp, &res);
+        if (!pyg_is_ok(err))
+          goto done;
+        sp[-1].type = kPygValueBool;
+        sp[-1].value.num = res ^ (pc->op == kPygOpNotEq);
+        continue;
+      case kPygOpLT:
+      case kPygOpGT:
+      case kPygOpLTE:
+      case kPygOpGTE:
+        sp--;
+        if (sp[-1].type != kPygValueInt || sp->type != kPygValueInt) {
+          err = pyg_error_str(kPygErrGYP,
+                              sp[-1].type == sp->type ?
+                                  "Invalid input for comparison" :
+                                  "Can\'t operate on different types");
+          goto done;
+        }
+        if (pc->op == kPygOpLT)
+          res = sp[-1].value.num < sp->value.num;
+        else if (pc->op == kPygOpGT)
+          res = sp[-1].value.num > sp->value.num;
+        else if (pc->op == kPygOpLTE)
+          res = sp[-1].value.num <= sp->value.num;
         else
-          res = strncmp(left.value.str.str, right.value.str.str, len) == 0;
-      } else {
-        res = left.value.num == right.value.num;
-      }
-      if (b->op == kPygAstBinaryNotEq)
-        res = res == 0 ? 1 : 0;
-      break;
-    case kPygAstBinaryLT:
-    case kPygAstBinaryGTE:
-    case kPygAstBinaryLTE:
-    case kPygAstBinaryGT:
-      if (left.type == kPygValueInt) {
-        if (b->op == kPygAstBinaryLT || b->op == kPygAstBinaryGTE)
-          res = left.value.num < right.value.num;
-        else if (b->op == kPygAstBinaryGT || b->op == kPygAstBinaryLTE)
-          res = left.value.num > right.value.num;
-      } else {
-        /* `>`, `<` on non-int */
-        return pyg_error_str(kPygErrGYP, "Invalid input for comparison");
-      }
-      if (b->op == kPygAstBinaryGTE || b->op == kPygAstBinaryLTE)
-        res = res == 0 ? 1 : 0;
-      break;
-    case kPygAstBinaryAnd:
-    case kPygAstBinaryOr:
-      /* Should we skip evaluating other side? */
-      if (left.type == kPygValueBool) {
-        if (b->op == kPygAstBinaryOr)
-          res = left.value.num | right.value.num;
+          res = sp[-1].value.num >= sp->value.num;
+        sp[-1].type = kPygValueBool;
+        sp[-1].value.num = res;
+        continue;
+      case kPygOpIn:
+      case kPygOpNotIn:
+        res = pyg_cond_set_has(&cond->sets[pc->a], &sp[-1]);
+        sp[-1].type = kPygValueBool;
+        sp[-1].value.num = res ^ (pc->op == kPygOpNotIn);
+        continue;
+      case kPygOpNot:
+        res = !pyg_value_to_bool(&sp[-1]);
+        sp[-1].type = kPygValueBool;
+        sp[-1].value.num = res;
+        continue;
+      case kPygOpJumpIfFalse:
+      case kPygOpJumpIfTrue:
+        if (sp[-1].value.num == (pc->op == kPygOpJumpIfTrue))
+          pc = &cond->code[pc->a] - 1;
         else
-          res = left.value.num & right.value.num;
-      } else {
-        return pyg_error_str(kPygErrGYP, "Invalid input for and/or");
-      }
-      break;
-    default:
-      UNREACHABLE();
-      break;
+          sp--;
+        continue;
+      case kPygOpReturn:
+        *out = pyg_value_to_bool(&sp[-1]);
+        goto done;
+    }
+  }
+
+done:
+  if (stack != inline_stack)
+    free(stack);
+  return err;
+}
+
+
+pyg_error_t pyg_cond_load(pyg_cond_t* cond,
+                          pyg_scope_t* vars,
+                          pyg_value_t** values,
+                          unsigned int index) {
+  pyg_cond_ref_t* ref;
+  pyg_var_t* var;
+
+  ref = &cond->refs[index];
+  var = pyg_scope_hget(vars, ref->name, ref->len, ref->hash);
+  if (var == NULL) {
+    return pyg_error_str(kPygErrGYP,
+                         "Variable `%.*s` not found",
+                         (int) ref->len,
+                         ref->name);
   }
 
-  out->type = kPygValueBool;
-  out->value.num = res;
+  return pyg_unroll_var(var, &values[index]);
+}
+
+
+pyg_error_t pyg_cond_equal(pyg_value_t* left, pyg_value_t* right, int* out) {
+  pyg_value_type_t ltype;
+  pyg_value_type_t rtype;
+
+  ltype = left->type == kPygValueList ? kPygValueStr : left->type;
+  rtype = right->type == kPygValueList ? kPygValueStr : right->type;
+  if (ltype != rtype)
+    return pyg_error_str(kPygErrGYP, "Can\'t operate on different types");
+
+  /* Both are interned */
+  if (ltype == kPygValueStr)
+    *out = left->str == right->str;
+  else
+    *out = left->value.num == right->value.num;
   return pyg_ok();
 }
+
+
+int pyg_cond_set_has(pyg_cond_set_t* set, pyg_value_t* val) {
+  unsigned int i;
+
+  if (val->type == kPygValueStr) {
+    if (set->hashed)
+      return pyg_hashmap_iget(&set->map, val->str) != NULL;
+
+    for (i = 0; i < set->count; i++)
+      if (set->items[i].type == kPygValueStr && set->items[i].str == val->str)
+        return 1;
+  } else if (val->type == kPygValueInt) {
+    for (i = 0; i < set->count; i++) {
+      if (set->items[i].type == kPygValueInt &&
+          set->items[i].value.num == val->value.num) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
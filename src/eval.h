@@ -2,15 +2,25 @@
 #define SRC_EVAL_H_
 
 #include "src/common.h"
+#include "src/scope.h"
 
 typedef struct pyg_ast_s pyg_ast_t;
 typedef struct pyg_ast_binary_s pyg_ast_binary_t;
+typedef struct pyg_ast_name_s pyg_ast_name_t;
+typedef struct pyg_ast_list_s pyg_ast_list_t;
+typedef struct pyg_cond_s pyg_cond_t;
+typedef struct pyg_cond_ref_s pyg_cond_ref_t;
+typedef struct pyg_cond_set_s pyg_cond_set_t;
+typedef struct pyg_insn_s pyg_insn_t;
+typedef struct pyg_eval_stats_s pyg_eval_stats_t;
 
 enum pyg_ast_binary_op_e {
   kPygAstBinaryEq,
   kPygAstBinaryNotEq,
+  kPygAstBinaryIn,
+  kPygAstBinaryNotIn,
 
-  kPygAstBinaryLow = kPygAstBinaryNotEq,
+  kPygAstBinaryLow = kPygAstBinaryNotIn,
 
   kPygAstBinaryLT,
   kPygAstBinaryGT,
@@ -36,26 +46,138 @@ struct pyg_ast_binary_s {
 
 enum pyg_ast_type_e {
   kPygAstBinary,
+  kPygAstNot,
   kPygAstName,
   kPygAstStr,
-  kPygAstInt
+  kPygAstInt,
+  kPygAstList
 };
 typedef enum pyg_ast_type_e pyg_ast_type_t;
 
+struct pyg_ast_name_s {
+  pyg_str_t str;
+
+  /* Index in `pyg_cond_t.refs` */
+  unsigned int ref;
+};
+
+/* `[ ... ]` or `( ..., )` of string and integer literals */
+struct pyg_ast_list_s {
+  pyg_ast_t** items;
+  unsigned int count;
+};
+
 struct pyg_ast_s {
   pyg_ast_type_t type;
   union {
     pyg_ast_binary_t binary;
+    pyg_ast_t* arg;
+    pyg_ast_name_t name;
+    pyg_ast_list_t list;
     pyg_str_t str;
     int num;
   } value;
 };
 
+enum pyg_op_e {
+  /* Push `values[a]`, or `consts[a]` */
+  kPygOpLoad,
+  kPygOpConst,
+
+  /* Pop two values, push the result */
+  kPygOpEq,
+  kPygOpNotEq,
+  kPygOpLT,
+  kPygOpGT,
+  kPygOpLTE,
+  kPygOpGTE,
+
+  /* Push the result of `values[a] == consts[b]` */
+  kPygOpEqConst,
+  kPygOpNotEqConst,
+
+  /* Replace the top with its membership in `sets[a]`, or its negation */
+  kPygOpIn,
+  kPygOpNotIn,
+  kPygOpNot,
+
+  /* Jump to `a` keeping the top if it is false (true), pop it otherwise */
+  kPygOpJumpIfFalse,
+  kPygOpJumpIfTrue,
+
+  kPygOpReturn
+};
+typedef enum pyg_op_e pyg_op_t;
+
+struct pyg_insn_s {
+  pyg_op_t op;
+  unsigned int a;
+  unsigned int b;
+};
+
+struct pyg_cond_ref_s {
+  /* Points into the interned test string, read on every run */
+  const char* name;
+  unsigned int len;
+  uint64_t hash;
+};
+
+/* List literal, string items are interned */
+struct pyg_cond_set_s {
+  pyg_value_t* items;
+  unsigned int count;
+
+  /* Interned string items of long lists => item */
+  int hashed;
+  pyg_hashmap_t map;
+};
+
+/*
+ * Compiled condition. Every variable it references is listed once, and is
+ * loaded by its index in `refs`. Strings are interned, so they are equal
+ * only if they are the same pointer.
+ */
+struct pyg_cond_s {
+  pyg_insn_t* code;
+  pyg_value_t* consts;
+  pyg_cond_set_t* sets;
+  unsigned int set_count;
+
+  /* Maximum number of values on the stack */
+  unsigned int depth;
+
+  unsigned int ref_count;
+  pyg_cond_ref_t refs[1];
+};
+
+struct pyg_eval_stats_s {
+  /* Distinct condition strings compiled */
+  unsigned int conditions;
+
+  /* Runs of compiled conditions */
+  unsigned int evaluated;
+};
+
 pyg_error_t pyg_ast_parse(const char* str, pyg_ast_t** out);
 void pyg_ast_free(pyg_ast_t* ast);
 
-pyg_error_t pyg_eval_test(pyg_proto_hashmap_t* vars,
-                          const char* str,
-                          int* out);
+/*
+ * Compiled conditions are immutable and keyed by the interned test string,
+ * so one cache serves every .gyp file and thread of the process.
+ *
+ * Cache is created by the first `pyg_eval_ref()` and destroyed by the last
+ * `pyg_eval_unref()`, which should happen before the intern pool is gone.
+ */
+pyg_error_t pyg_eval_ref(void);
+void pyg_eval_unref(void);
+
+/* Counters of the cache since it was created */
+void pyg_eval_stats(pyg_eval_stats_t* stats);
+
+/*
+ * `str` must be interned: it is the key of the cache, and the compiled
+ * condition keeps pointers into it. Thread-safe.
+ */
+pyg_error_t pyg_eval_test(pyg_scope_t* vars, const char* str, int* out);
 
 #endif  /* SRC_EVAL_H_ */
@@ -0,0 +1,363 @@
+#include "src/exists.h"
+#include "src/common.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(__linux__) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#  define PYG_EXISTS_URING 1
+# endif
+#endif
+
+#ifdef PYG_EXISTS_URING
+# include <fcntl.h>
+# include <linux/io_uring.h>
+# include <linux/stat.h>
+# include <stdint.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif  /* PYG_EXISTS_URING */
+
+typedef struct pyg_exists_slice_s pyg_exists_slice_t;
+
+/* Every `step`-th path starting from `start` */
+struct pyg_exists_slice_s {
+  const char** paths;
+  char* missing;
+  unsigned int count;
+  unsigned int start;
+  unsigned int step;
+};
+
+static const unsigned int kPygExistsThreads = 8;
+
+static pyg_error_t pyg_exists_pool(const char** paths,
+                                   unsigned int count,
+                                   unsigned int jobs,
+                                   char* missing);
+static void* pyg_exists_worker(void* arg);
+
+#ifdef PYG_EXISTS_URING
+typedef struct pyg_uring_s pyg_uring_t;
+
+struct pyg_uring_s {
+  int fd;
+  unsigned int entries;
+
+  unsigned int* sq_tail;
+  unsigned int* sq_mask;
+  unsigned int* sq_array;
+  struct io_uring_sqe* sqes;
+
+  unsigned int* cq_head;
+  unsigned int* cq_tail;
+  unsigned int* cq_mask;
+  struct io_uring_cqe* cqes;
+
+  void* sq_ring;
+  size_t sq_size;
+  void* cq_ring;
+  size_t cq_size;
+  size_t sqes_size;
+};
+
+static const unsigned int kPygExistsRingSize = 256;
+
+static int pyg_uring_init(pyg_uring_t* ring, unsigned int entries);
+static void pyg_uring_destroy(pyg_uring_t* ring);
+static int pyg_exists_uring(const char** paths,
+                            unsigned int count,
+                            char* missing);
+#endif  /* PYG_EXISTS_URING */
+
+
+pyg_error_t pyg_exists_batch(const char** paths,
+                             unsigned int count,
+                             unsigned int jobs,
+                             char* missing) {
+#ifdef PYG_EXISTS_URING
+  const char* force;
+#endif  /* PYG_EXISTS_URING */
+
+  if (count == 0)
+    return pyg_ok();
+
+#ifdef PYG_EXISTS_URING
+  force = getenv("PYG_IO_URING");
+  if ((force == NULL || strcmp(force, "0") != 0) &&
+      pyg_exists_uring(paths, count, missing) == 0) {
+    return pyg_ok();
+  }
+#endif  /* PYG_EXISTS_URING */
+
+  return pyg_exists_pool(paths, count, jobs, missing);
+}
+
+
+pyg_error_t pyg_exists_pool(const char** paths,
+                            unsigned int count,
+                            unsigned int jobs,
+                            char* missing) {
+  pyg_exists_slice_t* slices;
+  pthread_t* threads;
+  char* started;
+  unsigned int i;
+
+  /* Checks are bound by latency rather than CPU, `-j` may only add more */
+  if (jobs < kPygExistsThreads)
+    jobs = kPygExistsThreads;
+  if (jobs > count)
+    jobs = count;
+
+  slices = calloc(jobs, sizeof(*slices) + sizeof(*threads) + 1);
+  if (slices == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_exists_slice_t");
+  threads = (pthread_t*) (slices + jobs);
+  started = (char*) (threads + jobs);
+
+  for (i = 0; i < jobs; i++) {
+    slices[i].paths = paths;
+    slices[i].missing = missing;
+    slices[i].count = count;
+    slices[i].start = i;
+    slices[i].step = jobs;
+
+    /* First slice is checked by the calling thread */
+    if (i != 0)
+      started[i] = pthread_create(&threads[i],
+                                  NULL,
+                                  pyg_exists_worker,
+                                  &slices[i]) == 0;
+  }
+
+  /* Slices of threads that failed to start are checked here too */
+  for (i = 0; i < jobs; i++)
+    if (!started[i])
+      pyg_exists_worker(&slices[i]);
+
+  for (i = 0; i < jobs; i++)
+    if (started[i])
+      pthread_join(threads[i], NULL);
+
+  free(slices);
+  return pyg_ok();
+}
+
+
+void* pyg_exists_worker(void* arg) {
+  pyg_exists_slice_t* slice;
+  unsigned int i;
+
+  slice = arg;
+  for (i = slice->start; i < slice->count; i += slice->step) {
+    struct stat st;
+
+    slice->missing[i] = stat(slice->paths[i], &st) != 0;
+  }
+
+  return NULL;
+}
+
+
+#ifdef PYG_EXISTS_URING
+
+int pyg_uring_init(pyg_uring_t* ring, unsigned int entries) {
+  struct io_uring_params p;
+  char* sq;
+  char* cq;
+
+  memset(&p, 0, sizeof(p));
+  ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (ring->fd < 0)
+    return -1;
+
+  ring->entries = p.sq_entries;
+  ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  /* Both rings may share the mapping */
+  if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+    if (ring->cq_size > ring->sq_size)
+      ring->sq_size = ring->cq_size;
+    ring->cq_size = ring->sq_size;
+  }
+
+  ring->sq_ring = mmap(NULL,
+                       ring->sq_size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED,
+                       ring->fd,
+                       IORING_OFF_SQ_RING);
+  if (ring->sq_ring == MAP_FAILED)
+    goto failed_sq_mmap;
+
+  if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+    ring->cq_ring = ring->sq_ring;
+  } else {
+    ring->cq_ring = mmap(NULL,
+                         ring->cq_size,
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED,
+                         ring->fd,
+                         IORING_OFF_CQ_RING);
+    if (ring->cq_ring == MAP_FAILED)
+      goto failed_cq_mmap;
+  }
+
+  ring->sqes = mmap(NULL,
+                    ring->sqes_size,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED,
+                    ring->fd,
+                    IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED)
+    goto failed_sqes_mmap;
+
+  sq = ring->sq_ring;
+  ring->sq_tail = (unsigned int*) (sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned int*) (sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned int*) (sq + p.sq_off.array);
+
+  cq = ring->cq_ring;
+  ring->cq_head = (unsigned int*) (cq + p.cq_off.head);
+  ring->cq_tail = (unsigned int*) (cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned int*) (cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+
+  return 0;
+
+failed_sqes_mmap:
+  if (ring->cq_ring != ring->sq_ring)
+    munmap(ring->cq_ring, ring->cq_size);
+
+failed_cq_mmap:
+  munmap(ring->sq_ring, ring->sq_size);
+
+failed_sq_mmap:
+  close(ring->fd);
+  return -1;
+}
+
+
+void pyg_uring_destroy(pyg_uring_t* ring) {
+  munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_ring != ring->sq_ring)
+    munmap(ring->cq_ring, ring->cq_size);
+  munmap(ring->sq_ring, ring->sq_size);
+  close(ring->fd);
+}
+
+
+/*
+ * Keeps up to `entries` STATX requests in flight, `user_data` holds index of
+ * the path (high bits) and of the result buffer (low bits). Returns -1 if
+ * io_uring or its STATX operation is not available.
+ */
+int pyg_exists_uring(const char** paths, unsigned int count, char* missing) {
+  pyg_uring_t ring;
+  struct statx* bufs;
+  unsigned int* free_bufs;
+  unsigned int free_count;
+  unsigned int next;
+  unsigned int done;
+  unsigned int pending;
+  int failed;
+
+  if (pyg_uring_init(&ring, kPygExistsRingSize) != 0)
+    return -1;
+
+  bufs = malloc(ring.entries * (sizeof(*bufs) + sizeof(*free_bufs)));
+  if (bufs == NULL) {
+    pyg_uring_destroy(&ring);
+    return -1;
+  }
+  free_bufs = (unsigned int*) (bufs + ring.entries);
+  for (free_count = 0; free_count < ring.entries; free_count++)
+    free_bufs[free_count] = free_count;
+
+  next = 0;
+  done = 0;
+  pending = 0;
+  failed = 0;
+
+  /* After a failure nothing is submitted, but in-flight requests are reaped */
+  while (done < next || (!failed && next < count)) {
+    unsigned int tail;
+    unsigned int head;
+    int n;
+
+    tail = *ring.sq_tail;
+    while (!failed && free_count > 0 && next < count) {
+      struct io_uring_sqe* sqe;
+      unsigned int idx;
+      unsigned int buf;
+
+      idx = tail & *ring.sq_mask;
+      buf = free_bufs[--free_count];
+
+      sqe = &ring.sqes[idx];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_STATX;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (uintptr_t) paths[next];
+      sqe->len = STATX_TYPE;
+      sqe->off = (uintptr_t) &bufs[buf];
+      sqe->user_data = ((uint64_t) next << 32) | buf;
+
+      ring.sq_array[idx] = idx;
+      tail++;
+      next++;
+      pending++;
+    }
+    __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+    n = syscall(__NR_io_uring_enter,
+                ring.fd,
+                pending,
+                1,
+                IORING_ENTER_GETEVENTS,
+                NULL,
+                0);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+
+      /*
+       * Can't wait for in-flight requests, they may still write to the
+       * buffers, leak them. The rings are not needed anymore.
+       */
+      pyg_uring_destroy(&ring);
+      return -1;
+    }
+    pending -= n;
+
+    head = *ring.cq_head;
+    tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      struct io_uring_cqe* cqe;
+
+      cqe = &ring.cqes[head & *ring.cq_mask];
+
+      /* Kernels before 5.6 do not support STATX */
+      if (cqe->res == -EINVAL)
+        failed = 1;
+
+      missing[cqe->user_data >> 32] = cqe->res < 0;
+      free_bufs[free_count++] = (unsigned int) cqe->user_data;
+      done++;
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  free(bufs);
+  pyg_uring_destroy(&ring);
+  return failed ? -1 : 0;
+}
+
+#endif  /* PYG_EXISTS_URING */
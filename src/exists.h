@@ -0,0 +1,20 @@
+#ifndef SRC_EXISTS_H_
+#define SRC_EXISTS_H_
+
+#include "src/error.h"
+
+/*
+ * Batched existence checks. On Linux all checks are submitted to io_uring
+ * as STATX requests, and the kernel runs them in parallel. Without io_uring
+ * (old kernel, seccomp, other OS, or `PYG_IO_URING=0` environment variable)
+ * paths are split between `jobs` threads calling stat(2).
+ *
+ * `missing[i]` is set to 1 if `paths[i]` does not exist (or can't be
+ * checked), and to 0 otherwise.
+ */
+pyg_error_t pyg_exists_batch(const char** paths,
+                             unsigned int count,
+                             unsigned int jobs,
+                             char* missing);
+
+#endif  /* SRC_EXISTS_H_ */
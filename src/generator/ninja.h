@@ -3,6 +3,6 @@
 
 #include "src/generator/base.h"
 
-pyg_gen_t pyg_gen_ninja;
+extern pyg_gen_t pyg_gen_ninja;
 
 #endif  /* SRC_GENERATOR_NINJA_H_ */
@@ -0,0 +1,538 @@
+#include "src/gyp.h"
+#include "src/common.h"
+#include "src/intern.h"
+#include "src/scan.h"
+
+#include "parson.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct pyg_gyp_parser_s pyg_gyp_parser_t;
+
+struct pyg_gyp_parser_s {
+  char* start;
+  char* end;
+  char* pos;
+  unsigned int depth;
+
+  /* Optional, receives `pyg_hash64()` of the contents before parsing */
+  uint64_t* hash;
+
+  /* Position tracking for error reporting */
+  unsigned int line;
+  char* line_start;
+
+  /* Filled in the parse callback, the buffer is gone once it returns */
+  int invoked;
+  unsigned int err_line;
+  unsigned int err_column;
+  char err[256];
+};
+
+static const unsigned int kPygGypMaxDepth = 256;
+
+static JSON_Value* pyg_gyp_parse_root(char* buffer, size_t size, void* arg);
+static JSON_Value* pyg_gyp_parse_value(pyg_gyp_parser_t* p);
+static JSON_Value* pyg_gyp_parse_dict(pyg_gyp_parser_t* p);
+static JSON_Value* pyg_gyp_parse_list(pyg_gyp_parser_t* p, char close);
+static char* pyg_gyp_parse_str(pyg_gyp_parser_t* p, size_t* len);
+static JSON_Value* pyg_gyp_parse_number(pyg_gyp_parser_t* p);
+static JSON_Value* pyg_gyp_parse_name(pyg_gyp_parser_t* p);
+static int pyg_gyp_parse_hex(char ch);
+static void pyg_gyp_skip(pyg_gyp_parser_t* p);
+static void* pyg_gyp_fail(pyg_gyp_parser_t* p,
+                          const char* pos,
+                          const char* fmt,
+                          ...);
+static void* pyg_gyp_fail_unexpected(pyg_gyp_parser_t* p,
+                                     const char* expected);
+
+
+pyg_error_t pyg_gyp_parse_file(const char* path,
+                               uint64_t* hash,
+                               JSON_Value** out) {
+  pyg_gyp_parser_t p;
+  JSON_Value* res;
+
+  pyg_scan_init();
+
+  p.hash = hash;
+  p.invoked = 0;
+  p.err[0] = '\0';
+
+  res = json_parse_file_with(path, pyg_gyp_parse_root, &p);
+  if (res != NULL) {
+    *out = res;
+    return pyg_ok();
+  }
+
+  if (!p.invoked)
+    return pyg_error_str(kPygErrFS, "Failed to read file: %s", path);
+
+  /* Parsed successfully, but failed to allocate the document */
+  if (p.err[0] == '\0')
+    return pyg_error_str(kPygErrNoMem, "JSON_Document: %s", path);
+
+  return pyg_error_str(kPygErrJSON,
+                       "%s:%u:%u: %s",
+                       path,
+                       p.err_line,
+                       p.err_column,
+                       p.err);
+}
+
+
+JSON_Value* pyg_gyp_parse_root(char* buffer, size_t size, void* arg) {
+  pyg_gyp_parser_t* p;
+  JSON_Value* res;
+
+  p = arg;
+  p->invoked = 1;
+  p->start = buffer;
+  p->end = buffer + size;
+  p->pos = buffer;
+  p->depth = 0;
+  p->line = 1;
+  p->line_start = buffer;
+
+  /* Strings are unescaped in place, so hash the buffer before that */
+  if (p->hash != NULL)
+    *p->hash = pyg_hash64(buffer, size);
+
+  /* UTF-8 BOM */
+  if (size >= 3 && memcmp(buffer, "\xef\xbb\xbf", 3) == 0)
+    p->pos += 3;
+
+  res = pyg_gyp_parse_value(p);
+  if (res == NULL)
+    return NULL;
+
+  pyg_gyp_skip(p);
+  if (p->pos != p->end) {
+    json_value_free(res);
+    return pyg_gyp_fail_unexpected(p, "end of file");
+  }
+
+  return res;
+}
+
+
+JSON_Value* pyg_gyp_parse_value(pyg_gyp_parser_t* p) {
+  JSON_Value* res;
+  char* str;
+
+  pyg_gyp_skip(p);
+  switch (*p->pos) {
+    case '{':
+      return pyg_gyp_parse_dict(p);
+    case '[':
+      return pyg_gyp_parse_list(p, ']');
+    case '(':
+      return pyg_gyp_parse_list(p, ')');
+    case '\'':
+    case '"':
+      str = pyg_gyp_parse_str(p, NULL);
+      if (str == NULL)
+        return NULL;
+      res = json_value_init_string_in_place(str);
+      if (res == NULL)
+        return pyg_gyp_fail(p, p->pos, "Out of memory");
+      return res;
+    case '-':
+    case '+':
+    case '.':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+      return pyg_gyp_parse_number(p);
+    case 'T':
+    case 'F':
+    case 'N':
+    case 't':
+    case 'f':
+    case 'n':
+      return pyg_gyp_parse_name(p);
+    default:
+      return pyg_gyp_fail_unexpected(p, "value");
+  }
+}
+
+
+JSON_Value* pyg_gyp_parse_dict(pyg_gyp_parser_t* p) {
+  JSON_Value* res;
+  JSON_Object* obj;
+
+  if (++p->depth > kPygGypMaxDepth)
+    return pyg_gyp_fail(p, p->pos, "Nesting is too deep");
+
+  /* Keys are interned below, the object owns none of them */
+  res = json_value_init_object_in_place(p->start, p->end);
+  if (res == NULL)
+    return pyg_gyp_fail(p, p->pos, "Out of memory");
+  obj = json_object(res);
+
+  /* Skip `{` */
+  p->pos++;
+  for (;;) {
+    JSON_Value* value;
+    const char* key;
+    char* key_pos;
+    char* str;
+    size_t len;
+
+    pyg_gyp_skip(p);
+    if (*p->pos == '}')
+      break;
+
+    if (*p->pos != '\'' && *p->pos != '"') {
+      pyg_gyp_fail_unexpected(p, "string key or `}`");
+      goto failed;
+    }
+
+    key_pos = p->pos;
+    str = pyg_gyp_parse_str(p, &len);
+    if (str == NULL)
+      goto failed;
+
+    /* Same keys are repeated over and over in every file */
+    key = pyg_intern(str, len);
+    if (key == NULL) {
+      pyg_gyp_fail(p, key_pos, "Out of memory");
+      goto failed;
+    }
+
+    pyg_gyp_skip(p);
+    if (*p->pos != ':') {
+      pyg_gyp_fail_unexpected(p, "`:`");
+      goto failed;
+    }
+    p->pos++;
+
+    value = pyg_gyp_parse_value(p);
+    if (value == NULL)
+      goto failed;
+
+    /* Duplicate keys: the last one wins, as in Python */
+    if (json_object_set_interned_value(obj, key, value) != JSONSuccess) {
+      json_value_free(value);
+      pyg_gyp_fail(p, key_pos, "Failed to add key `%s`", key);
+      goto failed;
+    }
+
+    pyg_gyp_skip(p);
+    if (*p->pos == ',') {
+      p->pos++;
+      continue;
+    }
+    if (*p->pos == '}')
+      break;
+
+    pyg_gyp_fail_unexpected(p, "`,` or `}`");
+    goto failed;
+  }
+
+  /* Skip `}` */
+  p->pos++;
+  p->depth--;
+  return res;
+
+failed:
+  json_value_free(res);
+  return NULL;
+}
+
+
+JSON_Value* pyg_gyp_parse_list(pyg_gyp_parser_t* p, char close) {
+  JSON_Value* res;
+  JSON_Array* arr;
+
+  if (++p->depth > kPygGypMaxDepth)
+    return pyg_gyp_fail(p, p->pos, "Nesting is too deep");
+
+  res = json_value_init_array();
+  if (res == NULL)
+    return pyg_gyp_fail(p, p->pos, "Out of memory");
+  arr = json_array(res);
+
+  /* Skip `[` or `(` */
+  p->pos++;
+  for (;;) {
+    JSON_Value* value;
+    char* value_pos;
+
+    pyg_gyp_skip(p);
+    if (*p->pos == close)
+      break;
+
+    value_pos = p->pos;
+    value = pyg_gyp_parse_value(p);
+    if (value == NULL)
+      goto failed;
+
+    if (json_array_append_value(arr, value) != JSONSuccess) {
+      json_value_free(value);
+      pyg_gyp_fail(p, value_pos, "Failed to append list item");
+      goto failed;
+    }
+
+    pyg_gyp_skip(p);
+    if (*p->pos == ',') {
+      p->pos++;
+      continue;
+    }
+    if (*p->pos == close)
+      break;
+
+    pyg_gyp_fail_unexpected(p, close == ']' ? "`,` or `]`" : "`,` or `)`");
+    goto failed;
+  }
+
+  /* Skip `]` or `)` */
+  p->pos++;
+  p->depth--;
+  return res;
+
+failed:
+  json_value_free(res);
+  return NULL;
+}
+
+
+/*
+ * Unescapes string literal in place, the result is never longer than the
+ * source. Adjacent literals are concatenated: `'a' "b"` is `ab`.
+ */
+char* pyg_gyp_parse_str(pyg_gyp_parser_t* p, size_t* len) {
+  char* res;
+  char* out;
+  char* pos;
+
+  pos = p->pos;
+  res = pos + 1;
+  out = res;
+  for (;;) {
+    char quote;
+
+    quote = *pos++;
+    for (;;) {
+      char ch;
+      int hi;
+      int lo;
+
+      ch = *pos;
+      if (ch == quote)
+        break;
+
+      if (ch == '\n' || (ch == '\0' && pos == p->end))
+        return pyg_gyp_fail(p, pos, "Unterminated string");
+
+      /* Move the whole run of plain characters at once */
+      if (ch != '\\') {
+        char* run;
+        int ascii;
+
+        ascii = 1;
+        run = (char*) pyg_scan.str(pos, p->end, quote, &ascii);
+        if (!ascii) {
+          const char* invalid;
+
+          invalid = pyg_scan.utf8(pos, run);
+          if (invalid != NULL)
+            return pyg_gyp_fail(p, invalid, "Invalid UTF-8 in string");
+        }
+
+        if (out != pos)
+          memmove(out, pos, run - pos);
+        out += run - pos;
+        pos = run;
+        continue;
+      }
+
+      pos++;
+      switch (*pos) {
+        case '\r':
+          if (pos[1] != '\n') {
+            *out++ = '\\';
+            *out++ = '\r';
+            break;
+          }
+          pos++;
+          /* fall through */
+        case '\n':
+          /* Line continuation */
+          p->line++;
+          p->line_start = pos + 1;
+          break;
+        case '\\':
+        case '\'':
+        case '"':
+          *out++ = *pos;
+          break;
+        case 'n': *out++ = '\n'; break;
+        case 't': *out++ = '\t'; break;
+        case 'r': *out++ = '\r'; break;
+        case 'a': *out++ = '\a'; break;
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'v': *out++ = '\v'; break;
+        case 'x':
+          hi = pyg_gyp_parse_hex(pos[1]);
+          lo = hi == -1 ? -1 : pyg_gyp_parse_hex(pos[2]);
+          if (lo == -1 || (hi == 0 && lo == 0))
+            return pyg_gyp_fail(p, pos - 1, "Invalid `\\x` escape");
+          *out++ = (char) ((hi << 4) | lo);
+          pos += 2;
+          break;
+        case '\0':
+          if (pos == p->end)
+            return pyg_gyp_fail(p, pos, "Unterminated string");
+          /* fall through */
+        default:
+          /* Unknown escapes are kept verbatim, as in Python */
+          *out++ = '\\';
+          *out++ = *pos;
+          break;
+      }
+      pos++;
+    }
+
+    /* Skip closing quote */
+    p->pos = pos + 1;
+    pyg_gyp_skip(p);
+    pos = p->pos;
+    if (*pos != '\'' && *pos != '"')
+      break;
+  }
+
+  *out = '\0';
+  if (len != NULL)
+    *len = out - res;
+  return res;
+}
+
+
+JSON_Value* pyg_gyp_parse_number(pyg_gyp_parser_t* p) {
+  JSON_Value* res;
+  char* end;
+  double num;
+
+  num = strtod(p->pos, &end);
+  if (end == p->pos)
+    return pyg_gyp_fail_unexpected(p, "number");
+  p->pos = end;
+
+  res = json_value_init_number(num);
+  if (res == NULL)
+    return pyg_gyp_fail(p, p->pos, "Out of memory");
+  return res;
+}
+
+
+JSON_Value* pyg_gyp_parse_name(pyg_gyp_parser_t* p) {
+  JSON_Value* res;
+  char* start;
+  char* pos;
+  int len;
+
+  start = p->pos;
+  for (pos = start;
+       (*pos >= 'a' && *pos <= 'z') || (*pos >= 'A' && *pos <= 'Z') ||
+           (*pos >= '0' && *pos <= '9') || *pos == '_';
+       pos++) {
+  }
+  len = pos - start;
+
+#define PYG_GYP_NAME(str) \
+    (len == sizeof(str) - 1 && memcmp(start, str, sizeof(str) - 1) == 0)
+  if (PYG_GYP_NAME("True") || PYG_GYP_NAME("true"))
+    res = json_value_init_boolean(1);
+  else if (PYG_GYP_NAME("False") || PYG_GYP_NAME("false"))
+    res = json_value_init_boolean(0);
+  else if (PYG_GYP_NAME("None") || PYG_GYP_NAME("null"))
+    res = json_value_init_null();
+  else
+    return pyg_gyp_fail(p, start, "Unknown name `%.*s`", len, start);
+#undef PYG_GYP_NAME
+
+  if (res == NULL)
+    return pyg_gyp_fail(p, start, "Out of memory");
+
+  p->pos = pos;
+  return res;
+}
+
+
+int pyg_gyp_parse_hex(char ch) {
+  if (ch >= '0' && ch <= '9')
+    return ch - '0';
+  if (ch >= 'a' && ch <= 'f')
+    return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F')
+    return ch - 'A' + 10;
+  return -1;
+}
+
+
+/* Skip whitespace and `#` comments, counting lines on the way */
+void pyg_gyp_skip(pyg_gyp_parser_t* p) {
+  char* pos;
+
+  pos = p->pos;
+  for (;;) {
+    switch (*pos) {
+      case '\n':
+        p->line++;
+        p->line_start = pos + 1;
+        /* fall through */
+      case ' ':
+      case '\t':
+      case '\r':
+      case '\f':
+      case '\v':
+        pos = (char*) pyg_scan.blank(pos + 1, p->end);
+        break;
+      case '#':
+        pos = memchr(pos, '\n', p->end - pos);
+        if (pos == NULL)
+          pos = p->end;
+        break;
+      default:
+        p->pos = pos;
+        return;
+    }
+  }
+}
+
+
+/* NOTE: Only the first error is recorded, always returns NULL */
+void* pyg_gyp_fail(pyg_gyp_parser_t* p, const char* pos, const char* fmt, ...) {
+  va_list ap;
+
+  if (p->err[0] != '\0')
+    return NULL;
+
+  p->err_line = p->line;
+  p->err_column = pos - p->line_start + 1;
+
+  va_start(ap, fmt);
+  vsnprintf(p->err, sizeof(p->err), fmt, ap);
+  va_end(ap);
+
+  return NULL;
+}
+
+
+void* pyg_gyp_fail_unexpected(pyg_gyp_parser_t* p, const char* expected) {
+  unsigned char ch;
+
+  ch = *p->pos;
+  if (p->pos == p->end)
+    return pyg_gyp_fail(p, p->pos, "Unexpected end of file, expected %s",
+                        expected);
+  if (ch >= 0x20 && ch < 0x7f)
+    return pyg_gyp_fail(p, p->pos, "Unexpected `%c`, expected %s",
+                        ch, expected);
+  return pyg_gyp_fail(p, p->pos, "Unexpected byte 0x%02x, expected %s",
+                      ch, expected);
+}
@@ -0,0 +1,24 @@
+#ifndef SRC_GYP_H_
+#define SRC_GYP_H_
+
+#include "src/common.h"
+#include "src/error.h"
+
+#include "parson.h"
+
+#include <stdint.h>
+
+/*
+ * Native parser of .gyp/.gypi files, i.e. of Python literals: single and
+ * double quoted strings (with implicit concatenation), trailing commas,
+ * `#` comments, `True`/`False`/`None` (and their JSON counterparts).
+ *
+ * The file is mapped and parsed in place in a single forward scan, strings
+ * of the resulting tree point into the mapping. Errors carry line and column.
+ * If `hash` is not NULL - it receives `pyg_hash64()` of the file contents.
+ */
+pyg_error_t pyg_gyp_parse_file(const char* path,
+                               uint64_t* hash,
+                               JSON_Value** out);
+
+#endif  /* SRC_GYP_H_ */
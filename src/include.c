@@ -0,0 +1,455 @@
+#include "src/include.h"
+#include "src/arena.h"
+#include "src/cache.h"
+#include "src/common.h"
+#include "src/intern.h"
+#include "src/json.h"
+#include "src/keywords.h"
+
+#include "parson.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const unsigned kPygIncludeCount = 16;
+
+typedef struct pyg_include_frame_s pyg_include_frame_t;
+
+/* Files being loaded by the current thread, innermost first */
+struct pyg_include_frame_s {
+  pyg_include_t* entry;
+  pyg_include_frame_t* parent;
+};
+
+static pyg_error_t pyg_includes_free_entry(pyg_hashmap_item_t* item,
+                                           void* arg);
+static pyg_error_t pyg_include_new(const char* path, pyg_include_t** out);
+static void pyg_include_free(pyg_include_t* entry);
+static pyg_error_t pyg_includes_apply_value(pyg_includes_t* includes,
+                                            const char* dir,
+                                            JSON_Value* value,
+                                            pyg_include_frame_t* stack);
+static pyg_error_t pyg_includes_apply_obj(pyg_includes_t* includes,
+                                          const char* dir,
+                                          JSON_Object* obj,
+                                          pyg_include_frame_t* stack);
+static pyg_error_t pyg_includes_get(pyg_includes_t* includes,
+                                    const char* path,
+                                    pyg_include_frame_t* stack,
+                                    pyg_include_t** out);
+static pyg_error_t pyg_includes_wait(pyg_includes_t* includes,
+                                     pyg_include_t* entry,
+                                     pyg_include_frame_t* stack);
+static pyg_error_t pyg_include_load(pyg_includes_t* includes,
+                                    pyg_include_t* entry,
+                                    pyg_include_frame_t* stack);
+static pyg_error_t pyg_include_rebase(const char* dir, JSON_Value* value);
+static pyg_error_t pyg_include_rebase_arr(const char* dir,
+                                          JSON_Array* arr,
+                                          int deps);
+static int pyg_include_path_key(const char* name, int* deps);
+
+
+pyg_error_t pyg_includes_init(pyg_includes_t* includes, pyg_cache_t* cache) {
+  pyg_error_t err;
+
+  includes->cache = cache;
+
+  err = pyg_hashmap_init(&includes->map, kPygIncludeCount);
+  if (!pyg_is_ok(err))
+    return err;
+
+  if (pthread_mutex_init(&includes->mutex, NULL) != 0) {
+    pyg_hashmap_destroy(&includes->map);
+    return pyg_error_str(kPygErrNoMem, "pthread_mutex_init()");
+  }
+
+  return pyg_ok();
+}
+
+
+void pyg_includes_destroy(pyg_includes_t* includes) {
+  pyg_hashmap_iterate(&includes->map, pyg_includes_free_entry, NULL);
+  pyg_hashmap_destroy(&includes->map);
+  pthread_mutex_destroy(&includes->mutex);
+}
+
+
+pyg_error_t pyg_includes_free_entry(pyg_hashmap_item_t* item, void* arg) {
+  pyg_include_free(item->value);
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_include_new(const char* path, pyg_include_t** out) {
+  pyg_include_t* entry;
+
+  entry = calloc(1, sizeof(*entry));
+  if (entry == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_include_t");
+
+  if (pthread_cond_init(&entry->ready_cond, NULL) != 0) {
+    free(entry);
+    return pyg_error_str(kPygErrNoMem, "pthread_cond_init()");
+  }
+
+  entry->path = path;
+  pyg_arena_init(&entry->arena);
+
+  *out = entry;
+  return pyg_ok();
+}
+
+
+void pyg_include_free(pyg_include_t* entry) {
+  pyg_arena_t* prev;
+
+  prev = pyg_arena_enter(&entry->arena);
+  if (entry->json != NULL)
+    json_value_free(entry->json);
+  pyg_arena_enter(prev);
+  pyg_arena_destroy(&entry->arena);
+  pthread_cond_destroy(&entry->ready_cond);
+  free(entry);
+}
+
+
+pyg_error_t pyg_includes_apply(pyg_includes_t* includes,
+                               const char* dir,
+                               JSON_Object* obj) {
+  return pyg_includes_apply_obj(includes, dir, obj, NULL);
+}
+
+
+pyg_error_t pyg_includes_apply_value(pyg_includes_t* includes,
+                                     const char* dir,
+                                     JSON_Value* value,
+                                     pyg_include_frame_t* stack) {
+  JSON_Array* arr;
+  size_t i;
+  size_t count;
+
+  if (json_value_get_type(value) == JSONObject)
+    return pyg_includes_apply_obj(includes, dir, json_object(value), stack);
+
+  arr = json_value_get_array(value);
+  if (arr == NULL)
+    return pyg_ok();
+
+  count = json_array_get_count(arr);
+  for (i = 0; i < count; i++) {
+    pyg_error_t err;
+
+    err = pyg_includes_apply_value(includes,
+                                   dir,
+                                   json_array_get_value(arr, i),
+                                   stack);
+    if (!pyg_is_ok(err))
+      return err;
+  }
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_includes_apply_obj(pyg_includes_t* includes,
+                                   const char* dir,
+                                   JSON_Object* obj,
+                                   pyg_include_frame_t* stack) {
+  pyg_error_t err;
+  JSON_Value* list;
+  JSON_Array* arr;
+  size_t i;
+  size_t count;
+
+  /*
+   * Nested objects first, merged trees are already resolved and do not have
+   * to be visited again
+   */
+  count = json_object_get_count(obj);
+  for (i = 0; i < count; i++) {
+    err = pyg_includes_apply_value(includes,
+                                   dir,
+                                   json_object_get_value_at(obj, i),
+                                   stack);
+    if (!pyg_is_ok(err))
+      return err;
+  }
+
+  list = json_object_get_value(obj, "includes");
+  if (list == NULL)
+    return pyg_ok();
+
+  arr = json_value_get_array(list);
+  if (arr == NULL)
+    return pyg_error_str(kPygErrJSON, "`includes` not array in %s", dir);
+
+  count = json_array_get_count(arr);
+  for (i = 0; i < count; i++) {
+    const char* path;
+    const char* ipath;
+    pyg_include_t* entry;
+
+    entry = NULL;
+    path = json_array_get_string(arr, i);
+    if (path == NULL)
+      return pyg_error_str(kPygErrJSON, "`includes`[%d] not string", (int) i);
+
+    err = pyg_path_resolve(dir, path, strlen(path), 1, &ipath);
+    if (!pyg_is_ok(err))
+      return err;
+
+    err = pyg_includes_get(includes, ipath, stack, &entry);
+    if (!pyg_is_ok(err))
+      return err;
+
+    /* Loaded entries are never modified, no lock is needed to read them */
+    err = pyg_merge_json_obj(obj, json_object(entry->json), kPygMergeAuto);
+    if (!pyg_is_ok(err))
+      return err;
+  }
+
+  if (json_object_remove(obj, "includes") != JSONSuccess)
+    return pyg_error_str(kPygErrJSON, "Failed to remove `includes`");
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_includes_get(pyg_includes_t* includes,
+                             const char* path,
+                             pyg_include_frame_t* stack,
+                             pyg_include_t** out) {
+  pyg_error_t err;
+  pyg_include_t* entry;
+
+  pthread_mutex_lock(&includes->mutex);
+  entry = pyg_hashmap_iget(&includes->map, path);
+  if (entry != NULL) {
+    err = pyg_includes_wait(includes, entry, stack);
+    pthread_mutex_unlock(&includes->mutex);
+    if (!pyg_is_ok(err))
+      return err;
+
+    *out = entry;
+    return pyg_ok();
+  }
+
+  /* Placeholder, so other threads wait for this file instead of loading it */
+  err = pyg_include_new(path, &entry);
+  if (pyg_is_ok(err)) {
+    err = pyg_hashmap_iinsert(&includes->map, path, entry);
+    if (!pyg_is_ok(err))
+      pyg_include_free(entry);
+  }
+  pthread_mutex_unlock(&includes->mutex);
+  if (!pyg_is_ok(err))
+    return err;
+
+  /* Unrelated files are loaded by other threads meanwhile */
+  err = pyg_include_load(includes, entry, stack);
+
+  pthread_mutex_lock(&includes->mutex);
+  entry->ready = 1;
+  entry->code = err.code;
+  if (!pyg_is_ok(err)) {
+    /* Error string is thread-local, copy it out for the waiters */
+    snprintf(entry->msg,
+             sizeof(entry->msg),
+             "%s",
+             err.str == NULL ? "" : err.str);
+  }
+  pthread_cond_broadcast(&entry->ready_cond);
+  pthread_mutex_unlock(&includes->mutex);
+  if (!pyg_is_ok(err))
+    return err;
+
+  *out = entry;
+  return pyg_ok();
+}
+
+
+/* NOTE: Should be called with mutex held */
+pyg_error_t pyg_includes_wait(pyg_includes_t* includes,
+                              pyg_include_t* entry,
+                              pyg_include_frame_t* stack) {
+  pyg_include_t* waiting;
+  pyg_include_frame_t* frame;
+
+  if (!entry->ready) {
+    /*
+     * Follow the entries that loading threads wait for, a cycle through this
+     * thread would never be ready
+     */
+    for (waiting = entry; waiting != NULL; waiting = waiting->waiting) {
+      for (frame = stack; frame != NULL; frame = frame->parent) {
+        if (frame->entry == waiting) {
+          return pyg_error_str(kPygErrGYP,
+                               "Include cycle at %s",
+                               entry->path);
+        }
+      }
+    }
+
+    for (frame = stack; frame != NULL; frame = frame->parent)
+      frame->entry->waiting = entry;
+    while (!entry->ready)
+      pthread_cond_wait(&entry->ready_cond, &includes->mutex);
+    for (frame = stack; frame != NULL; frame = frame->parent)
+      frame->entry->waiting = NULL;
+  }
+
+  if (entry->code != kPygOk)
+    return pyg_error_str(entry->code, "%s", entry->msg);
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_include_load(pyg_includes_t* includes,
+                             pyg_include_t* entry,
+                             pyg_include_frame_t* stack) {
+  pyg_error_t err;
+  pyg_include_frame_t frame;
+  pyg_arena_t* prev;
+  JSON_Object* obj;
+  char* dir;
+
+  dir = pyg_dirname(entry->path);
+  if (dir == NULL)
+    return pyg_error_str(kPygErrFS, "pyg_dirname(%s)", entry->path);
+
+  /* NOTE: Caller has set the intern function already */
+  prev = pyg_arena_enter(&entry->arena);
+
+  err = pyg_cache_parse_file(includes->cache, entry->path, &entry->json);
+  if (!pyg_is_ok(err))
+    goto done;
+
+  obj = json_object(entry->json);
+  if (obj == NULL) {
+    err = pyg_error_str(kPygErrJSON, "JSON not object: %s", entry->path);
+    goto done;
+  }
+
+  frame.entry = entry;
+  frame.parent = stack;
+  err = pyg_includes_apply_obj(includes, dir, obj, &frame);
+  if (!pyg_is_ok(err))
+    goto done;
+
+  err = pyg_include_rebase(dir, entry->json);
+
+done:
+  pyg_arena_enter(prev);
+  free(dir);
+  return err;
+}
+
+
+pyg_error_t pyg_include_rebase(const char* dir, JSON_Value* value) {
+  pyg_error_t err;
+  JSON_Object* obj;
+  JSON_Array* arr;
+  size_t i;
+  size_t count;
+
+  arr = json_value_get_array(value);
+  if (arr != NULL) {
+    count = json_array_get_count(arr);
+    for (i = 0; i < count; i++) {
+      err = pyg_include_rebase(dir, json_array_get_value(arr, i));
+      if (!pyg_is_ok(err))
+        return err;
+    }
+    return pyg_ok();
+  }
+
+  obj = json_value_get_object(value);
+  if (obj == NULL)
+    return pyg_ok();
+
+  count = json_object_get_count(obj);
+  for (i = 0; i < count; i++) {
+    JSON_Value* sub;
+    int deps;
+
+    sub = json_object_get_value_at(obj, i);
+    arr = json_value_get_array(sub);
+    if (arr != NULL && pyg_include_path_key(json_object_get_name(obj, i),
+                                            &deps)) {
+      err = pyg_include_rebase_arr(dir, arr, deps);
+    } else {
+      err = pyg_include_rebase(dir, sub);
+    }
+    if (!pyg_is_ok(err))
+      return err;
+  }
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_include_rebase_arr(const char* dir,
+                                   JSON_Array* arr,
+                                   int deps) {
+  size_t i;
+  size_t count;
+
+  count = json_array_get_count(arr);
+  for (i = 0; i < count; i++) {
+    const char* path;
+    char buf[PATH_MAX];
+    int len;
+    JSON_Value* value;
+
+    path = json_array_get_string(arr, i);
+    if (path == NULL)
+      continue;
+
+    /* Absolute, variables, commands and flags are left as they are */
+    if (path[0] == '\0' || strchr("/<>^$-", path[0]) != NULL)
+      continue;
+
+    /* `target` without `file.gyp:` belongs to the including file */
+    if (deps && strchr(path, ':') == NULL)
+      continue;
+
+    len = snprintf(buf, sizeof(buf), "%s/%s", dir, path);
+    if (len < 0 || (size_t) len >= sizeof(buf))
+      return pyg_error_str(kPygErrFS, "Path too long: %s/%s", dir, path);
+
+    value = json_value_init_string(buf);
+    if (value == NULL)
+      return pyg_error_str(kPygErrNoMem, "json_value_init_string");
+
+    if (json_array_replace_value(arr, i, value) != JSONSuccess) {
+      json_value_free(value);
+      return pyg_error_str(kPygErrJSON, "Failed to insert string into array");
+    }
+  }
+
+  return pyg_ok();
+}
+
+
+/* Keys holding lists of paths, including merge suffixes (`sources!`, ...) */
+int pyg_include_path_key(const char* name, int* deps) {
+  unsigned int len;
+
+  len = strlen(name);
+  if (len > 0 && strchr("=?+!", name[len - 1]) != NULL)
+    len--;
+
+  switch (pyg_keyword(name, len)) {
+    case kPygKwKeySources:
+    case kPygKwKeyIncludeDirs:
+      *deps = 0;
+      return 1;
+    case kPygKwKeyDependencies:
+      *deps = 1;
+      return 1;
+    default:
+      return 0;
+  }
+}
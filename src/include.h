@@ -0,0 +1,70 @@
+#ifndef SRC_INCLUDE_H_
+#define SRC_INCLUDE_H_
+
+#include "src/arena.h"
+#include "src/cache.h"
+#include "src/common.h"
+#include "src/error.h"
+
+#include "parson.h"
+
+#include <pthread.h>
+
+typedef struct pyg_includes_s pyg_includes_t;
+typedef struct pyg_include_s pyg_include_t;
+
+/*
+ * Files listed in `includes` (usually .gypi) are parsed once per run, no
+ * matter how many files include them. Each entry keeps the fully resolved
+ * tree: nested includes are merged in, and relative paths in `sources`,
+ * `include_dirs` and `dependencies` are rebased on the directory of the
+ * included file, so the tree may be merged into files from any directory.
+ */
+struct pyg_include_s {
+  /* Interned realpath */
+  const char* path;
+
+  pyg_arena_t arena;
+  JSON_Value* json;
+
+  /*
+   * Entry is inserted before it is loaded, by the thread that loads it.
+   * Others wait on `ready_cond` until `ready` is set. Guarded by
+   * `pyg_includes_t.mutex`.
+   */
+  int ready;
+  pthread_cond_t ready_cond;
+  pyg_error_code_t code;
+  char msg[1024];
+
+  /* Entry the loading thread waits for, to detect cycles across threads */
+  pyg_include_t* waiting;
+};
+
+struct pyg_includes_s {
+  /* May be NULL */
+  pyg_cache_t* cache;
+
+  /* Held while entries are looked up, never while they are loaded */
+  pthread_mutex_t mutex;
+
+  /* Interned realpath => pyg_include_t */
+  pyg_hashmap_t map;
+};
+
+pyg_error_t pyg_includes_init(pyg_includes_t* includes, pyg_cache_t* cache);
+void pyg_includes_destroy(pyg_includes_t* includes);
+
+/*
+ * Merge files listed in `includes` of `obj` and of every object nested in it
+ * into the object that lists them, and remove `includes` keys. Paths are
+ * relative to `dir`. Thread-safe.
+ *
+ * NOTE: Merged values are allocated by the caller (see src/arena.h), and do
+ * not reference the cached trees.
+ */
+pyg_error_t pyg_includes_apply(pyg_includes_t* includes,
+                               const char* dir,
+                               JSON_Object* obj);
+
+#endif  /* SRC_INCLUDE_H_ */
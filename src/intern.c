@@ -0,0 +1,195 @@
+#include "src/intern.h"
+#include "src/arena.h"
+#include "src/common.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Top bits of the hash pick the shard, bottom bits - the slot */
+#define PYG_INTERN_SHARD_BITS 4
+#define PYG_INTERN_SHARD_COUNT (1 << PYG_INTERN_SHARD_BITS)
+
+typedef struct pyg_intern_shard_s pyg_intern_shard_t;
+
+struct pyg_intern_shard_s {
+  pthread_mutex_t mutex;
+
+  /* Open addressing, power of two size */
+  pyg_interned_t** space;
+  unsigned int size;
+  unsigned int count;
+
+  /* Storage of the strings */
+  pyg_arena_t arena;
+};
+
+static const unsigned int kPygInternShardSize = 256;
+
+static pyg_error_t pyg_intern_init(void);
+static void pyg_intern_destroy(void);
+static int pyg_intern_grow(pyg_intern_shard_t* shard);
+
+static pthread_mutex_t pyg_intern_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int pyg_intern_refs;
+static pyg_intern_shard_t pyg_intern_shards[PYG_INTERN_SHARD_COUNT];
+
+
+pyg_error_t pyg_intern_ref(void) {
+  pyg_error_t err;
+
+  err = pyg_ok();
+  pthread_mutex_lock(&pyg_intern_mutex);
+  if (pyg_intern_refs == 0)
+    err = pyg_intern_init();
+  if (pyg_is_ok(err))
+    pyg_intern_refs++;
+  pthread_mutex_unlock(&pyg_intern_mutex);
+
+  return err;
+}
+
+
+void pyg_intern_unref(void) {
+  pthread_mutex_lock(&pyg_intern_mutex);
+  if (--pyg_intern_refs == 0)
+    pyg_intern_destroy();
+  pthread_mutex_unlock(&pyg_intern_mutex);
+}
+
+
+pyg_error_t pyg_intern_init(void) {
+  unsigned int i;
+
+  for (i = 0; i < PYG_INTERN_SHARD_COUNT; i++) {
+    pyg_intern_shard_t* shard;
+
+    shard = &pyg_intern_shards[i];
+    shard->size = kPygInternShardSize;
+    shard->count = 0;
+    shard->space = calloc(shard->size, sizeof(*shard->space));
+    if (shard->space == NULL)
+      goto failed_shard;
+
+    if (pthread_mutex_init(&shard->mutex, NULL) != 0) {
+      free(shard->space);
+      goto failed_shard;
+    }
+
+    pyg_arena_init(&shard->arena);
+  }
+
+  return pyg_ok();
+
+failed_shard:
+  while (i-- > 0) {
+    pyg_intern_shard_t* shard;
+
+    shard = &pyg_intern_shards[i];
+    pthread_mutex_destroy(&shard->mutex);
+    free(shard->space);
+    shard->space = NULL;
+  }
+  return pyg_error_str(kPygErrNoMem, "pyg_intern_shard_t");
+}
+
+
+void pyg_intern_destroy(void) {
+  unsigned int i;
+
+  for (i = 0; i < PYG_INTERN_SHARD_COUNT; i++) {
+    pyg_intern_shard_t* shard;
+
+    shard = &pyg_intern_shards[i];
+    pyg_arena_destroy(&shard->arena);
+    pthread_mutex_destroy(&shard->mutex);
+    free(shard->space);
+    shard->space = NULL;
+  }
+}
+
+
+const char* pyg_intern(const char* str, size_t len) {
+  pyg_intern_shard_t* shard;
+  pyg_interned_t* entry;
+  uint64_t hash;
+  unsigned int mask;
+  unsigned int i;
+
+  hash = pyg_hash(str, len);
+  shard = &pyg_intern_shards[hash >> (64 - PYG_INTERN_SHARD_BITS)];
+
+  pthread_mutex_lock(&shard->mutex);
+
+  mask = shard->size - 1;
+  for (i = hash & mask; shard->space[i] != NULL; i = (i + 1) & mask) {
+    entry = shard->space[i];
+    if (entry->hash == hash &&
+        entry->len == len &&
+        memcmp(entry->str, str, len) == 0) {
+      pthread_mutex_unlock(&shard->mutex);
+      return entry->str;
+    }
+  }
+
+  entry = pyg_arena_alloc(&shard->arena,
+                          offsetof(pyg_interned_t, str) + len + 1);
+  if (entry == NULL)
+    goto failed;
+
+  entry->hash = hash;
+  entry->len = len;
+  memcpy(entry->str, str, len);
+  entry->str[len] = '\0';
+
+  shard->space[i] = entry;
+
+  /* Keep load factor below 1/2 */
+  if (++shard->count * 2 > shard->size && pyg_intern_grow(shard) != 0) {
+    shard->space[i] = NULL;
+    shard->count--;
+    goto failed;
+  }
+
+  pthread_mutex_unlock(&shard->mutex);
+  return entry->str;
+
+failed:
+  pthread_mutex_unlock(&shard->mutex);
+  return NULL;
+}
+
+
+/* NOTE: Should be called with shard mutex held */
+int pyg_intern_grow(pyg_intern_shard_t* shard) {
+  pyg_interned_t** space;
+  unsigned int size;
+  unsigned int mask;
+  unsigned int i;
+
+  size = shard->size * 2;
+  space = calloc(size, sizeof(*space));
+  if (space == NULL)
+    return -1;
+
+  mask = size - 1;
+  for (i = 0; i < shard->size; i++) {
+    pyg_interned_t* entry;
+    unsigned int j;
+
+    entry = shard->space[i];
+    if (entry == NULL)
+      continue;
+
+    for (j = entry->hash & mask; space[j] != NULL; j = (j + 1) & mask) {
+    }
+    space[j] = entry;
+  }
+
+  free(shard->space);
+  shard->space = space;
+  shard->size = size;
+  return 0;
+}
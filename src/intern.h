@@ -0,0 +1,37 @@
+#ifndef SRC_INTERN_H_
+#define SRC_INTERN_H_
+
+#include "src/common.h"
+#include "src/error.h"
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct pyg_interned_s pyg_interned_t;
+
+struct pyg_interned_s {
+  uint64_t hash;
+  unsigned int len;
+  char str[1];
+};
+
+/*
+ * Process-wide, thread-safe pool of immutable strings. Equal strings are
+ * stored once, so interned strings can be compared by pointer and carry
+ * their precomputed `pyg_hash()` and length.
+ *
+ * Pool is created by the first `pyg_intern_ref()` and destroyed, together
+ * with all strings, by the last `pyg_intern_unref()`.
+ */
+pyg_error_t pyg_intern_ref(void);
+void pyg_intern_unref(void);
+
+/* NOTE: Signature matches `JSON_Intern_Function` */
+const char* pyg_intern(const char* str, size_t len);
+
+#define pyg_cintern(s) pyg_intern((s), strlen((s)))
+#define pyg_interned(s) container_of((s), pyg_interned_t, str)
+#define pyg_intern_hash(s) (pyg_interned((s))->hash)
+#define pyg_intern_len(s) (pyg_interned((s))->len)
+
+#endif  /* SRC_INTERN_H_ */
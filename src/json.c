@@ -1,5 +1,6 @@
 #include "src/json.h"
 #include "src/common.h"
+#include "src/intern.h"
 #include "src/unroll.h"
 
 #include "parson.h"
@@ -13,7 +14,8 @@ static pyg_error_t pyg_merge_json_arr(JSON_Value** to,
                                       JSON_Value* from,
                                       pyg_merge_mode_t mode);
 static JSON_Value* pyg_merge_json_exclude(JSON_Array* to, JSON_Array* from);
-static const char* pyg_merge_classify(const char* name, pyg_merge_mode_t* mode);
+static const char* pyg_merge_classify(const char* name,
+                                      pyg_merge_mode_t* mode);
 
 
 pyg_error_t pyg_iter_array(JSON_Array* arr,
@@ -31,15 +33,10 @@ pyg_error_t pyg_iter_array(JSON_Array* arr,
 
     val = get(arr, i);
     if (val == NULL) {
-      static char msg[1024];
-
-      snprintf(msg,
-               sizeof(msg),
-               "Invalid array item during iteration of `%s`[%d]",
-               label,
-               (int) i);
-
-      return pyg_error_str(kPygErrJSON, msg);
+      return pyg_error_str(kPygErrJSON,
+                           "Invalid array item during iteration of `%s`[%d]",
+                           label,
+                           (int) i);
     }
 
     err = cb(val, i, count, arg);
@@ -78,8 +75,8 @@ pyg_error_t pyg_merge_json_inplace(JSON_Value** to,
 }
 
 
+/* NOTE: Object names are interned, so is the result (NULL on OOM) */
 const char* pyg_merge_classify(const char* name, pyg_merge_mode_t* mode) {
-  static char buf[1024];
   int len;
 
   if (*mode == kPygMergeStrict)
@@ -99,9 +96,7 @@ const char* pyg_merge_classify(const char* name, pyg_merge_mode_t* mode) {
     default: *mode = kPygMergeAuto; goto skip;
   }
 
-  /* TODO(indutny): error on overflow */
-  snprintf(buf, sizeof(buf), "%.*s", len - 1, name);
-  return buf;
+  return pyg_intern(name, len - 1);
 
 skip:
   return name;
@@ -122,11 +117,15 @@ pyg_error_t pyg_merge_json_obj(JSON_Object* to,
     JSON_Value* from_value;
     JSON_Value* to_value;
     JSON_Value* new_to_value;
+    const char* to_name;
 
     name = json_object_get_name(from, i);
-    from_value = json_object_get_value(from, name);
+    from_value = json_object_get_value_at(from, i);
 
-    to_value = json_object_get_value(to, pyg_merge_classify(name, &mode));
+    to_name = pyg_merge_classify(name, &mode);
+    if (to_name == NULL)
+      return pyg_error_str(kPygErrNoMem, "Failed to merge JSON (%s)", name);
+    to_value = json_object_get_interned_value(to, to_name);
 
     /* New property */
     if (to_value == NULL) {
@@ -134,9 +133,7 @@ pyg_error_t pyg_merge_json_obj(JSON_Object* to,
       if (!pyg_is_ok(err))
         return err;
 
-      st = json_object_set_value(to,
-                                 pyg_merge_classify(name, &mode),
-                                 from_value);
+      st = json_object_set_interned_value(to, to_name, from_value);
       if (st != JSONSuccess) {
         json_value_free(from_value);
         return pyg_error_str(kPygErrNoMem, "Failed to merge JSON (%s)", name);
@@ -153,7 +150,7 @@ pyg_error_t pyg_merge_json_obj(JSON_Object* to,
     if (new_to_value == to_value)
       continue;
 
-    st = json_object_set_value(to, name, to_value);
+    st = json_object_set_interned_value(to, to_name, new_to_value);
     if (st != JSONSuccess)
       return pyg_error_str(kPygErrNoMem, "Failed to merge JSON (%s)", name);
   }
@@ -329,43 +326,69 @@ pyg_error_t pyg_merge_json(JSON_Value* to,
 }
 
 
-pyg_error_t pyg_unroll_json(pyg_proto_hashmap_t* vars, JSON_Value** out) {
+pyg_error_t pyg_unroll_json(pyg_scope_t* vars, JSON_Value** out) {
   pyg_error_t err;
   JSON_Value* value;
 
   value = *out;
   if (json_value_get_type(value) == JSONString) {
     const char* str;
-    char* estr;
+    const char* estr;
 
     str = json_string(value);
-    err = pyg_unroll_str(vars, str, &estr);
+    err = pyg_unroll_istr(vars, str, &estr);
     if (!pyg_is_ok(err))
       return err;
 
-    *out = json_value_init_string(estr);
-    free(estr);
+    /* Interned strings outlive the tree */
+    *out = json_value_init_string_in_place(estr);
 
     if (*out == NULL)
       return pyg_error_str(kPygErrNoMem, "failed to alloc string");
-  } else if (json_value_get_type(value) == JSONString) {
+  } else if (json_value_get_type(value) == JSONArray) {
     size_t i;
-    size_t count;
     JSON_Array* arr;
 
     arr = json_value_get_array(value);
-    count = json_array_get_count(arr);
-    for (i = 0; i < count; i++) {
+    i = 0;
+    while (i < json_array_get_count(arr)) {
       JSON_Value* sub;
       JSON_Value* new_sub;
+      const char* str;
+      pyg_list_t* list;
 
       sub = json_array_get_value(arr, i);
-      new_sub = sub;
-      pyg_unroll_json(vars, &new_sub);
-      if (sub == new_sub)
-        continue;
 
-      json_array_replace_value(arr, i, new_sub);
+      /* `<@(list)` - items are spliced into the array as they are */
+      str = json_value_get_string(sub);
+      if (str != NULL) {
+        err = pyg_unroll_list(vars, str, &list);
+        if (!pyg_is_ok(err))
+          return err;
+
+        if (list != NULL) {
+          if (json_array_splice_strings_in_place(arr,
+                                                 i,
+                                                 list->items,
+                                                 list->count) !=
+                  JSONSuccess) {
+            return pyg_error_str(kPygErrNoMem, "failed to splice list");
+          }
+          i += list->count;
+          continue;
+        }
+      }
+
+      new_sub = sub;
+      err = pyg_unroll_json(vars, &new_sub);
+      if (!pyg_is_ok(err))
+        return err;
+      if (sub != new_sub &&
+          json_array_replace_value(arr, i, new_sub) != JSONSuccess) {
+        json_value_free(new_sub);
+        return pyg_error_str(kPygErrNoMem, "failed to replace value");
+      }
+      i++;
     }
   }
 
@@ -373,7 +396,7 @@ pyg_error_t pyg_unroll_json(pyg_proto_hashmap_t* vars, JSON_Value** out) {
 }
 
 
-pyg_error_t pyg_unroll_json_key(pyg_proto_hashmap_t* vars,
+pyg_error_t pyg_unroll_json_key(pyg_scope_t* vars,
                                 JSON_Object* json,
                                 const char* key) {
   pyg_error_t err;
@@ -416,7 +439,7 @@ pyg_error_t pyg_stringify_json(JSON_Value* value, char** out) {
 
         arr = json_value_get_array(value);
         count = json_array_get_count(arr);
-        size = count == 0 ? 0 : (count - 1) * 2;
+        size = count == 0 ? 0 : count - 1;
         for (i = 0; i < count; i++) {
           const char* str;
 
@@ -439,12 +462,9 @@ pyg_error_t pyg_stringify_json(JSON_Value* value, char** out) {
           if (str == NULL)
             continue;
 
-          /* Separator */
-          if (i != 0) {
-            p[0] = ',';
-            p[1] = ' ';
-            p += 2;
-          }
+          /* Separator, arrays are command line arguments */
+          if (i != 0)
+            *p++ = ' ';
 
           /* Value */
           len = strlen(str);
@@ -454,6 +474,7 @@ pyg_error_t pyg_stringify_json(JSON_Value* value, char** out) {
 
         *p = '\0';
       }
+      break;
     default:
       /* TODO(indutny): support objects and numbers */
       UNREACHABLE();
@@ -2,6 +2,7 @@
 #define SRC_JSON_H_
 
 #include "src/common.h"
+#include "src/scope.h"
 
 #include "parson.h"
 
@@ -31,8 +32,8 @@ pyg_error_t pyg_clone_json(JSON_Value* value,
                            pyg_merge_mode_t mode,
                            JSON_Value** out);
 
-pyg_error_t pyg_unroll_json(pyg_proto_hashmap_t* vars, JSON_Value** out);
-pyg_error_t pyg_unroll_json_key(pyg_proto_hashmap_t* vars,
+pyg_error_t pyg_unroll_json(pyg_scope_t* vars, JSON_Value** out);
+pyg_error_t pyg_unroll_json_key(pyg_scope_t* vars,
                                 JSON_Object* obj,
                                 const char* key);
 pyg_error_t pyg_stringify_json(JSON_Value* value, char** out);
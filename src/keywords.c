@@ -0,0 +1,104 @@
+/* Generated by tools/keywords.c from src/keywords.list */
+#include "src/keywords.h"
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct pyg_keyword_slot_s pyg_keyword_slot_t;
+
+struct pyg_keyword_slot_s {
+  const char* str;
+  unsigned int len;
+  pyg_keyword_t keyword;
+};
+
+static const uint32_t kPygKeywordSeed = 1674U;
+static const unsigned int kPygKeywordMaxLen = 14;
+
+static const pyg_keyword_slot_t kPygKeywordTable[64] = {
+  { "<", 1, kPygKwOpLT },
+  { "!=", 2, kPygKwOpNotEq },
+  { "static_library", 14, kPygKwTypeStatic },
+  { "or", 2, kPygKwOpOrWord },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "m", 1, kPygKwExtM },
+  { "dll", 3, kPygKwExtDLL },
+  { "", 0, kPygKwUnknown },
+  { "<=", 2, kPygKwOpLTE },
+  { "not", 3, kPygKwOpNot },
+  { "none", 4, kPygKwTypeNone },
+  { "", 0, kPygKwUnknown },
+  { "dylib", 5, kPygKwExtDylib },
+  { "cxx", 3, kPygKwExtCXX },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "and", 3, kPygKwOpAndWord },
+  { "so", 2, kPygKwExtSO },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "cpp", 3, kPygKwExtCPP },
+  { "||", 2, kPygKwOpOr },
+  { "include_dirs", 12, kPygKwKeyIncludeDirs },
+  { "dependencies", 12, kPygKwKeyDependencies },
+  { "", 0, kPygKwUnknown },
+  { "shared_library", 14, kPygKwTypeShared },
+  { "", 0, kPygKwUnknown },
+  { "S", 1, kPygKwExtAsmPP },
+  { "cc", 2, kPygKwExtCC },
+  { "", 0, kPygKwUnknown },
+  { "executable", 10, kPygKwTypeExecutable },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "sources", 7, kPygKwKeySources },
+  { "", 0, kPygKwUnknown },
+  { "==", 2, kPygKwOpEq },
+  { "", 0, kPygKwUnknown },
+  { "c", 1, kPygKwExtC },
+  { ">=", 2, kPygKwOpGTE },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "", 0, kPygKwUnknown },
+  { "o", 1, kPygKwExtO },
+  { ">", 1, kPygKwOpGT },
+  { "", 0, kPygKwUnknown },
+  { "mm", 2, kPygKwExtMM },
+  { "s", 1, kPygKwExtAsm },
+  { "&&", 2, kPygKwOpAnd },
+  { "in", 2, kPygKwOpIn },
+};
+
+
+pyg_keyword_t pyg_keyword(const char* str, unsigned int len) {
+  const pyg_keyword_slot_t* slot;
+  uint32_t h;
+  unsigned int i;
+
+  if (len > kPygKeywordMaxLen)
+    return kPygKwUnknown;
+
+  h = kPygKeywordSeed ^ len;
+  for (i = 0; i < len; i++)
+    h = (h ^ (uint8_t) str[i]) * 0x01000193;
+  h ^= h >> 15;
+
+  slot = &kPygKeywordTable[h & 63U];
+  if (slot->len != len || memcmp(slot->str, str, len) != 0)
+    return kPygKwUnknown;
+
+  return slot->keyword;
+}
@@ -0,0 +1,50 @@
+/* Generated by tools/keywords.c from src/keywords.list */
+#ifndef SRC_KEYWORDS_H_
+#define SRC_KEYWORDS_H_
+
+#include <string.h>
+
+enum pyg_keyword_e {
+  kPygKwUnknown,
+  kPygKwKeySources,
+  kPygKwKeyIncludeDirs,
+  kPygKwKeyDependencies,
+  kPygKwTypeNone,
+  kPygKwTypeExecutable,
+  kPygKwTypeStatic,
+  kPygKwTypeShared,
+  kPygKwExtC,
+  kPygKwExtCC,
+  kPygKwExtCPP,
+  kPygKwExtCXX,
+  kPygKwExtM,
+  kPygKwExtMM,
+  kPygKwExtAsmPP,
+  kPygKwExtAsm,
+  kPygKwExtO,
+  kPygKwExtSO,
+  kPygKwExtDylib,
+  kPygKwExtDLL,
+  kPygKwOpEq,
+  kPygKwOpNotEq,
+  kPygKwOpLT,
+  kPygKwOpGT,
+  kPygKwOpLTE,
+  kPygKwOpGTE,
+  kPygKwOpAnd,
+  kPygKwOpAndWord,
+  kPygKwOpOr,
+  kPygKwOpOrWord,
+  kPygKwOpNot,
+  kPygKwOpIn,
+
+  kPygKwCount
+};
+typedef enum pyg_keyword_e pyg_keyword_t;
+
+/* `kPygKwUnknown` if `str` is not a keyword */
+pyg_keyword_t pyg_keyword(const char* str, unsigned int len);
+
+#define pyg_ckeyword(s) pyg_keyword((s), strlen((s)))
+
+#endif  /* SRC_KEYWORDS_H_ */
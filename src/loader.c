@@ -0,0 +1,278 @@
+#include "src/loader.h"
+#include "src/common.h"
+#include "src/queue.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const unsigned int kPygLoaderJobCount = 64;
+
+static void* pyg_loader_worker(void* arg);
+static pyg_loader_job_t* pyg_loader_find(pyg_loader_t* loader,
+                                         const char* path,
+                                         int enqueue);
+static void pyg_loader_run(pyg_loader_t* loader, pyg_loader_job_t* job);
+static pyg_error_t pyg_loader_free_job(pyg_hashmap_item_t* item, void* arg);
+
+
+pyg_error_t pyg_loader_init(pyg_loader_t* loader,
+                            unsigned int jobs,
+                            pyg_loader_load_cb load_cb,
+                            pyg_loader_free_cb free_cb) {
+  pyg_error_t err;
+  unsigned int i;
+
+  loader->jobs = jobs;
+  loader->threads = NULL;
+  loader->closing = 0;
+  loader->load_cb = load_cb;
+  loader->free_cb = free_cb;
+  loader->data = NULL;
+  QUEUE_INIT(&loader->pending);
+
+  err = pyg_hashmap_init_owned(&loader->map, kPygLoaderJobCount);
+  if (!pyg_is_ok(err))
+    return err;
+
+  if (pthread_mutex_init(&loader->mutex, NULL) != 0) {
+    err = pyg_error_str(kPygErrNoMem, "pthread_mutex_init()");
+    goto failed_mutex_init;
+  }
+  if (pthread_cond_init(&loader->pending_cond, NULL) != 0) {
+    err = pyg_error_str(kPygErrNoMem, "pthread_cond_init()");
+    goto failed_pending_init;
+  }
+  if (pthread_cond_init(&loader->done_cond, NULL) != 0) {
+    err = pyg_error_str(kPygErrNoMem, "pthread_cond_init()");
+    goto failed_done_init;
+  }
+
+  if (!pyg_loader_is_parallel(loader))
+    return pyg_ok();
+
+  loader->threads = calloc(jobs, sizeof(*loader->threads));
+  if (loader->threads == NULL) {
+    err = pyg_error_str(kPygErrNoMem, "pyg_loader_t.threads");
+    goto failed_threads_alloc;
+  }
+
+  for (i = 0; i < jobs; i++) {
+    if (pthread_create(&loader->threads[i],
+                       NULL,
+                       pyg_loader_worker,
+                       loader) != 0) {
+      break;
+    }
+  }
+
+  /* Could not start any thread - fallback to on-demand loading */
+  loader->jobs = i;
+  if (i == 0) {
+    free(loader->threads);
+    loader->threads = NULL;
+  }
+
+  return pyg_ok();
+
+failed_threads_alloc:
+  pthread_cond_destroy(&loader->done_cond);
+
+failed_done_init:
+  pthread_cond_destroy(&loader->pending_cond);
+
+failed_pending_init:
+  pthread_mutex_destroy(&loader->mutex);
+
+failed_mutex_init:
+  pyg_hashmap_destroy(&loader->map);
+  return err;
+}
+
+
+void pyg_loader_destroy(pyg_loader_t* loader) {
+  unsigned int i;
+
+  pthread_mutex_lock(&loader->mutex);
+  loader->closing = 1;
+  pthread_cond_broadcast(&loader->pending_cond);
+  pthread_mutex_unlock(&loader->mutex);
+
+  if (loader->threads != NULL) {
+    for (i = 0; i < loader->jobs; i++)
+      pthread_join(loader->threads[i], NULL);
+    free(loader->threads);
+    loader->threads = NULL;
+  }
+
+  pyg_hashmap_iterate(&loader->map, pyg_loader_free_job, loader);
+  pyg_hashmap_destroy(&loader->map);
+
+  pthread_cond_destroy(&loader->done_cond);
+  pthread_cond_destroy(&loader->pending_cond);
+  pthread_mutex_destroy(&loader->mutex);
+}
+
+
+pyg_error_t pyg_loader_free_job(pyg_hashmap_item_t* item, void* arg) {
+  pyg_loader_t* loader;
+  pyg_loader_job_t* job;
+
+  loader = arg;
+  job = item->value;
+
+  /* Prefetched, but never reached by the caller */
+  if (!job->claimed && job->res != NULL)
+    loader->free_cb(job->res);
+
+  free(job);
+
+  return pyg_ok();
+}
+
+
+pyg_loader_job_t* pyg_loader_find(pyg_loader_t* loader,
+                                  const char* path,
+                                  int enqueue) {
+  pyg_loader_job_t* job;
+
+  job = pyg_hashmap_cget(&loader->map, path);
+  if (job != NULL)
+    return job;
+
+  job = calloc(1, sizeof(*job));
+  if (job == NULL)
+    return NULL;
+
+  job->state = kPygLoaderJobPending;
+  job->code = kPygOk;
+  QUEUE_INIT(&job->member);
+
+  if (!pyg_is_ok(pyg_hashmap_cinsert(&loader->map, path, job))) {
+    free(job);
+    return NULL;
+  }
+  job->path = pyg_hashmap_cget_key(&loader->map, path);
+
+  if (enqueue) {
+    QUEUE_INSERT_TAIL(&loader->pending, &job->member);
+    pthread_cond_signal(&loader->pending_cond);
+  }
+
+  return job;
+}
+
+
+pyg_error_t pyg_loader_submit(pyg_loader_t* loader, const char* path) {
+  pyg_loader_job_t* job;
+  int closing;
+
+  /* Nobody to pick it up, `pyg_loader_get` will load it */
+  if (!pyg_loader_is_parallel(loader))
+    return pyg_ok();
+
+  pthread_mutex_lock(&loader->mutex);
+  closing = loader->closing;
+  job = NULL;
+  if (!closing)
+    job = pyg_loader_find(loader, path, 1);
+  pthread_mutex_unlock(&loader->mutex);
+
+  if (job == NULL && !closing)
+    return pyg_error_str(kPygErrNoMem, "pyg_loader_job_t");
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_loader_get(pyg_loader_t* loader,
+                           const char* path,
+                           void** out) {
+  pyg_loader_job_t* job;
+  pyg_error_t err;
+
+  pthread_mutex_lock(&loader->mutex);
+
+  job = pyg_loader_find(loader, path, 0);
+  if (job == NULL) {
+    pthread_mutex_unlock(&loader->mutex);
+    return pyg_error_str(kPygErrNoMem, "pyg_loader_job_t");
+  }
+
+  /* Nobody has started it yet - do it ourselves instead of waiting */
+  if (job->state == kPygLoaderJobPending) {
+    QUEUE_REMOVE(&job->member);
+    pyg_loader_run(loader, job);
+  }
+
+  while (job->state != kPygLoaderJobDone)
+    pthread_cond_wait(&loader->done_cond, &loader->mutex);
+
+  if (job->code != kPygOk) {
+    err = pyg_error_str(job->code, "%s", job->msg);
+  } else if (job->claimed) {
+    err = pyg_error_str(kPygErrGYP, "File loaded twice: %s", path);
+  } else {
+    job->claimed = 1;
+    *out = job->res;
+    err = pyg_ok();
+  }
+
+  pthread_mutex_unlock(&loader->mutex);
+  return err;
+}
+
+
+/* NOTE: Should be called with mutex held */
+void pyg_loader_run(pyg_loader_t* loader, pyg_loader_job_t* job) {
+  pyg_error_t err;
+  void* res;
+
+  job->state = kPygLoaderJobRunning;
+  pthread_mutex_unlock(&loader->mutex);
+
+  res = NULL;
+  err = loader->load_cb(loader, job->path, &res);
+
+  pthread_mutex_lock(&loader->mutex);
+  job->state = kPygLoaderJobDone;
+  job->code = err.code;
+  if (pyg_is_ok(err)) {
+    job->res = res;
+  } else {
+    /* Error string is thread-local, copy it out */
+    snprintf(job->msg,
+             sizeof(job->msg),
+             "%s",
+             err.str == NULL ? "" : err.str);
+  }
+  pthread_cond_broadcast(&loader->done_cond);
+}
+
+
+void* pyg_loader_worker(void* arg) {
+  pyg_loader_t* loader;
+
+  loader = arg;
+
+  pthread_mutex_lock(&loader->mutex);
+  for (;;) {
+    QUEUE* q;
+    pyg_loader_job_t* job;
+
+    while (QUEUE_EMPTY(&loader->pending) && !loader->closing)
+      pthread_cond_wait(&loader->pending_cond, &loader->mutex);
+    if (loader->closing)
+      break;
+
+    q = QUEUE_HEAD(&loader->pending);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);
+
+    job = container_of(q, pyg_loader_job_t, member);
+    pyg_loader_run(loader, job);
+  }
+  pthread_mutex_unlock(&loader->mutex);
+
+  return NULL;
+}
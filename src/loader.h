@@ -0,0 +1,73 @@
+#ifndef SRC_LOADER_H_
+#define SRC_LOADER_H_
+
+#include "src/common.h"
+#include "src/error.h"
+#include "src/queue.h"
+
+#include <pthread.h>
+
+typedef struct pyg_loader_s pyg_loader_t;
+typedef struct pyg_loader_job_s pyg_loader_job_t;
+typedef pyg_error_t (*pyg_loader_load_cb)(pyg_loader_t* loader,
+                                          const char* path,
+                                          void** out);
+typedef void (*pyg_loader_free_cb)(void* res);
+
+enum pyg_loader_job_state_e {
+  kPygLoaderJobPending,
+  kPygLoaderJobRunning,
+  kPygLoaderJobDone
+};
+typedef enum pyg_loader_job_state_e pyg_loader_job_state_t;
+
+struct pyg_loader_job_s {
+  /* Owned by `pyg_loader_t.map` */
+  const char* path;
+  pyg_loader_job_state_t state;
+
+  /* Result, owned by job until claimed by `pyg_loader_get` */
+  void* res;
+  int claimed;
+  pyg_error_code_t code;
+  char msg[1024];
+
+  QUEUE member;
+};
+
+struct pyg_loader_s {
+  unsigned int jobs;
+  pthread_t* threads;
+  int closing;
+
+  pyg_loader_load_cb load_cb;
+  pyg_loader_free_cb free_cb;
+
+  /* Opaque, for use by `load_cb` */
+  void* data;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t pending_cond;
+  pthread_cond_t done_cond;
+
+  /* realpath => pyg_loader_job_t, every path is loaded only once */
+  pyg_hashmap_t map;
+  QUEUE pending;
+};
+
+/* `jobs` <= 1 - no threads, everything is loaded on demand in `get` */
+pyg_error_t pyg_loader_init(pyg_loader_t* loader,
+                            unsigned int jobs,
+                            pyg_loader_load_cb load_cb,
+                            pyg_loader_free_cb free_cb);
+void pyg_loader_destroy(pyg_loader_t* loader);
+
+/* Schedule loading of `path` in background, no-op if already seen */
+pyg_error_t pyg_loader_submit(pyg_loader_t* loader, const char* path);
+
+/* Wait for (or perform) the load of `path` and claim the result */
+pyg_error_t pyg_loader_get(pyg_loader_t* loader, const char* path, void** out);
+
+#define pyg_loader_is_parallel(l) ((l)->jobs > 1)
+
+#endif  /* SRC_LOADER_H_ */
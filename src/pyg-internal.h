@@ -2,7 +2,7 @@
 #define SRC_PYG_INTERNAL_H_
 
 pyg_error_t pyg_add_var(pyg_t* pyg,
-                        pyg_proto_hashmap_t* vars,
+                        pyg_scope_t* vars,
                         const char* key,
                         pyg_value_t* value);
 
@@ -1,10 +1,18 @@
 #include "src/pyg.h"
 #include "src/pyg-internal.h"
+#include "src/cache.h"
+#include "src/command.h"
 #include "src/common.h"
 #include "src/eval.h"
+#include "src/exists.h"
 #include "src/generator/base.h"
+#include "src/include.h"
+#include "src/intern.h"
 #include "src/json.h"
+#include "src/keywords.h"
+#include "src/loader.h"
 #include "src/queue.h"
+#include "src/scope.h"
 #include "src/unroll.h"
 
 #include "parson.h"
@@ -15,25 +23,47 @@
 
 static const unsigned kPygChildrenCount = 16;
 static const unsigned kPygTargetCount = 16;
-static const unsigned kPygVarCount = 16;
+static const unsigned kPygCommandJobs = 8;
+
+typedef struct pyg_load_s pyg_load_t;
+
+/* Passed to `pyg_prepare` as `loader->data` */
+struct pyg_load_s {
+  pyg_cache_t* cache;
+  pyg_includes_t* includes;
+  pyg_commands_t* commands;
+  int lazy;
+};
 
 
 static pyg_error_t pyg_new_child(const char* path, pyg_t* parent, pyg_t** out);
+static pyg_error_t pyg_prepare(pyg_loader_t* loader,
+                               const char* path,
+                               void** out);
+static void pyg_release(void* pyg);
+static pyg_error_t pyg_attach(pyg_t* pyg, pyg_t* parent);
 static pyg_error_t pyg_free_child(pyg_hashmap_item_t* item, void* arg);
 static pyg_error_t pyg_free_target(pyg_hashmap_item_t* item, void* arg);
-static pyg_error_t pyg_free_var(pyg_hashmap_item_t* item, void* arg);
+static pyg_error_t pyg_add_stats(pyg_hashmap_item_t* item, void* arg);
 static pyg_error_t pyg_load(pyg_t* pyg);
+static pyg_error_t pyg_load_target_defaults(pyg_t* pyg);
 static pyg_error_t pyg_load_variables(pyg_t* pyg,
                                       JSON_Object* json,
-                                      pyg_proto_hashmap_t* out);
+                                      pyg_scope_t* out);
 static pyg_error_t pyg_eval_conditions(pyg_t* pyg,
                                        JSON_Object* json,
-                                       pyg_proto_hashmap_t* vars);
+                                       pyg_scope_t* vars);
 static pyg_error_t pyg_load_targets(pyg_t* pyg);
+static pyg_error_t pyg_prefetch(pyg_loader_t* loader, pyg_t* pyg);
+static pyg_error_t pyg_prefetch_target(pyg_loader_t* loader,
+                                       pyg_target_t* target);
+static pyg_error_t pyg_link(pyg_t* pyg);
+static pyg_error_t pyg_link_target(pyg_target_t* target);
 static pyg_error_t pyg_load_target(void* val,
                                    size_t i,
                                    size_t count,
                                    void* arg);
+static pyg_error_t pyg_materialize_target(pyg_target_t* target);
 static pyg_error_t pyg_load_target_deps(pyg_target_t* target);
 static pyg_error_t pyg_load_target_dep(void* val,
                                        size_t i,
@@ -42,103 +72,154 @@ static pyg_error_t pyg_load_target_dep(void* val,
 static pyg_error_t pyg_resolve_json(pyg_target_t* pyg,
                                     JSON_Object* json,
                                     const char* key);
+static pyg_error_t pyg_resolve_list(pyg_target_t* target,
+                                    pyg_list_t* list,
+                                    const char** paths);
 static pyg_error_t pyg_target_type_from_str(const char* type,
                                             pyg_target_type_t* out);
 static pyg_error_t pyg_create_sources(pyg_target_t* target);
+static pyg_error_t pyg_validate_paths(pyg_t* pyg, unsigned int jobs);
+static pyg_error_t pyg_validate_add(const char*** paths,
+                                    unsigned int* count,
+                                    unsigned int* size,
+                                    const char* path);
+static int pyg_validate_compare(const void* a, const void* b);
+static int pyg_validate_compare_str(const void* a, const void* b);
 
 
+/* NOTE: `path` comes from `pyg_path_resolve()` */
 pyg_error_t pyg_new_child(const char* path, pyg_t* parent, pyg_t** out) {
   pyg_error_t err;
   pyg_t* res;
-  char* rpath;
-  JSON_Value* clone;
-
-  rpath = pyg_realpath(path);
-  if (rpath == NULL)
-    return pyg_error_str(kPygErrFS, "pyg_realpath(%s)", path);
+  pyg_t* existing;
 
   /* Try looking up the path */
-  if (parent != NULL) {
-    pyg_t* existing;
+  existing = pyg_hashmap_iget(&parent->root->children.map, path);
 
-    existing = pyg_hashmap_cget(&parent->root->children.map, rpath);
+  /* Child found! */
+  if (existing != NULL) {
+    *out = existing;
+    return pyg_ok();
+  }
 
-    /* Child found! */
-    if (existing != NULL) {
-      *out = existing;
-      return pyg_ok();
-    }
+  /* Either prefetched by loader threads, or loaded right here */
+  err = pyg_loader_get(parent->root->loader, path, (void**) &res);
+  if (!pyg_is_ok(err))
+    return err;
+
+  err = pyg_attach(res, parent);
+  if (!pyg_is_ok(err)) {
+    pyg_free(res);
+    return err;
   }
 
-  res = calloc(1, sizeof(*res));
-  if (res == NULL) {
-    err = pyg_error_str(kPygErrNoMem, "pyg_t");
-    goto failed_calloc;
+  /* NOTE: `res` is owned by root from this point */
+  if (!res->lazy) {
+    err = pyg_link(res);
+    if (!pyg_is_ok(err))
+      return err;
   }
 
-  res->id = 0;
-  res->child_count = 0;
-  res->parent = parent;
-  res->root = res->parent == NULL ? res : res->parent->root;
+  *out = res;
+  return pyg_ok();
+}
 
-  if (parent != NULL)
-    res->id = ++parent->child_count;
 
-  res->json = json_parse_file_with_comments(path);
-  if (res->json == NULL) {
-    err = pyg_error_str(kPygErrJSON, "Failed to parse JSON in file: %s", path);
-    goto failed_parse_file;
-  }
+pyg_error_t pyg_prepare(pyg_loader_t* loader, const char* path, void** out) {
+  pyg_error_t err;
+  pyg_load_t* load;
+  pyg_t* res;
+  pyg_arena_t* prev;
+  pyg_arena_t parse_arena;
+  JSON_Value* json;
 
-  err = pyg_clone_json(res->json, kPygMergeAuto, &clone);
-  if (!pyg_is_ok(err))
-    goto failed_clone_json;
-  res->clone = clone;
+  load = loader->data;
+  res = calloc(1, sizeof(*res));
+  if (res == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_t");
+  res->lazy = load->lazy;
 
-  res->obj = json_object(res->clone);
-  if (res->obj == NULL) {
-    err = pyg_error_str(kPygErrJSON, "JSON not object: %s", path);
-    goto failed_to_object;
+  /* All JSON of the file is allocated from its arena, names are interned */
+  pyg_arena_init(&res->arena);
+  prev = pyg_arena_enter(&res->arena);
+  json_set_intern_function(pyg_intern);
+
+  /* Not attached to any tree yet */
+  res->id = 0;
+  res->child_count = 0;
+  res->parent = NULL;
+  res->root = NULL;
+  QUEUE_INIT(&res->member);
+
+  res->path = pyg_cintern(path);
+  if (res->path == NULL) {
+    err = pyg_error_str(kPygErrNoMem, "pyg_t.path");
+    goto failed_intern;
   }
 
-  res->path = rpath;
   res->dir = pyg_dirname(res->path);
   if (res->dir == NULL) {
     err = pyg_error_str(kPygErrFS, "pyg_dirname(%s)", res->path);
-    goto failed_to_object;
+    goto failed_dirname;
   }
 
-  QUEUE_INIT(&res->member);
-
-  if (res->parent == NULL) {
-    QUEUE_INIT(&res->children.list);
-
-    err = pyg_hashmap_init(&res->children.map, kPygChildrenCount);
-    if (!pyg_is_ok(err))
-      goto failed_children_init;
+  /* Parsed tree (and the file buffer) is dropped as soon as it is cloned */
+  pyg_arena_init(&parse_arena);
+  pyg_arena_enter(&parse_arena);
+  err = pyg_cache_parse_file(load->cache, path, &json);
+  if (pyg_is_ok(err)) {
+    pyg_arena_enter(&res->arena);
+    err = pyg_clone_json(json, kPygMergeAuto, &res->clone);
+    pyg_arena_enter(&parse_arena);
+    json_value_free(json);
   }
+  pyg_arena_enter(&res->arena);
+  pyg_arena_destroy(&parse_arena);
+  if (!pyg_is_ok(err))
+    goto failed_parse_file;
 
-  /* For easier iteration - push self to the list anyway */
-  QUEUE_INSERT_TAIL(&res->root->children.list, &res->member);
+  res->obj = json_object(res->clone);
+  if (res->obj == NULL) {
+    err = pyg_error_str(kPygErrJSON, "JSON not object: %s", path);
+    goto failed_to_object;
+  }
 
-  err = pyg_hashmap_cinsert(&res->root->children.map, res->path, res);
+  err = pyg_includes_apply(load->includes, res->dir, res->obj);
   if (!pyg_is_ok(err))
-    goto failed_children_insert;
+    goto failed_to_object;
 
   err = pyg_hashmap_init(&res->target.map, kPygTargetCount);
   if (!pyg_is_ok(err))
-    goto failed_target_init;
+    goto failed_to_object;
 
   QUEUE_INIT(&res->target.list);
 
-  err = pyg_hashmap_init(&res->vars.map, kPygVarCount);
+  err = pyg_scope_init(&res->vars, NULL);
   if (!pyg_is_ok(err))
     goto failed_vars_init;
-  res->vars.parent = NULL;
 
+  /* Shared by all scopes of the file */
+  err = pyg_unroll_cache_init(&res->templates);
+  if (!pyg_is_ok(err))
+    goto failed_templates_init;
+  res->vars.templates = &res->templates;
+  res->templates.commands = load->commands;
+  res->templates.dir = res->dir;
+
+  /* Start commands early, they are likely to be slower than the rest */
+  err = pyg_unroll_prefetch(&res->templates, res->clone);
+  if (!pyg_is_ok(err)) {
+    pyg_unroll_cache_destroy(&res->templates);
+    goto failed_templates_init;
+  }
+
+  /* Lazy trees prefetch dependencies of each target once it is reached */
   err = pyg_load(res);
+  if (pyg_is_ok(err) && !res->lazy)
+    err = pyg_prefetch(loader, res);
+  json_set_intern_function(NULL);
+  pyg_arena_enter(prev);
   if (!pyg_is_ok(err)) {
-    pyg_hashmap_cdelete(&res->root->children.map, res->path);
     pyg_free(res);
     return err;
   }
@@ -146,39 +227,194 @@ pyg_error_t pyg_new_child(const char* path, pyg_t* parent, pyg_t** out) {
   *out = res;
   return pyg_ok();
 
+failed_templates_init:
+  pyg_scope_destroy(&res->vars);
+
 failed_vars_init:
   pyg_hashmap_destroy(&res->target.map);
 
-failed_target_init:
-  pyg_hashmap_cdelete(&res->root->children.map, res->path);
-
-failed_children_insert:
-  if (res->parent == NULL)
-    pyg_hashmap_destroy(&res->children.map);
-
-failed_children_init:
-  free(res->dir);
-  res->dir = NULL;
-
-failed_clone_json:
-  json_value_free(res->json);
-  res->json = NULL;
-
 failed_to_object:
   json_value_free(res->clone);
   res->clone = NULL;
 
 failed_parse_file:
-  free(res);
+  free(res->dir);
+  res->dir = NULL;
+
+failed_dirname:
+  res->path = NULL;
 
-failed_calloc:
-  free(rpath);
+failed_intern:
+  json_set_intern_function(NULL);
+  pyg_arena_enter(prev);
+  pyg_arena_destroy(&res->arena);
+  free(res);
   return err;
 }
 
 
-pyg_error_t pyg_new(const char* path, pyg_t** out) {
-  return pyg_new_child(path, NULL, out);
+void pyg_release(void* pyg) {
+  pyg_free(pyg);
+}
+
+
+pyg_error_t pyg_attach(pyg_t* pyg, pyg_t* parent) {
+  pyg_error_t err;
+
+  pyg->parent = parent;
+  pyg->root = parent == NULL ? pyg : parent->root;
+
+  if (parent != NULL)
+    pyg->id = ++parent->child_count;
+
+  if (pyg->root == pyg) {
+    QUEUE_INIT(&pyg->children.list);
+
+    err = pyg_hashmap_init(&pyg->children.map, kPygChildrenCount);
+    if (!pyg_is_ok(err)) {
+      pyg->root = NULL;
+      return err;
+    }
+  }
+
+  err = pyg_hashmap_iinsert(&pyg->root->children.map, pyg->path, pyg);
+  if (!pyg_is_ok(err)) {
+    if (pyg->root == pyg)
+      pyg_hashmap_destroy(&pyg->children.map);
+    pyg->root = NULL;
+    return err;
+  }
+
+  /* For easier iteration - push self to the list anyway */
+  QUEUE_INSERT_TAIL(&pyg->root->children.list, &pyg->member);
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_new(const char* path, pyg_options_t* options, pyg_t** out) {
+  pyg_error_t err;
+  pyg_loader_t loader;
+  pyg_cache_t cache;
+  pyg_includes_t includes;
+  pyg_commands_t commands;
+  pyg_load_t load;
+  pyg_t* res;
+  pyg_target_t* root;
+  const char* rpath;
+
+  /* Released by `pyg_free()` of the root */
+  err = pyg_intern_ref();
+  if (!pyg_is_ok(err))
+    return err;
+
+  /* Released by `pyg_free()` of the root, conditions run on translate too */
+  err = pyg_eval_ref();
+  if (!pyg_is_ok(err))
+    goto failed_eval_ref;
+
+  /* Directory realpaths are needed only while loading */
+  err = pyg_path_ref();
+  if (!pyg_is_ok(err))
+    goto failed_path_ref;
+
+  err = pyg_path_resolve(".", path, strlen(path), 1, &rpath);
+  if (!pyg_is_ok(err))
+    goto failed_cache_init;
+
+  load.cache = NULL;
+  load.lazy = options->root_target != NULL;
+  if (options->parse_cache != NULL) {
+    err = pyg_cache_init(&cache, options->parse_cache);
+    if (!pyg_is_ok(err))
+      goto failed_cache_init;
+    load.cache = &cache;
+  }
+
+  /* Merged trees are copied, so included files are not needed after load */
+  err = pyg_includes_init(&includes, load.cache);
+  if (!pyg_is_ok(err))
+    goto failed_includes_init;
+  load.includes = &includes;
+
+  /* Commands wait on children, not on CPU - run them in parallel anyway */
+  err = pyg_commands_init(&commands,
+                          options->jobs > 1 ? options->jobs : kPygCommandJobs,
+                          options->command_cache ? load.cache : NULL);
+  if (!pyg_is_ok(err))
+    goto failed_commands_init;
+  load.commands = &commands;
+
+  err = pyg_loader_init(&loader, options->jobs, pyg_prepare, pyg_release);
+  if (!pyg_is_ok(err))
+    goto failed_loader_init;
+  loader.data = &load;
+
+  err = pyg_loader_get(&loader, rpath, (void**) &res);
+  if (!pyg_is_ok(err))
+    goto failed_loader_get;
+
+  err = pyg_attach(res, NULL);
+  if (!pyg_is_ok(err)) {
+    pyg_free(res);
+    goto failed_loader_get;
+  }
+
+  res->loader = &loader;
+  if (res->lazy) {
+    root = pyg_hashmap_cget(&res->target.map, options->root_target);
+    if (root == NULL) {
+      err = pyg_error_str(kPygErrGYP,
+                          "Root target `%s` not found in %s",
+                          options->root_target,
+                          res->path);
+    } else {
+      err = pyg_link_target(root);
+    }
+  } else {
+    err = pyg_link(res);
+  }
+  if (pyg_is_ok(err) && options->strict_paths)
+    err = pyg_validate_paths(res, options->jobs);
+  res->loader = NULL;
+  pyg_loader_destroy(&loader);
+  res->command_stats = commands.stats;
+  pyg_commands_destroy(&commands);
+  pyg_includes_destroy(&includes);
+  if (options->parse_cache != NULL)
+    pyg_cache_destroy(&cache);
+  pyg_path_unref();
+
+  if (!pyg_is_ok(err)) {
+    pyg_free(res);
+    return err;
+  }
+
+  *out = res;
+  return pyg_ok();
+
+failed_loader_get:
+  pyg_loader_destroy(&loader);
+
+failed_loader_init:
+  pyg_commands_destroy(&commands);
+
+failed_commands_init:
+  pyg_includes_destroy(&includes);
+
+failed_includes_init:
+  if (options->parse_cache != NULL)
+    pyg_cache_destroy(&cache);
+
+failed_cache_init:
+  pyg_path_unref();
+
+failed_path_ref:
+  pyg_eval_unref();
+
+failed_eval_ref:
+  pyg_intern_unref();
+  return err;
 }
 
 
@@ -186,22 +422,29 @@ void pyg_free(pyg_t* pyg) {
   free(pyg->dir);
   pyg->dir = NULL;
 
-  if (pyg->parent == NULL) {
+  if (pyg->root == pyg) {
     pyg_hashmap_iterate(&pyg->children.map, pyg_free_child, pyg);
     pyg_hashmap_destroy(&pyg->children.map);
   }
   pyg_hashmap_iterate(&pyg->target.map, pyg_free_target, NULL);
   pyg_hashmap_destroy(&pyg->target.map);
 
-  pyg_hashmap_iterate(&pyg->vars.map, pyg_free_var, NULL);
-  pyg_hashmap_destroy(&pyg->vars.map);
+  pyg_scope_destroy(&pyg->vars);
+  pyg_unroll_cache_destroy(&pyg->templates);
 
-  json_value_free(pyg->json);
-  json_value_free(pyg->clone);
-  pyg->json = NULL;
+  /* Cloned tree does not own anything outside of the arena */
+  pyg_arena_destroy(&pyg->arena);
   pyg->clone = NULL;
   pyg->obj = NULL;
 
+  pyg->path = NULL;
+
+  /* Interned strings are shared by the whole tree */
+  if (pyg->root == pyg) {
+    pyg_eval_unref();
+    pyg_intern_unref();
+  }
+
   free(pyg);
 }
 
@@ -227,8 +470,7 @@ pyg_error_t pyg_free_target(pyg_hashmap_item_t* item, void* arg) {
     free(target->source.list[i].filename);
   }
 
-  pyg_hashmap_iterate(&target->vars.map, pyg_free_var, NULL);
-  pyg_hashmap_destroy(&target->vars.map);
+  pyg_scope_destroy(&target->vars);
 
   free(target->source.list);
   free(target->deps.list);
@@ -238,8 +480,24 @@ pyg_error_t pyg_free_target(pyg_hashmap_item_t* item, void* arg) {
 }
 
 
-pyg_error_t pyg_free_var(pyg_hashmap_item_t* item, void* arg) {
-  free(item->value);
+void pyg_get_stats(pyg_t* pyg, pyg_stats_t* stats) {
+  memset(stats, 0, sizeof(*stats));
+
+  /* Root is in its own `children` map */
+  pyg_hashmap_iterate(&pyg->root->children.map, pyg_add_stats, stats);
+  pyg_eval_stats(&stats->conditions);
+}
+
+
+pyg_error_t pyg_add_stats(pyg_hashmap_item_t* item, void* arg) {
+  pyg_t* pyg;
+  pyg_stats_t* stats;
+
+  pyg = item->value;
+  stats = arg;
+  pyg_unroll_stats(&pyg->templates, &stats->unroll);
+  if (pyg->root == pyg)
+    stats->commands = pyg->command_stats;
 
   return pyg_ok();
 }
@@ -248,7 +506,6 @@ pyg_error_t pyg_free_var(pyg_hashmap_item_t* item, void* arg) {
 pyg_error_t pyg_load(pyg_t* pyg) {
   pyg_error_t err;
 
-  /* TODO(indutny): Support target_defaults */
   err = pyg_load_variables(pyg, pyg->obj, &pyg->vars);
   if (!pyg_is_ok(err))
     return err;
@@ -257,13 +514,62 @@ pyg_error_t pyg_load(pyg_t* pyg) {
   if (!pyg_is_ok(err))
     return err;
 
+  err = pyg_load_target_defaults(pyg);
+  if (!pyg_is_ok(err))
+    return err;
+
   return pyg_load_targets(pyg);
 }
 
 
+/* Every target is merged on top of a copy of `target_defaults` */
+pyg_error_t pyg_load_target_defaults(pyg_t* pyg) {
+  JSON_Value* defaults;
+  JSON_Array* targets;
+  size_t i;
+  size_t count;
+
+  defaults = json_object_get_value(pyg->obj, "target_defaults");
+  if (defaults == NULL)
+    return pyg_ok();
+
+  if (json_value_get_type(defaults) != JSONObject)
+    return pyg_error_str(kPygErrJSON, "`target_defaults` not object");
+
+  targets = json_object_get_array(pyg->obj, "targets");
+  count = json_array_get_count(targets);
+  for (i = 0; i < count; i++) {
+    pyg_error_t err;
+    JSON_Object* target;
+    JSON_Value* res;
+
+    target = json_array_get_object(targets, i);
+    if (target == NULL)
+      return pyg_error_str(kPygErrJSON, "`targets`[%d] not object", (int) i);
+
+    err = pyg_clone_json(defaults, kPygMergeAuto, &res);
+    if (!pyg_is_ok(err))
+      return err;
+
+    err = pyg_merge_json_obj(json_object(res), target, kPygMergeAuto);
+    if (!pyg_is_ok(err)) {
+      json_value_free(res);
+      return err;
+    }
+
+    if (json_array_replace_value(targets, i, res) != JSONSuccess) {
+      json_value_free(res);
+      return pyg_error_str(kPygErrJSON, "Failed to replace target");
+    }
+  }
+
+  return pyg_ok();
+}
+
+
 pyg_error_t pyg_load_variables(pyg_t* pyg,
                                JSON_Object* json,
-                               pyg_proto_hashmap_t* out) {
+                               pyg_scope_t* out) {
   size_t i;
   size_t count;
   JSON_Value* val;
@@ -282,9 +588,10 @@ pyg_error_t pyg_load_variables(pyg_t* pyg,
     JSON_Value* prop;
     const char* name;
     pyg_value_t val;
+    pyg_list_t list;
 
     name = json_object_get_name(vars, i);
-    prop = json_object_get_value(vars, name);
+    prop = json_object_get_value_at(vars, i);
 
     switch (json_value_get_type(prop)) {
       case JSONString:
@@ -293,21 +600,53 @@ pyg_error_t pyg_load_variables(pyg_t* pyg,
 
           str = json_value_get_string(prop);
           val.type = kPygValueStr;
-          val.value.str.str = str;
-          val.value.str.len = strlen(str);
+          val.str = str;
+          val.len = strlen(str);
         }
         break;
       case JSONNumber:
         val.type = kPygValueInt;
+        val.str = NULL;
         val.value.num = json_value_get_number(prop);
         break;
+      case JSONArray:
+        {
+          JSON_Array* arr;
+          size_t j;
+
+          /* Items are copied by `pyg_add_var()` */
+          arr = json_value_get_array(prop);
+          list.count = json_array_get_count(arr);
+          list.items = malloc(list.count * sizeof(*list.items) + 1);
+          if (list.items == NULL)
+            return pyg_error_str(kPygErrNoMem, "`variables`[%d]", (int) i);
+
+          for (j = 0; j < list.count; j++) {
+            list.items[j] = json_array_get_string(arr, j);
+            if (list.items[j] == NULL) {
+              free(list.items);
+              return pyg_error_str(kPygErrGYP,
+                                   "`variables`[%d] list items should be "
+                                       "strings",
+                                   (int) i);
+            }
+          }
+          list.paths = NULL;
+          list.resolved = 0;
+          val.type = kPygValueList;
+          val.str = NULL;
+          val.value.list = &list;
+        }
+        break;
       default:
         return pyg_error_str(kPygErrGYP,
-                             "`variables`[%d] is not string/integer",
+                             "`variables`[%d] is not string/integer/list",
                              (int) i);
     }
 
     err = pyg_add_var(pyg, out, name, &val);
+    if (val.type == kPygValueList)
+      free(list.items);
     if (!pyg_is_ok(err))
       return err;
   }
@@ -317,44 +656,43 @@ pyg_error_t pyg_load_variables(pyg_t* pyg,
 
 
 pyg_error_t pyg_add_var(pyg_t* pyg,
-                        pyg_proto_hashmap_t* vars,
+                        pyg_scope_t* vars,
                         const char* key,
                         pyg_value_t* val) {
   pyg_error_t err;
-  char key_st[1024];
   const char* ekey;
   int len;
-  pyg_value_t* dup_val;
-
-  /* Evaluate variable using all known variables at the point */
-  /* TODO(indutny): ./pyg ... -D... -D... - how should this handle it? */
-  err = pyg_unroll_value(vars, val, &dup_val);
-  if (!pyg_is_ok(err))
-    return err;
 
   len = strlen(key);
 
   /* Default value */
   if (key[len - 1] == '%') {
-    ekey = key_st;
-    snprintf(key_st, sizeof(key_st), "%.*s", len - 1, key);
-
-    if (pyg_proto_hashmap_cget(vars, ekey) != NULL)
+    ekey = pyg_intern(key, len - 1);
+    if (ekey != NULL && pyg_scope_iget(vars, ekey) != NULL)
       return pyg_ok();
   } else {
-    ekey = key;
+    ekey = pyg_intern(key, len);
   }
-
-  err = pyg_hashmap_cinsert(&vars->map, ekey, dup_val);
+  if (ekey == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_intern(%s)", key);
+
+  /*
+   * Later definitions override earlier and inherited ones. The value is
+   * expanded on first use, so it may refer to variables defined after it.
+   */
+  err = pyg_scope_set(vars, ekey, val);
   if (!pyg_is_ok(err))
-    free(dup_val);
-  return err;
+    return err;
+
+  if (vars->templates != NULL)
+    vars->templates->stats.variables++;
+  return pyg_ok();
 }
 
 
 pyg_error_t pyg_eval_conditions(pyg_t* pyg,
                                 JSON_Object* json,
-                                pyg_proto_hashmap_t* vars) {
+                                pyg_scope_t* vars) {
   size_t i;
   JSON_Value* val;
   JSON_Array* conds;
@@ -371,7 +709,7 @@ pyg_error_t pyg_eval_conditions(pyg_t* pyg,
     JSON_Array* pair;
     size_t pair_size;
     const char* test;
-    char* etest;
+    const char* etest;
     int btest;
     JSON_Object* branch;
 
@@ -386,12 +724,11 @@ pyg_error_t pyg_eval_conditions(pyg_t* pyg,
     }
 
     test = json_array_get_string(pair, 0);
-    err = pyg_unroll_str(vars, test, &etest);
+    err = pyg_unroll_istr(vars, test, &etest);
     if (!pyg_is_ok(err))
       return err;
 
     err = pyg_eval_test(vars, etest, &btest);
-    free(etest);
     if (!pyg_is_ok(err))
       return err;
 
@@ -430,7 +767,7 @@ pyg_error_t pyg_load_targets(pyg_t* pyg) {
   if (targets == NULL)
     return pyg_error_str(kPygErrJSON, "'targets' property not found");
 
-  /* Load local targets */
+  /* Register local targets by name */
   err = pyg_iter_array(targets,
                        "targets",
                        (pyg_iter_array_get_cb) json_array_get_object,
@@ -439,34 +776,134 @@ pyg_error_t pyg_load_targets(pyg_t* pyg) {
   if (!pyg_is_ok(err))
     return err;
 
-  /* Load their deps */
+  /* Lazy targets are materialized by `pyg_link_target` */
+  if (pyg->lazy)
+    return pyg_ok();
+
+  /* NOTE: Dependencies are loaded later by `pyg_link` */
+  QUEUE_FOREACH(q, &pyg->target.list) {
+    pyg_target_t* target;
+
+    target = container_of(q, pyg_target_t, member);
+    err = pyg_materialize_target(target);
+    if (!pyg_is_ok(err))
+      return err;
+  }
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_prefetch(pyg_loader_t* loader, pyg_t* pyg) {
+  QUEUE* q;
+
+  if (!pyg_loader_is_parallel(loader))
+    return pyg_ok();
+
+  /* Let other threads load external dependencies while we are linking */
   QUEUE_FOREACH(q, &pyg->target.list) {
+    pyg_error_t err;
+
+    err = pyg_prefetch_target(loader, container_of(q, pyg_target_t, member));
+    if (!pyg_is_ok(err))
+      return err;
+  }
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_prefetch_target(pyg_loader_t* loader, pyg_target_t* target) {
+  JSON_Array* deps;
+  const char* dir;
+  size_t i;
+  size_t count;
+
+  dir = target->pyg->dir;
+  deps = json_object_get_array(target->json, "dependencies");
+  count = json_array_get_count(deps);
+  for (i = 0; i < count; i++) {
+    pyg_error_t err;
+    const char* dep;
+    const char* colon;
+    const char* dep_path;
+
+    dep = json_array_get_string(deps, i);
+    if (dep == NULL)
+      continue;
+
+    colon = strchr(dep, ':');
+    if (colon == NULL)
+      continue;
+
+    /* Errors will be reported by `pyg_link` */
+    err = pyg_path_resolve(dir, dep, colon - dep, 0, &dep_path);
+    if (!pyg_is_ok(err))
+      continue;
+
+    err = pyg_loader_submit(loader, dep_path);
+    if (!pyg_is_ok(err))
+      return err;
+  }
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_link(pyg_t* pyg) {
+  QUEUE* q;
+
+  QUEUE_FOREACH(q, &pyg->target.list) {
+    pyg_error_t err;
     pyg_target_t* target;
 
     target = container_of(q, pyg_target_t, member);
+    target->state = kPygTargetLinking;
     err = pyg_load_target_deps(target);
     if (!pyg_is_ok(err))
       return err;
+    target->state = kPygTargetLinked;
+  }
+
+  return pyg_ok();
+}
+
 
-    /* Resolve various path arrays in JSON */
-    err = pyg_resolve_json(target, target->json, "sources");
-    if (pyg_is_ok(err))
-      err = pyg_resolve_json(target, target->json, "include_dirs");
+/* Lazy counterpart of `pyg_link`, walks dependencies depth-first */
+pyg_error_t pyg_link_target(pyg_target_t* target) {
+  pyg_error_t err;
+  pyg_loader_t* loader;
 
-    /* TODO(indutny): cflags/ldflags could be arrays */
-    if (pyg_is_ok(err))
-      err = pyg_unroll_json_key(&target->vars, target->json, "cflags");
-    if (pyg_is_ok(err))
-      err = pyg_unroll_json_key(&target->vars, target->json, "ldflags");
+  /* Done, or a dependency cycle */
+  if (target->state >= kPygTargetLinking)
+    return pyg_ok();
+
+  if (target->state == kPygTargetRegistered) {
+    pyg_arena_t* prev;
+
+    prev = pyg_arena_enter(&target->pyg->arena);
+    json_set_intern_function(pyg_intern);
+    err = pyg_materialize_target(target);
+    json_set_intern_function(NULL);
+    pyg_arena_enter(prev);
     if (!pyg_is_ok(err))
       return err;
+  }
 
-    /* Create list of source/type/output structs */
-    err = pyg_create_sources(target);
+  target->state = kPygTargetLinking;
+
+  loader = target->pyg->root->loader;
+  if (pyg_loader_is_parallel(loader)) {
+    err = pyg_prefetch_target(loader, target);
     if (!pyg_is_ok(err))
       return err;
   }
 
+  err = pyg_load_target_deps(target);
+  if (!pyg_is_ok(err))
+    return err;
+
+  target->state = kPygTargetLinked;
   return pyg_ok();
 }
 
@@ -474,7 +911,6 @@ pyg_error_t pyg_load_targets(pyg_t* pyg) {
 pyg_error_t pyg_load_target(void* val, size_t i, size_t count, void* arg) {
   JSON_Object* obj;
   const char* name;
-  const char* type;
   pyg_t* pyg;
   pyg_target_t* target;
   pyg_error_t err;
@@ -488,55 +924,35 @@ pyg_error_t pyg_load_target(void* val, size_t i, size_t count, void* arg) {
 
   target->pyg = pyg;
   target->json = obj;
+  target->state = kPygTargetRegistered;
   QUEUE_INIT(&target->member);
 
-  err = pyg_hashmap_init(&target->vars.map, kPygVarCount);
+  /* File scope is complete at this point */
+  err = pyg_scope_init(&target->vars, &pyg->vars);
   if (!pyg_is_ok(err))
     goto failed_init_vars;
-  target->vars.parent = &pyg->vars;
 
-  err = pyg_load_variables(pyg, target->json, &target->vars);
-  if (!pyg_is_ok(err))
-    goto failed_load_vars;
-
-  /* Need to eval it early because of the source list */
-  err = pyg_eval_conditions(pyg, target->json, &target->vars);
-  if (!pyg_is_ok(err))
-    goto failed_load_vars;
-
-  /* Allocate space for dependencies */
-  target->deps.count =
-      json_array_get_count(json_object_get_array(obj, "dependencies"));
-  target->deps.list = calloc(target->deps.count, sizeof(*target->deps.list));
-  if (target->deps.list == NULL) {
-    err = pyg_error_str(kPygErrNoMem, "pyg_target_t.deps");
-    goto failed_load_vars;
-  }
-
-  /* Allocate space for source files */
-  target->source.count =
-      json_array_get_count(json_object_get_array(obj, "sources"));
-  target->source.list = calloc(target->source.count,
-                               sizeof(*target->source.list));
-  if (target->source.list == NULL) {
-    err = pyg_error_str(kPygErrNoMem, "pyg_target_t.source");
-    goto failed_alloc_source;
-  }
-
-  /* Load name/type */
   name = json_object_get_string(obj, "target_name");
   if (name == NULL) {
     err = pyg_error_str(kPygErrJSON, "'target_name' not string");
     goto failed_target_name;
   }
 
-  target->name = name;
-  type = json_object_get_string(obj, "type");
-  err = pyg_target_type_from_str(type, &target->type);
-  if (!pyg_is_ok(err))
+  target->name = pyg_cintern(name);
+  if (target->name == NULL) {
+    err = pyg_error_str(kPygErrNoMem, "pyg_target_t.name");
     goto failed_target_name;
+  }
+
+  if (pyg_hashmap_iget(&pyg->target.map, target->name) != NULL) {
+    err = pyg_error_str(kPygErrGYP,
+                        "Duplicate target `%s` in %s",
+                        target->name,
+                        pyg->path);
+    goto failed_target_name;
+  }
 
-  err = pyg_hashmap_cinsert(&pyg->target.map, name, target);
+  err = pyg_hashmap_iinsert(&pyg->target.map, target->name, target);
   if (!pyg_is_ok(err))
     goto failed_target_name;
   QUEUE_INSERT_TAIL(&pyg->target.list, &target->member);
@@ -544,15 +960,7 @@ pyg_error_t pyg_load_target(void* val, size_t i, size_t count, void* arg) {
   return pyg_ok();
 
 failed_target_name:
-  free(target->source.list);
-  target->source.list = NULL;
-
-failed_alloc_source:
-  free(target->deps.list);
-  target->deps.list = NULL;
-
-failed_load_vars:
-  pyg_hashmap_destroy(&target->vars.map);
+  pyg_scope_destroy(&target->vars);
 
 failed_init_vars:
   free(target);
@@ -561,22 +969,78 @@ failed_init_vars:
 }
 
 
+/* NOTE: Target is owned by `pyg->target.map`, it is freed on failure too */
+pyg_error_t pyg_materialize_target(pyg_target_t* target) {
+  pyg_error_t err;
+  JSON_Object* obj;
+  const char* type;
+  size_t count;
+
+  obj = target->json;
+
+  err = pyg_load_variables(target->pyg, obj, &target->vars);
+  if (!pyg_is_ok(err))
+    return err;
+
+  /* Need to eval it early because of the source list */
+  err = pyg_eval_conditions(target->pyg, obj, &target->vars);
+  if (!pyg_is_ok(err))
+    return err;
+
+  /* Allocate space for dependencies */
+  count = json_array_get_count(json_object_get_array(obj, "dependencies"));
+  target->deps.list = calloc(count, sizeof(*target->deps.list));
+  if (target->deps.list == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_target_t.deps");
+  target->deps.count = count;
+
+  type = json_object_get_string(obj, "type");
+  err = pyg_target_type_from_str(type, &target->type);
+  if (!pyg_is_ok(err))
+    return err;
+
+  /* Resolve various path arrays in JSON */
+  err = pyg_resolve_json(target, obj, "sources");
+  if (pyg_is_ok(err))
+    err = pyg_resolve_json(target, obj, "include_dirs");
+  if (pyg_is_ok(err))
+    err = pyg_unroll_json_key(&target->vars, obj, "cflags");
+  if (pyg_is_ok(err))
+    err = pyg_unroll_json_key(&target->vars, obj, "ldflags");
+  if (!pyg_is_ok(err))
+    return err;
+
+  /* Allocate space for source files, lists are spliced in at this point */
+  count = json_array_get_count(json_object_get_array(obj, "sources"));
+  target->source.list = calloc(count, sizeof(*target->source.list));
+  if (target->source.list == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_target_t.source");
+  target->source.count = count;
+
+  /* Create list of source/type/output structs */
+  err = pyg_create_sources(target);
+  if (!pyg_is_ok(err))
+    return err;
+
+  target->state = kPygTargetMaterialized;
+  return pyg_ok();
+}
+
+
 pyg_error_t pyg_target_type_from_str(const char* type, pyg_target_type_t* out) {
   if (type == NULL) {
     *out = kPygTargetDefaultType;
     return pyg_ok();
   }
 
-  if (strcmp(type, "none") == 0)
-    *out = kPygTargetNone;
-  else if (strcmp(type, "executable") == 0)
-    *out = kPygTargetExecutable;
-  else if (strcmp(type, "static_library") == 0)
-    *out = kPygTargetStatic;
-  else if (strcmp(type, "shared_library") == 0)
-    *out = kPygTargetShared;
-  else
-    return pyg_error_str(kPygErrJSON, "Invalid target.type: %s", type);
+  switch (pyg_ckeyword(type)) {
+    case kPygKwTypeNone: *out = kPygTargetNone; break;
+    case kPygKwTypeExecutable: *out = kPygTargetExecutable; break;
+    case kPygKwTypeStatic: *out = kPygTargetStatic; break;
+    case kPygKwTypeShared: *out = kPygTargetShared; break;
+    default:
+      return pyg_error_str(kPygErrJSON, "Invalid target.type: %s", type);
+  }
 
   return pyg_ok();
 }
@@ -610,7 +1074,7 @@ pyg_error_t pyg_load_target_dep(void* val, size_t i, size_t count, void* arg) {
   pyg_target_t* dep_target;
   pyg_t* child;
   const char* colon;
-  char* dep_path;
+  const char* dep_path;
 
   dep = val;
   target = arg;
@@ -628,19 +1092,11 @@ pyg_error_t pyg_load_target_dep(void* val, size_t i, size_t count, void* arg) {
   }
 
   /* Non-local! */
-  dep_path = pyg_nresolve(target->pyg->dir,
-                          strlen(target->pyg->dir),
-                          dep,
-                          colon - dep);
-  if (dep_path == NULL) {
-    return pyg_error_str(kPygErrFS,
-                         "Failed to resolve %.*s",
-                         colon - dep,
-                         dep);
-  }
+  err = pyg_path_resolve(target->pyg->dir, dep, colon - dep, 1, &dep_path);
+  if (!pyg_is_ok(err))
+    return err;
 
   err = pyg_new_child(dep_path, target->pyg, &child);
-  free(dep_path);
   if (!pyg_is_ok(err))
     return err;
 
@@ -653,6 +1109,12 @@ pyg_error_t pyg_load_target_dep(void* val, size_t i, size_t count, void* arg) {
   }
 
 done:
+  if (target->pyg->lazy) {
+    err = pyg_link_target(dep_target);
+    if (!pyg_is_ok(err))
+      return err;
+  }
+
   if (dep_target->type == kPygTargetExecutable) {
     return pyg_error_str(kPygErrGYP,
                          "Dependency `%s` has non-linkable type",
@@ -670,7 +1132,6 @@ pyg_error_t pyg_resolve_json(pyg_target_t* target,
   JSON_Value* val;
   JSON_Array* arr;
   size_t i;
-  size_t count;
 
   val = json_object_get_value(json, key);
   /* No values */
@@ -682,37 +1143,103 @@ pyg_error_t pyg_resolve_json(pyg_target_t* target,
   if (arr == NULL)
     return pyg_error_str(kPygErrJSON, "`%s` not array", key);
 
-  count = json_array_get_count(arr);
-  for (i = 0; i < count; i++) {
+  i = 0;
+  while (i < json_array_get_count(arr)) {
     pyg_error_t err;
     const char* path;
     char* epath;
-    char* resolved;
-    JSON_Status status;
+    const char* resolved;
+    JSON_Value* value;
+    pyg_list_t* list;
 
     path = json_array_get_string(arr, i);
     if (path == NULL)
       return pyg_error_str(kPygErrJSON, "`%s`[%d] not string", key, (int) i);
 
-    err = pyg_unroll_str(&target->vars, path, &epath);
+    /* `<@(list)` - items are resolved once and spliced into the array */
+    err = pyg_unroll_list(&target->vars, path, &list);
     if (!pyg_is_ok(err))
       return err;
 
-    resolved = pyg_resolve(target->pyg->dir, epath);
-    if (resolved == NULL) {
-      err = pyg_error_str(kPygErrFS,
-                          "pyg_resolve(%s, %s)",
-                          target->pyg->dir,
-                          epath);
-      free(epath);
-      return err;
+    if (list != NULL) {
+      const char** paths;
+      JSON_Status status;
+
+      /* Output of commands is shared between files, resolve every time */
+      paths = list->paths;
+      if (paths == NULL) {
+        paths = malloc(list->count * sizeof(*paths) + 1);
+        if (paths == NULL)
+          return pyg_error_str(kPygErrNoMem, "`%s` list paths", key);
+      }
+
+      err = pyg_ok();
+      if (paths != list->paths || !list->resolved)
+        err = pyg_resolve_list(target, list, paths);
+      if (pyg_is_ok(err) && paths == list->paths)
+        list->resolved = 1;
+
+      status = JSONSuccess;
+      if (pyg_is_ok(err))
+        status = json_array_splice_strings_in_place(arr, i, paths, list->count);
+      if (paths != list->paths)
+        free(paths);
+      if (!pyg_is_ok(err))
+        return err;
+      if (status != JSONSuccess)
+        return pyg_error_str(kPygErrJSON, "Failed to splice list into array");
+
+      i += list->count;
+      continue;
     }
 
-    status = json_array_replace_string(arr, i, resolved);
+    /* NOTE: Not memoized, sources are rarely shared and get interned below */
+    err = pyg_unroll_str(&target->vars, path, &epath);
+    if (!pyg_is_ok(err))
+      return err;
+
+    /* Same paths are shared by many targets, results are interned */
+    /* Existence is checked by `pyg_validate_paths()` in a single batch */
+    err = pyg_path_resolve(target->pyg->dir,
+                           epath,
+                           strlen(epath),
+                           0,
+                           &resolved);
     free(epath);
-    free(resolved);
-    if (status != JSONSuccess)
+    if (!pyg_is_ok(err))
+      return err;
+
+    value = json_value_init_string_in_place(resolved);
+    if (value == NULL)
+      return pyg_error_str(kPygErrNoMem, "json_value_init_string_in_place");
+
+    if (json_array_replace_value(arr, i, value) != JSONSuccess) {
+      json_value_free(value);
       return pyg_error_str(kPygErrJSON, "Failed to insert string into array");
+    }
+    i++;
+  }
+
+  return pyg_ok();
+}
+
+
+/* Items of lists are relative to the .gyp file of the target */
+pyg_error_t pyg_resolve_list(pyg_target_t* target,
+                             pyg_list_t* list,
+                             const char** paths) {
+  unsigned int i;
+
+  for (i = 0; i < list->count; i++) {
+    pyg_error_t err;
+
+    err = pyg_path_resolve(target->pyg->dir,
+                           list->items[i],
+                           strlen(list->items[i]),
+                           0,
+                           &paths[i]);
+    if (!pyg_is_ok(err))
+      return err;
   }
 
   return pyg_ok();
@@ -737,21 +1264,28 @@ pyg_error_t pyg_create_sources(pyg_target_t* target) {
     if (ext == NULL) {
       src->type = kPygSourceSkip;
     } else {
-      ext++;
-      if (strcmp(ext, "c") == 0)
-        src->type = kPygSourceC;
-      else if (strcmp(ext, "cc") == 0 || strcmp(ext, "cpp") == 0)
-        src->type = kPygSourceCXX;
-      else if (strcmp(ext, "m") == 0)
-        src->type = kPygSourceObjC;
-      else if (strcmp(ext, "mm") == 0)
-        src->type = kPygSourceObjCXX;
-      else if (strcmp(ext, "o") == 0 || strcmp(ext, "so") == 0)
-        src->type = kPygSourceLink;
-      else if (strcmp(ext, "dylib") == 0 || strcmp(ext, "dll") == 0)
-        src->type = kPygSourceLink;
-      else
-        src->type = kPygSourceSkip;
+      switch (pyg_ckeyword(ext + 1)) {
+        /* Assembly is passed to the C compiler driver */
+        case kPygKwExtC:
+        case kPygKwExtAsm:
+        case kPygKwExtAsmPP:
+          src->type = kPygSourceC;
+          break;
+        case kPygKwExtCC:
+        case kPygKwExtCPP:
+        case kPygKwExtCXX:
+          src->type = kPygSourceCXX;
+          break;
+        case kPygKwExtM: src->type = kPygSourceObjC; break;
+        case kPygKwExtMM: src->type = kPygSourceObjCXX; break;
+        case kPygKwExtO:
+        case kPygKwExtSO:
+        case kPygKwExtDylib:
+        case kPygKwExtDLL:
+          src->type = kPygSourceLink;
+          break;
+        default: src->type = kPygSourceSkip; break;
+      }
     }
 
     target->source.types |= src->type;
@@ -778,6 +1312,150 @@ pyg_error_t pyg_create_sources(pyg_target_t* target) {
 }
 
 
+pyg_error_t pyg_validate_paths(pyg_t* pyg, unsigned int jobs) {
+  pyg_error_t err;
+  QUEUE* q;
+  const char** paths;
+  unsigned int count;
+  unsigned int size;
+  unsigned int missing_count;
+  unsigned int i;
+  unsigned int j;
+  char* missing;
+  char msg[768];
+  int off;
+
+  paths = NULL;
+  count = 0;
+  size = 0;
+  QUEUE_FOREACH(q, &pyg->children.list) {
+    pyg_t* p;
+    QUEUE* qt;
+
+    p = container_of(q, pyg_t, member);
+    QUEUE_FOREACH(qt, &p->target.list) {
+      pyg_target_t* target;
+      JSON_Array* dirs;
+
+      target = container_of(qt, pyg_target_t, member);
+      if (target->state != kPygTargetLinked)
+        continue;
+
+      for (i = 0; i < target->source.count; i++) {
+        err = pyg_validate_add(&paths,
+                               &count,
+                               &size,
+                               target->source.list[i].path);
+        if (!pyg_is_ok(err))
+          goto done;
+      }
+
+      dirs = json_object_get_array(target->json, "include_dirs");
+      for (i = 0; i < json_array_get_count(dirs); i++) {
+        err = pyg_validate_add(&paths,
+                               &count,
+                               &size,
+                               json_array_get_string(dirs, i));
+        if (!pyg_is_ok(err))
+          goto done;
+      }
+    }
+  }
+
+  /* Paths are interned, duplicates are equal pointers */
+  qsort(paths, count, sizeof(*paths), pyg_validate_compare);
+  for (i = 0, j = 0; i < count; i++)
+    if (j == 0 || paths[j - 1] != paths[i])
+      paths[j++] = paths[i];
+  count = j;
+
+  missing = calloc(count + 1, sizeof(*missing));
+  if (missing == NULL) {
+    err = pyg_error_str(kPygErrNoMem, "pyg_validate_paths");
+    goto done;
+  }
+
+  err = pyg_exists_batch(paths, count, jobs, missing);
+  if (!pyg_is_ok(err))
+    goto failed_batch;
+
+  for (i = 0, j = 0; i < count; i++)
+    if (missing[i])
+      paths[j++] = paths[i];
+  missing_count = j;
+  if (missing_count == 0)
+    goto failed_batch;
+
+  /* Report all of them at once (as many as fit), in stable order */
+  qsort(paths, missing_count, sizeof(*paths), pyg_validate_compare_str);
+  off = 0;
+  for (i = 0; i < missing_count; i++) {
+    int n;
+
+    n = snprintf(msg + off,
+                 sizeof(msg) - off,
+                 "%s%s",
+                 i == 0 ? "" : ", ",
+                 paths[i]);
+    if (n < 0 || (size_t) (off + n) >= sizeof(msg))
+      break;
+    off += n;
+  }
+  msg[off] = '\0';
+
+  err = pyg_error_str(kPygErrFS,
+                      "%u missing file(s): %s%s",
+                      missing_count,
+                      msg,
+                      i == missing_count ? "" : ", ...");
+
+failed_batch:
+  free(missing);
+
+done:
+  free(paths);
+  return err;
+}
+
+
+pyg_error_t pyg_validate_add(const char*** paths,
+                             unsigned int* count,
+                             unsigned int* size,
+                             const char* path) {
+  /* Flags and variables are passed as they are */
+  if (path == NULL || path[0] == '-' || path[0] == '$')
+    return pyg_ok();
+
+  if (*count == *size) {
+    const char** tmp;
+
+    *size = *size == 0 ? 1024 : *size * 2;
+    tmp = realloc(*paths, *size * sizeof(**paths));
+    if (tmp == NULL)
+      return pyg_error_str(kPygErrNoMem, "pyg_validate_paths");
+    *paths = tmp;
+  }
+
+  (*paths)[(*count)++] = path;
+  return pyg_ok();
+}
+
+
+int pyg_validate_compare(const void* a, const void* b) {
+  const char* pa;
+  const char* pb;
+
+  pa = *(const char* const*) a;
+  pb = *(const char* const*) b;
+  return pa < pb ? -1 : pa > pb ? 1 : 0;
+}
+
+
+int pyg_validate_compare_str(const void* a, const void* b) {
+  return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+
 pyg_error_t pyg_translate(pyg_t* pyg, pyg_settings_t* settings) {
   QUEUE* q;
 
@@ -795,6 +1473,10 @@ pyg_error_t pyg_translate(pyg_t* pyg, pyg_settings_t* settings) {
 
       target = container_of(qt, pyg_target_t, member);
 
+      /* Not reached from the root target */
+      if (target->state != kPygTargetLinked)
+        continue;
+
       settings->gen->target_cb(target, settings);
     }
   }
@@ -1,29 +1,38 @@
 #ifndef SRC_PYG_H_
 #define SRC_PYG_H_
 
+#include "src/arena.h"
+#include "src/command.h"
 #include "src/common.h"
+#include "src/eval.h"
+#include "src/scope.h"
 #include "src/queue.h"
+#include "src/unroll.h"
 
 #include "parson.h"
 
 /* Forward declarations */
 struct pyg_gen_s;
+struct pyg_loader_s;
 
 typedef struct pyg_s pyg_t;
 typedef struct pyg_state_s pyg_state_t;
 typedef struct pyg_target_s pyg_target_t;
 typedef struct pyg_source_s pyg_source_t;
 typedef struct pyg_settings_s pyg_settings_t;
+typedef struct pyg_options_s pyg_options_t;
+typedef struct pyg_stats_s pyg_stats_t;
 
 struct pyg_s {
   /* 0 - for root, > 0 for child */
   unsigned int id;
   unsigned int child_count;
 
-  JSON_Value* json;
+  /* `clone` tree lives here, parsed one is freed right after cloning */
+  pyg_arena_t arena;
   JSON_Value* clone;
   JSON_Object* obj;
-  char* path;
+  const char* path;
   char* dir;
 
   pyg_t* root;
@@ -33,12 +42,22 @@ struct pyg_s {
     QUEUE list;
   } children;
 
+  /* Only for root, and only during `pyg_new` */
+  struct pyg_loader_s* loader;
+
+  /* Targets are materialized only when reached from the root target */
+  int lazy;
+
   struct {
     pyg_hashmap_t map;
     QUEUE list;
   } target;
 
-  pyg_proto_hashmap_t vars;
+  pyg_scope_t vars;
+  pyg_unroll_cache_t templates;
+
+  /* Only for root, `<!(command)` runs during `pyg_new` */
+  pyg_command_stats_t command_stats;
 
   QUEUE member;
 };
@@ -53,12 +72,26 @@ enum pyg_target_type_e {
 };
 typedef enum pyg_target_type_e pyg_target_type_t;
 
+enum pyg_target_state_e {
+  /* Only `name` and `json` are known */
+  kPygTargetRegistered,
+
+  /* Variables, conditions, paths and sources are processed */
+  kPygTargetMaterialized,
+
+  /* Dependencies are being resolved */
+  kPygTargetLinking,
+  kPygTargetLinked
+};
+typedef enum pyg_target_state_e pyg_target_state_t;
+
 struct pyg_target_s {
   pyg_t* pyg;
   JSON_Object* json;
 
   const char* name;
   pyg_target_type_t type;
+  pyg_target_state_t state;
 
   QUEUE member;
 
@@ -73,7 +106,7 @@ struct pyg_target_s {
     unsigned int count;
   } source;
 
-  pyg_proto_hashmap_t vars;
+  pyg_scope_t vars;
 };
 
 enum pyg_source_type_e {
@@ -105,9 +138,48 @@ struct pyg_settings_s {
   pyg_buf_t* out;
 };
 
-pyg_error_t pyg_new(const char* path, pyg_t** out);
+struct pyg_options_s {
+  /* Number of threads loading .gyp files, 0 or 1 - load on main thread */
+  unsigned int jobs;
+
+  /* Directory of the parse cache, NULL - no cache (see src/cache.h) */
+  const char* parse_cache;
+
+  /*
+   * Also keep the output of `<!(command)` in `parse_cache` (see
+   * src/command.h). Off by default: a command may read files and state the
+   * cache does not know about.
+   */
+  int command_cache;
+
+  /*
+   * Name of the target in the top-level file. If not NULL - only it and its
+   * (transitive) dependencies are processed and translated.
+   */
+  const char* root_target;
+
+  /*
+   * Check that every path in `sources` and `include_dirs` exists, in one
+   * batch after loading (see src/exists.h). Otherwise only their directories
+   * have to exist.
+   */
+  int strict_paths;
+};
+
+struct pyg_stats_s {
+  /* Totals of `pyg_t.templates` over every loaded file */
+  pyg_unroll_stats_t unroll;
+  pyg_command_stats_t commands;
+
+  /* Of the process-wide cache (see src/eval.h) */
+  pyg_eval_stats_t conditions;
+};
+
+pyg_error_t pyg_new(const char* path, pyg_options_t* options, pyg_t** out);
 void pyg_free(pyg_t* pyg);
 
+void pyg_get_stats(pyg_t* pyg, pyg_stats_t* stats);
+
 pyg_error_t pyg_translate(pyg_t* pyg, pyg_settings_t* settings);
 
 #endif  /* SRC_PYG_H_ */
@@ -0,0 +1,401 @@
+#include "src/scan.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) &&        \
+    (defined(__GNUC__) || defined(__clang__))
+# define PYG_SCAN_X86 1
+# define PYG_SCAN_AVX2 __attribute__((target("avx2")))
+# include <immintrin.h>
+#endif
+
+#define PYG_SCAN_IS_BLANK(c)                                                  \
+    ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\f' || (c) == '\v')
+
+static void pyg_scan_select(void);
+static int pyg_scan_utf8_seq(const unsigned char* s, const unsigned char* end);
+
+static const char* pyg_scan_blank_scalar(const char* pos, const char* end);
+static const char* pyg_scan_str_scalar(const char* pos,
+                                       const char* end,
+                                       char quote,
+                                       int* ascii);
+static const char* pyg_scan_utf8_scalar(const char* pos, const char* end);
+
+static const pyg_scan_t pyg_scan_scalar = {
+  pyg_scan_blank_scalar,
+  pyg_scan_str_scalar,
+  pyg_scan_utf8_scalar,
+  "scalar"
+};
+
+#ifdef PYG_SCAN_X86
+static const char* pyg_scan_blank_sse2(const char* pos, const char* end);
+static const char* pyg_scan_str_sse2(const char* pos,
+                                     const char* end,
+                                     char quote,
+                                     int* ascii);
+static const char* pyg_scan_utf8_sse2(const char* pos, const char* end);
+
+static const char* pyg_scan_blank_avx2(const char* pos, const char* end);
+static const char* pyg_scan_str_avx2(const char* pos,
+                                     const char* end,
+                                     char quote,
+                                     int* ascii);
+static const char* pyg_scan_utf8_avx2(const char* pos, const char* end);
+
+static const pyg_scan_t pyg_scan_sse2 = {
+  pyg_scan_blank_sse2,
+  pyg_scan_str_sse2,
+  pyg_scan_utf8_sse2,
+  "sse2"
+};
+
+static const pyg_scan_t pyg_scan_avx2 = {
+  pyg_scan_blank_avx2,
+  pyg_scan_str_avx2,
+  pyg_scan_utf8_avx2,
+  "avx2"
+};
+#endif  /* PYG_SCAN_X86 */
+
+static pthread_once_t pyg_scan_once = PTHREAD_ONCE_INIT;
+
+pyg_scan_t pyg_scan = {
+  pyg_scan_blank_scalar,
+  pyg_scan_str_scalar,
+  pyg_scan_utf8_scalar,
+  "scalar"
+};
+
+
+void pyg_scan_init(void) {
+  pthread_once(&pyg_scan_once, pyg_scan_select);
+}
+
+
+void pyg_scan_select(void) {
+  const char* force;
+
+  force = getenv("PYG_SCAN");
+  pyg_scan = pyg_scan_scalar;
+
+#ifdef PYG_SCAN_X86
+  __builtin_cpu_init();
+  if ((force == NULL || strcmp(force, "avx2") == 0) &&
+      __builtin_cpu_supports("avx2")) {
+    pyg_scan = pyg_scan_avx2;
+  } else if (force == NULL || strcmp(force, "scalar") != 0) {
+    pyg_scan = pyg_scan_sse2;
+  }
+#endif  /* PYG_SCAN_X86 */
+}
+
+
+/* Length of valid multi-byte sequence at `s`, or 0 */
+int pyg_scan_utf8_seq(const unsigned char* s, const unsigned char* end) {
+  unsigned char lo;
+  unsigned char hi;
+  int len;
+  int i;
+
+  /* Overlongs, surrogates and code points above U+10FFFF are invalid */
+  lo = 0x80;
+  hi = 0xbf;
+  if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+    len = 2;
+  } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+    len = 3;
+    if (s[0] == 0xe0)
+      lo = 0xa0;
+    else if (s[0] == 0xed)
+      hi = 0x9f;
+  } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+    len = 4;
+    if (s[0] == 0xf0)
+      lo = 0x90;
+    else if (s[0] == 0xf4)
+      hi = 0x8f;
+  } else {
+    return 0;
+  }
+
+  if (end - s < len)
+    return 0;
+  if (s[1] < lo || s[1] > hi)
+    return 0;
+  for (i = 2; i < len; i++)
+    if ((s[i] & 0xc0) != 0x80)
+      return 0;
+
+  return len;
+}
+
+
+const char* pyg_scan_blank_scalar(const char* pos, const char* end) {
+  while (pos < end && PYG_SCAN_IS_BLANK(*pos))
+    pos++;
+  return pos;
+}
+
+
+const char* pyg_scan_str_scalar(const char* pos,
+                                const char* end,
+                                char quote,
+                                int* ascii) {
+  unsigned char high;
+
+  high = 0;
+  for (; pos < end; pos++) {
+    char ch;
+
+    ch = *pos;
+    if (ch == quote || ch == '\\' || ch == '\n')
+      break;
+    high |= (unsigned char) ch;
+  }
+
+  if ((high & 0x80) != 0)
+    *ascii = 0;
+  return pos;
+}
+
+
+const char* pyg_scan_utf8_scalar(const char* pos, const char* end) {
+  while (pos < end) {
+    int len;
+
+    if ((unsigned char) *pos < 0x80) {
+      pos++;
+      continue;
+    }
+
+    len = pyg_scan_utf8_seq((const unsigned char*) pos,
+                            (const unsigned char*) end);
+    if (len == 0)
+      return pos;
+    pos += len;
+  }
+
+  return NULL;
+}
+
+
+#ifdef PYG_SCAN_X86
+
+const char* pyg_scan_blank_sse2(const char* pos, const char* end) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i four = _mm_set1_epi8(4);
+  const __m128i nl = _mm_set1_epi8('\n');
+
+  while (end - pos >= 16) {
+    __m128i v;
+    __m128i t;
+    __m128i blank;
+    unsigned int mask;
+
+    v = _mm_loadu_si128((const __m128i*) pos);
+
+    /* `\t` ... `\r` except `\n`, or ` ` */
+    t = _mm_sub_epi8(v, tab);
+    blank = _mm_cmpeq_epi8(_mm_min_epu8(t, four), t);
+    blank = _mm_andnot_si128(_mm_cmpeq_epi8(v, nl), blank);
+    blank = _mm_or_si128(blank, _mm_cmpeq_epi8(v, space));
+
+    mask = ~_mm_movemask_epi8(blank) & 0xffff;
+    if (mask != 0)
+      return pos + __builtin_ctz(mask);
+    pos += 16;
+  }
+
+  return pyg_scan_blank_scalar(pos, end);
+}
+
+
+const char* pyg_scan_str_sse2(const char* pos,
+                              const char* end,
+                              char quote,
+                              int* ascii) {
+  const __m128i q = _mm_set1_epi8(quote);
+  const __m128i bs = _mm_set1_epi8('\\');
+  const __m128i nl = _mm_set1_epi8('\n');
+  unsigned int high;
+
+  high = 0;
+  while (end - pos >= 16) {
+    __m128i v;
+    __m128i stop;
+    unsigned int mask;
+
+    v = _mm_loadu_si128((const __m128i*) pos);
+    stop = _mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, bs));
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, nl));
+
+    mask = _mm_movemask_epi8(stop);
+    if (mask != 0) {
+      unsigned int i;
+
+      i = __builtin_ctz(mask);
+      high |= _mm_movemask_epi8(v) & ((1U << i) - 1);
+      if (high != 0)
+        *ascii = 0;
+      return pos + i;
+    }
+
+    high |= _mm_movemask_epi8(v);
+    pos += 16;
+  }
+
+  if (high != 0)
+    *ascii = 0;
+  return pyg_scan_str_scalar(pos, end, quote, ascii);
+}
+
+
+/* Vector loop skips ASCII, multi-byte sequences are checked one by one */
+const char* pyg_scan_utf8_sse2(const char* pos, const char* end) {
+  while (pos < end) {
+    int len;
+
+    while (end - pos >= 16) {
+      unsigned int mask;
+
+      mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) pos));
+      if (mask != 0) {
+        pos += __builtin_ctz(mask);
+        break;
+      }
+      pos += 16;
+    }
+
+    if (pos == end)
+      break;
+
+    if ((unsigned char) *pos < 0x80) {
+      pos++;
+      continue;
+    }
+
+    len = pyg_scan_utf8_seq((const unsigned char*) pos,
+                            (const unsigned char*) end);
+    if (len == 0)
+      return pos;
+    pos += len;
+  }
+
+  return NULL;
+}
+
+
+PYG_SCAN_AVX2
+const char* pyg_scan_blank_avx2(const char* pos, const char* end) {
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i four = _mm256_set1_epi8(4);
+  const __m256i nl = _mm256_set1_epi8('\n');
+
+  while (end - pos >= 32) {
+    __m256i v;
+    __m256i t;
+    __m256i blank;
+    unsigned int mask;
+
+    v = _mm256_loadu_si256((const __m256i*) pos);
+
+    t = _mm256_sub_epi8(v, tab);
+    blank = _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t);
+    blank = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, nl), blank);
+    blank = _mm256_or_si256(blank, _mm256_cmpeq_epi8(v, space));
+
+    mask = ~(unsigned int) _mm256_movemask_epi8(blank);
+    if (mask != 0)
+      return pos + __builtin_ctz(mask);
+    pos += 32;
+  }
+
+  return pyg_scan_blank_sse2(pos, end);
+}
+
+
+PYG_SCAN_AVX2
+const char* pyg_scan_str_avx2(const char* pos,
+                              const char* end,
+                              char quote,
+                              int* ascii) {
+  const __m256i q = _mm256_set1_epi8(quote);
+  const __m256i bs = _mm256_set1_epi8('\\');
+  const __m256i nl = _mm256_set1_epi8('\n');
+  unsigned int high;
+
+  high = 0;
+  while (end - pos >= 32) {
+    __m256i v;
+    __m256i stop;
+    unsigned int mask;
+
+    v = _mm256_loadu_si256((const __m256i*) pos);
+    stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, q), _mm256_cmpeq_epi8(v, bs));
+    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, nl));
+
+    mask = _mm256_movemask_epi8(stop);
+    if (mask != 0) {
+      unsigned int i;
+
+      i = __builtin_ctz(mask);
+
+      /* `i` may be 31 */
+      high |= (unsigned int) _mm256_movemask_epi8(v) &
+              (unsigned int) ((1ULL << i) - 1);
+      if (high != 0)
+        *ascii = 0;
+      return pos + i;
+    }
+
+    high |= _mm256_movemask_epi8(v);
+    pos += 32;
+  }
+
+  if (high != 0)
+    *ascii = 0;
+  return pyg_scan_str_sse2(pos, end, quote, ascii);
+}
+
+
+PYG_SCAN_AVX2
+const char* pyg_scan_utf8_avx2(const char* pos, const char* end) {
+  while (pos < end) {
+    int len;
+
+    while (end - pos >= 32) {
+      unsigned int mask;
+
+      mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*) pos));
+      if (mask != 0) {
+        pos += __builtin_ctz(mask);
+        break;
+      }
+      pos += 32;
+    }
+
+    if (pos == end)
+      break;
+
+    if ((unsigned char) *pos < 0x80) {
+      pos++;
+      continue;
+    }
+
+    len = pyg_scan_utf8_seq((const unsigned char*) pos,
+                            (const unsigned char*) end);
+    if (len == 0)
+      return pos;
+    pos += len;
+  }
+
+  return NULL;
+}
+
+#endif  /* PYG_SCAN_X86 */
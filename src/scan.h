@@ -0,0 +1,37 @@
+#ifndef SRC_SCAN_H_
+#define SRC_SCAN_H_
+
+typedef struct pyg_scan_s pyg_scan_t;
+
+/*
+ * Byte scanning kernels of the parser. Scalar, SSE2 and AVX2 versions are
+ * available, the best one supported by CPU is picked by `pyg_scan_init()`
+ * (`PYG_SCAN=scalar|sse2|avx2` environment variable overrides the choice).
+ *
+ * None of the kernels read past `end`.
+ */
+struct pyg_scan_s {
+  /* First byte that is not ` `, `\t`, `\r`, `\f` or `\v`, or `end` */
+  const char* (*blank)(const char* pos, const char* end);
+
+  /*
+   * First `quote`, `\\` or `\n`, or `end`. `*ascii` is set to zero if any of
+   * the skipped bytes is not ASCII, and is left untouched otherwise.
+   */
+  const char* (*str)(const char* pos,
+                     const char* end,
+                     char quote,
+                     int* ascii);
+
+  /* First byte of invalid UTF-8 sequence, or NULL if there is none */
+  const char* (*utf8)(const char* pos, const char* end);
+
+  const char* name;
+};
+
+extern pyg_scan_t pyg_scan;
+
+/* Thread-safe, may be called many times */
+void pyg_scan_init(void);
+
+#endif  /* SRC_SCAN_H_ */
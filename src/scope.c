@@ -0,0 +1,132 @@
+#include "src/scope.h"
+#include "src/common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const unsigned int kPygScopeSize = 16;
+static const unsigned int kPygScopeVarCount = 8;
+
+
+pyg_error_t pyg_scope_init(pyg_scope_t* scope, pyg_scope_t* parent) {
+  memset(scope, 0, sizeof(*scope));
+  scope->parent = parent;
+
+  if (parent != NULL) {
+    scope->templates = parent->templates;
+    scope->map = parent->map;
+    return pyg_ok();
+  }
+
+  scope->map = &scope->own;
+  return pyg_hashmap_init(&scope->own, kPygScopeSize);
+}
+
+
+void pyg_scope_destroy(pyg_scope_t* scope) {
+  unsigned int i;
+
+  for (i = 0; i < scope->vars.count; i++) {
+    pyg_var_t* var;
+
+    var = scope->vars.list[i];
+    if (var->state == kPygVarDone && var->value.type == kPygValueList)
+      free(var->value.value.list);
+    free(var);
+  }
+  free(scope->vars.list);
+  scope->vars.list = NULL;
+  scope->vars.count = 0;
+
+  if (scope->map == &scope->own)
+    pyg_hashmap_destroy(&scope->own);
+  scope->map = NULL;
+}
+
+
+pyg_var_t* pyg_scope_get(pyg_scope_t* scope,
+                         const char* key,
+                         unsigned int key_len) {
+  return pyg_hashmap_get(scope->map, key, key_len);
+}
+
+
+pyg_var_t* pyg_scope_iget(pyg_scope_t* scope, const char* key) {
+  return pyg_hashmap_iget(scope->map, key);
+}
+
+
+pyg_var_t* pyg_scope_hget(pyg_scope_t* scope,
+                          const char* key,
+                          unsigned int key_len,
+                          uint64_t hash) {
+  return pyg_hashmap_hget(scope->map, key, key_len, hash);
+}
+
+
+pyg_error_t pyg_scope_set(pyg_scope_t* scope,
+                          const char* key,
+                          pyg_value_t* value) {
+  pyg_error_t err;
+  pyg_var_t* var;
+  size_t var_size;
+
+  if (scope->vars.count == scope->vars.size) {
+    pyg_var_t** list;
+    unsigned int size;
+
+    size = scope->vars.size == 0 ? kPygScopeVarCount : scope->vars.size * 2;
+    list = realloc(scope->vars.list, size * sizeof(*list));
+    if (list == NULL)
+      return pyg_error_str(kPygErrNoMem, "pyg_scope_t vars");
+    scope->vars.list = list;
+    scope->vars.size = size;
+  }
+
+  /* Copy on first write */
+  if (scope->map != &scope->own) {
+    err = pyg_hashmap_clone(&scope->own, scope->map);
+    if (!pyg_is_ok(err))
+      return err;
+    scope->map = &scope->own;
+  }
+
+  /* List items follow the variable */
+  var_size = sizeof(*var);
+  if (value->type == kPygValueList) {
+    var_size += sizeof(*value->value.list);
+    var_size += value->value.list->count * sizeof(*value->value.list->items);
+  }
+
+  var = malloc(var_size);
+  if (var == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_var_t");
+
+  var->name = key;
+  var->state = kPygVarPending;
+  var->scope = scope;
+  var->prev = pyg_hashmap_iget(&scope->own, key);
+  var->raw = *value;
+  if (value->type == kPygValueList) {
+    pyg_list_t* list;
+
+    list = (pyg_list_t*) (var + 1);
+    *list = *value->value.list;
+    list->items = (const char**) (list + 1);
+    list->paths = NULL;
+    list->resolved = 0;
+    memcpy(list->items,
+           value->value.list->items,
+           list->count * sizeof(*list->items));
+    var->raw.value.list = list;
+  }
+
+  err = pyg_hashmap_iinsert(&scope->own, key, var);
+  if (!pyg_is_ok(err)) {
+    free(var);
+    return err;
+  }
+
+  scope->vars.list[scope->vars.count++] = var;
+  return pyg_ok();
+}
@@ -0,0 +1,92 @@
+#ifndef SRC_SCOPE_H_
+#define SRC_SCOPE_H_
+
+#include "src/common.h"
+#include "src/error.h"
+
+typedef struct pyg_scope_s pyg_scope_t;
+typedef struct pyg_var_s pyg_var_t;
+
+/* Forward declarations */
+struct pyg_unroll_cache_s;
+
+enum pyg_var_state_e {
+  kPygVarPending,
+  kPygVarEvaluating,
+  kPygVarDone
+};
+typedef enum pyg_var_state_e pyg_var_state_t;
+
+/*
+ * Variables are stored as they are written and expanded on the first lookup
+ * (see `pyg_unroll_var()`), unused ones are never expanded.
+ */
+struct pyg_var_s {
+  const char* name;
+  pyg_var_state_t state;
+
+  /* References are resolved in the scope of the definition */
+  pyg_scope_t* scope;
+
+  /* Definition that this one overrides, may be NULL */
+  pyg_var_t* prev;
+
+  /* Strings are borrowed from the .gyp tree, list items are copied */
+  pyg_value_t raw;
+
+  /* Expanded `raw`, valid in `kPygVarDone` state. Lists are owned. */
+  pyg_value_t value;
+};
+
+/*
+ * Variable scope. Scopes are flat: each one maps every visible name (its own
+ * and inherited) to a variable, so any name is resolved with a single lookup.
+ *
+ * A child scope shares the map of its parent until the first variable is
+ * defined in it. At that point the map is copied (slots are reused as they
+ * are, nothing is rehashed), and inherited variables are shared with the
+ * parent, along with their expanded values.
+ *
+ * NOTE: Parent scope must not be modified once it has children, and must
+ * outlive them.
+ */
+struct pyg_scope_s {
+  pyg_scope_t* parent;
+
+  /* Parsed `<(name)` templates (see src/unroll.h), inherited from parent */
+  struct pyg_unroll_cache_s* templates;
+
+  /* Either `own`, or the map of the closest ancestor with definitions */
+  pyg_hashmap_t* map;
+  pyg_hashmap_t own;
+
+  /* Variables defined in this scope, including overridden ones */
+  struct {
+    pyg_var_t** list;
+    unsigned int count;
+    unsigned int size;
+  } vars;
+};
+
+pyg_error_t pyg_scope_init(pyg_scope_t* scope, pyg_scope_t* parent);
+void pyg_scope_destroy(pyg_scope_t* scope);
+
+pyg_var_t* pyg_scope_get(pyg_scope_t* scope,
+                         const char* key,
+                         unsigned int key_len);
+pyg_var_t* pyg_scope_iget(pyg_scope_t* scope, const char* key);
+pyg_var_t* pyg_scope_hget(pyg_scope_t* scope,
+                          const char* key,
+                          unsigned int key_len,
+                          uint64_t hash);
+
+/*
+ * Define (or redefine) variable. `key` must be interned, `value` is stored
+ * unexpanded: strings must outlive the scope, list items are copied.
+ * Variables are released only with the scope.
+ */
+pyg_error_t pyg_scope_set(pyg_scope_t* scope,
+                          const char* key,
+                          pyg_value_t* value);
+
+#endif  /* SRC_SCOPE_H_ */
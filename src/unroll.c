@@ -1,222 +1,897 @@
 #include "src/unroll.h"
+#include "src/arena.h"
+#include "src/command.h"
 #include "src/common.h"
+#include "src/intern.h"
 
-#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-enum pyg_unroll_state_e {
-  kPygUnrollLT,
-  kPygUnrollParenOpen,
-  kPygUnrollName
+/* Variables resolved without heap allocation */
+#define PYG_UNROLL_INLINE 16
+
+typedef struct pyg_unroll_seg_s pyg_unroll_seg_t;
+typedef struct pyg_unroll_template_s pyg_unroll_template_t;
+typedef struct pyg_unroll_ref_s pyg_unroll_ref_t;
+
+enum pyg_unroll_seg_type_e {
+  kPygUnrollLiteral,
+
+  /* `<(name)` and `<@(name)` */
+  kPygUnrollVar,
+  kPygUnrollVarList,
+
+  /* `<!(command)` and `<!@(command)` */
+  kPygUnrollCommand,
+  kPygUnrollCommandList
+};
+typedef enum pyg_unroll_seg_type_e pyg_unroll_seg_type_t;
+
+struct pyg_unroll_seg_s {
+  pyg_unroll_seg_type_t type;
+
+  /* Literal text, variable name, or command */
+  const char* str;
+  unsigned int len;
+
+  /* `pyg_hash()` of variable name */
+  uint64_t hash;
 };
-typedef enum pyg_unroll_state_e pyg_unroll_state_t;
 
-static pyg_error_t pyg_unroll_calc_size(pyg_proto_hashmap_t* vars,
-                                        pyg_str_t* str,
-                                        int* out);
-static pyg_error_t pyg_unroll_write(pyg_proto_hashmap_t* vars,
-                                    pyg_str_t* str,
-                                    char* out);
+struct pyg_unroll_template_s {
+  /* Sum of literal lengths */
+  unsigned int literal_len;
+
+  /* Variables and commands */
+  unsigned int ref_count;
+  unsigned int count;
+  pyg_unroll_seg_t segs[1];
+};
+
+struct pyg_unroll_ref_s {
+  pyg_unroll_seg_type_t type;
+
+  /* `<` */
+  const char* start;
+
+  /* Contents between the parens */
+  const char* str;
+
+  /* Closing `)` */
+  const char* close;
+};
 
-pyg_error_t pyg_unroll_value(pyg_proto_hashmap_t* vars,
+static const unsigned int kPygUnrollCacheSize = 64;
+
+static pyg_error_t pyg_unroll_get_template(pyg_scope_t* vars,
+                                           const char* str,
+                                           unsigned int len,
+                                           pyg_arena_t* scratch,
+                                           pyg_unroll_template_t** out);
+static pyg_error_t pyg_unroll_parse(const char* str,
+                                    unsigned int len,
+                                    pyg_arena_t* arena,
+                                    pyg_unroll_template_t** out);
+static int pyg_unroll_next(const char* p,
+                           const char* end,
+                           pyg_unroll_ref_t* ref);
+static pyg_error_t pyg_unroll_ref(pyg_scope_t* vars,
+                                  pyg_unroll_seg_t* seg,
+                                  pyg_value_t** out);
+static pyg_error_t pyg_unroll_command(pyg_scope_t* vars,
+                                      pyg_unroll_seg_t* seg,
+                                      pyg_value_t** out);
+static pyg_error_t pyg_unroll_items(pyg_scope_t* vars,
+                                    pyg_list_t* input,
+                                    pyg_value_t* out);
+static pyg_error_t pyg_unroll_prefetch_str(pyg_unroll_cache_t* cache,
+                                           const char* str);
+static pyg_error_t pyg_unroll_lookup(pyg_scope_t* vars,
+                                     pyg_unroll_template_t* t,
+                                     pyg_value_t** values);
+static pyg_error_t pyg_unroll_build(pyg_unroll_template_t* t,
+                                    pyg_value_t** values,
+                                    char** out,
+                                    unsigned int* out_len);
+static pyg_error_t pyg_unroll_expand(pyg_scope_t* vars,
+                                     const char* str,
+                                     unsigned int len,
+                                     char** out,
+                                     unsigned int* out_len);
+static pyg_error_t pyg_unroll_memo(pyg_unroll_cache_t* cache,
+                                   pyg_unroll_template_t* t,
+                                   pyg_value_t** values,
+                                   const char** out);
+
+
+pyg_error_t pyg_unroll_cache_init(pyg_unroll_cache_t* cache) {
+  pyg_error_t err;
+
+  memset(&cache->stats, 0, sizeof(cache->stats));
+  pyg_arena_init(&cache->arena);
+  cache->commands = NULL;
+  cache->dir = NULL;
+
+  err = pyg_hashmap_init(&cache->map, kPygUnrollCacheSize);
+  if (!pyg_is_ok(err))
+    return err;
+
+  err = pyg_hashmap_init_owned(&cache->results, kPygUnrollCacheSize);
+  if (!pyg_is_ok(err))
+    pyg_hashmap_destroy(&cache->map);
+  return err;
+}
+
+
+void pyg_unroll_cache_destroy(pyg_unroll_cache_t* cache) {
+  pyg_hashmap_destroy(&cache->results);
+  pyg_hashmap_destroy(&cache->map);
+  pyg_arena_destroy(&cache->arena);
+}
+
+
+void pyg_unroll_stats(pyg_unroll_cache_t* cache, pyg_unroll_stats_t* stats) {
+  stats->templates += cache->stats.templates;
+  stats->hits += cache->stats.hits;
+  stats->misses += cache->stats.misses;
+  stats->variables += cache->stats.variables;
+  stats->evaluated += cache->stats.evaluated;
+}
+
+
+pyg_error_t pyg_unroll_value(pyg_scope_t* vars,
                              pyg_value_t* input,
-                             pyg_value_t** out) {
+                             pyg_value_t* out) {
   pyg_error_t err;
-  pyg_value_t* res;
-  int size;
+
+  if (input->type == kPygValueList)
+    return pyg_unroll_items(vars, input->value.list, out);
 
   /* No string - nothing to unroll */
   if (input->type != kPygValueStr) {
-    res = malloc(sizeof(*res));
+    *out = *input;
+    return pyg_ok();
+  }
+
+  /* Interned, so the value never owns its text */
+  err = pyg_unroll_istr(vars, input->str, &out->str);
+  if (!pyg_is_ok(err))
+    return err;
+
+  out->type = kPygValueStr;
+  out->len = pyg_intern_len(out->str);
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_unroll_str(pyg_scope_t* vars,
+                           const char* input,
+                           char** out) {
+  unsigned int len;
+
+  return pyg_unroll_expand(vars, input, strlen(input), out, &len);
+}
+
+
+pyg_error_t pyg_unroll_istr(pyg_scope_t* vars,
+                            const char* input,
+                            const char** out) {
+  pyg_error_t err;
+  pyg_unroll_template_t* t;
+  pyg_arena_t scratch;
+  pyg_value_t* inline_values[PYG_UNROLL_INLINE];
+  pyg_value_t** values;
+  unsigned int len;
+  char* res;
+  unsigned int res_len;
+
+  len = strlen(input);
+  if (pyg_unroll_next(input, input + len, NULL) != 0) {
+    *out = pyg_intern(input, len);
+    goto intern_done;
+  }
+
+  values = inline_values;
+
+  pyg_arena_init(&scratch);
+  err = pyg_unroll_get_template(vars, input, len, &scratch, &t);
+  if (!pyg_is_ok(err))
+    goto done;
+
+  if (t->ref_count > PYG_UNROLL_INLINE) {
+    values = malloc(t->ref_count * sizeof(*values));
+    if (values == NULL) {
+      values = inline_values;
+      err = pyg_error_str(kPygErrNoMem, "Failed to malloc() unroll values");
+      goto done;
+    }
+  }
+
+  err = pyg_unroll_lookup(vars, t, values);
+  if (!pyg_is_ok(err))
+    goto done;
+
+  /* Same template with the same values - same result */
+  *out = NULL;
+  if (vars->templates != NULL) {
+    err = pyg_unroll_memo(vars->templates, t, values, out);
+    if (!pyg_is_ok(err) || *out != NULL)
+      goto done;
+  }
+
+  err = pyg_unroll_build(t, values, &res, &res_len);
+  if (!pyg_is_ok(err))
+    goto done;
+
+  *out = pyg_intern(res, res_len);
+  free(res);
+
+  if (vars->templates != NULL && *out != NULL)
+    err = pyg_unroll_memo(vars->templates, t, values, out);
+
+done:
+  if (values != inline_values)
+    free(values);
+  pyg_arena_destroy(&scratch);
+  if (!pyg_is_ok(err))
+    return err;
+
+intern_done:
+  if (*out == NULL)
+    return pyg_error_str(kPygErrNoMem, "Failed to intern unroll result");
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_unroll_list(pyg_scope_t* vars,
+                            const char* input,
+                            pyg_list_t** out) {
+  pyg_error_t err;
+  pyg_unroll_ref_t ref;
+  pyg_unroll_seg_t seg;
+  pyg_value_t* value;
+  const char* end;
+
+  *out = NULL;
+  if (input[0] != '<')
+    return pyg_ok();
+
+  end = input + strlen(input);
+  if (pyg_unroll_next(input, end, &ref) != 0)
+    return pyg_ok();
+  if (ref.start != input || ref.close + 1 != end)
+    return pyg_ok();
+  if (ref.type != kPygUnrollVarList && ref.type != kPygUnrollCommandList)
+    return pyg_ok();
+
+  seg.type = ref.type;
+  seg.str = ref.str;
+  seg.len = ref.close - ref.str;
+  seg.hash = pyg_hash(seg.str, seg.len);
+  err = pyg_unroll_ref(vars, &seg, &value);
+  if (!pyg_is_ok(err))
+    return err;
+
+  /* Not a list - expanded as a single string */
+  if (value->type == kPygValueList)
+    *out = value->value.list;
+  return pyg_ok();
+}
+
+
+/*
+ * Expands every item of `input` into a new list value, items that are a
+ * whole `<@(name)` or `<!@(command)` are replaced by the items they refer
+ * to. The list is allocated in a single block, owned by the caller.
+ */
+pyg_error_t pyg_unroll_items(pyg_scope_t* vars,
+                             pyg_list_t* input,
+                             pyg_value_t* out) {
+  pyg_error_t err;
+  const char** items;
+  unsigned int count;
+  unsigned int size;
+  unsigned int i;
+  unsigned int len;
+  pyg_list_t* list;
+  char* joined;
+  char* p;
+
+  items = NULL;
+  count = 0;
+  size = 0;
+  for (i = 0; i < input->count; i++) {
+    pyg_list_t* sub;
+    unsigned int n;
+
+    err = pyg_unroll_list(vars, input->items[i], &sub);
+    if (!pyg_is_ok(err))
+      goto failed_items;
+
+    n = sub == NULL ? 1 : sub->count;
+    if (count + n > size) {
+      const char** tmp;
+
+      size = count + n > size * 2 ? count + n : size * 2;
+      tmp = realloc(items, size * sizeof(*items));
+      if (tmp == NULL) {
+        err = pyg_error_str(kPygErrNoMem, "Failed to realloc() list items");
+        goto failed_items;
+      }
+      items = tmp;
+    }
+
+    if (sub != NULL) {
+      memcpy(&items[count], sub->items, n * sizeof(*items));
+    } else {
+      err = pyg_unroll_istr(vars, input->items[i], &items[count]);
+      if (!pyg_is_ok(err))
+        goto failed_items;
+    }
+    count += n;
+  }
+
+  /* Room for resolved paths follows the items */
+  list = malloc(sizeof(*list) + 2 * count * sizeof(*items));
+  if (list == NULL) {
+    err = pyg_error_str(kPygErrNoMem, "Failed to malloc() unroll result");
+    goto failed_items;
+  }
+
+  list->items = (const char**) (list + 1);
+  list->count = count;
+  list->paths = list->items + count;
+  list->resolved = 0;
+  if (count != 0)
+    memcpy(list->items, items, count * sizeof(*items));
+
+  len = count == 0 ? 0 : count - 1;
+  for (i = 0; i < count; i++)
+    len += pyg_intern_len(items[i]);
+
+  joined = malloc(len + 1);
+  if (joined == NULL) {
+    err = pyg_error_str(kPygErrNoMem, "Failed to malloc() joined list");
+    goto failed_joined;
+  }
+  for (i = 0, p = joined; i < count; i++) {
+    size_t item_len;
+
+    if (i != 0)
+      *p++ = ' ';
+    item_len = pyg_intern_len(items[i]);
+    memcpy(p, items[i], item_len);
+    p += item_len;
+  }
+  out->str = pyg_intern(joined, len);
+  out->len = len;
+  free(joined);
+  if (out->str == NULL) {
+    err = pyg_error_str(kPygErrNoMem, "Failed to intern joined list");
+    goto failed_joined;
+  }
+
+  free(items);
+  out->type = kPygValueList;
+  out->value.list = list;
+  return pyg_ok();
+
+failed_joined:
+  free(list);
+
+failed_items:
+  free(items);
+  return err;
+}
+
+
+pyg_error_t pyg_unroll_expand(pyg_scope_t* vars,
+                              const char* str,
+                              unsigned int len,
+                              char** out,
+                              unsigned int* out_len) {
+  pyg_error_t err;
+  pyg_unroll_template_t* t;
+  pyg_arena_t scratch;
+  pyg_value_t* inline_values[PYG_UNROLL_INLINE];
+  pyg_value_t** values;
+  char* res;
+
+  /* Fast path: nothing to expand */
+  if (pyg_unroll_next(str, str + len, NULL) != 0) {
+    res = malloc(len + 1);
     if (res == NULL)
       return pyg_error_str(kPygErrNoMem, "Failed to malloc() unroll result");
+    memcpy(res, str, len);
+    res[len] = '\0';
 
-    *res = *input;
     *out = res;
+    *out_len = len;
     return pyg_ok();
   }
 
-  err = pyg_unroll_calc_size(vars, &input->value.str, &size);
+  values = inline_values;
+
+  pyg_arena_init(&scratch);
+  err = pyg_unroll_get_template(vars, str, len, &scratch, &t);
   if (!pyg_is_ok(err))
-    return err;
+    goto done;
+
+  if (t->ref_count > PYG_UNROLL_INLINE) {
+    values = malloc(t->ref_count * sizeof(*values));
+    if (values == NULL) {
+      values = inline_values;
+      err = pyg_error_str(kPygErrNoMem, "Failed to malloc() unroll values");
+      goto done;
+    }
+  }
 
-  /* Embed string in the structure */
-  res = malloc(sizeof(*res) + size + 1);
-  if (res == NULL)
-    return pyg_error_str(kPygErrNoMem, "Failed to malloc() unroll result");
+  err = pyg_unroll_lookup(vars, t, values);
+  if (!pyg_is_ok(err))
+    goto done;
+
+  err = pyg_unroll_build(t, values, out, out_len);
+
+done:
+  if (values != inline_values)
+    free(values);
+  pyg_arena_destroy(&scratch);
+  return err;
+}
+
+
+/* Resolve every reference of `t`, in order */
+pyg_error_t pyg_unroll_lookup(pyg_scope_t* vars,
+                              pyg_unroll_template_t* t,
+                              pyg_value_t** values) {
+  pyg_error_t err;
+  unsigned int i;
+  unsigned int j;
+
+  for (i = 0, j = 0; i < t->count; i++) {
+    pyg_unroll_seg_t* seg;
+
+    seg = &t->segs[i];
+    if (seg->type == kPygUnrollLiteral)
+      continue;
+
+    err = pyg_unroll_ref(vars, seg, &values[j++]);
+    if (!pyg_is_ok(err))
+      return err;
+  }
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_unroll_ref(pyg_scope_t* vars,
+                           pyg_unroll_seg_t* seg,
+                           pyg_value_t** out) {
+  pyg_var_t* var;
+
+  if (seg->type == kPygUnrollCommand || seg->type == kPygUnrollCommandList)
+    return pyg_unroll_command(vars, seg, out);
+
+  var = pyg_scope_hget(vars, seg->str, seg->len, seg->hash);
+  if (var == NULL) {
+    return pyg_error_str(kPygErrGYP,
+                         "variable `%.*s` not found",
+                         (int) seg->len,
+                         seg->str);
+  }
+  return pyg_unroll_var(var, out);
+}
+
+
+pyg_error_t pyg_unroll_var(pyg_var_t* var, pyg_value_t** out) {
+  pyg_error_t err;
+  pyg_unroll_cache_t* cache;
+
+  /* `x: '<(x) ...'` - the name refers to the overridden definition */
+  while (var->state == kPygVarEvaluating && var->prev != NULL)
+    var = var->prev;
+
+  if (var->state == kPygVarDone) {
+    *out = &var->value;
+    return pyg_ok();
+  }
+  if (var->state == kPygVarEvaluating) {
+    return pyg_error_str(kPygErrGYP,
+                         "variable `%s` depends on itself",
+                         var->name);
+  }
 
-  res->type = kPygValueStr;
-  res->value.str.str = (char*) res + sizeof(*res);
-  res->value.str.len = size;
-  err = pyg_unroll_write(vars, &input->value.str, (char*) res->value.str.str);
+  var->state = kPygVarEvaluating;
+  err = pyg_unroll_value(var->scope, &var->raw, &var->value);
   if (!pyg_is_ok(err)) {
-    free(res);
+    var->state = kPygVarPending;
     return err;
   }
+  var->state = kPygVarDone;
 
-  *out = res;
+  cache = var->scope->templates;
+  if (cache != NULL)
+    cache->stats.evaluated++;
+
+  *out = &var->value;
   return pyg_ok();
 }
 
 
-pyg_error_t pyg_unroll_str(pyg_proto_hashmap_t* vars,
-                           const char* input,
-                           char** out) {
+/*
+ * Output of the command is owned by `pyg_commands_t`, so it can be used as a
+ * value in the same way as a variable
+ */
+pyg_error_t pyg_unroll_command(pyg_scope_t* vars,
+                               pyg_unroll_seg_t* seg,
+                               pyg_value_t** out) {
   pyg_error_t err;
-  pyg_str_t str;
-  int size;
-  char* res;
+  pyg_unroll_cache_t* cache;
+  pyg_command_t* cmd;
+  char* str;
+  unsigned int len;
+
+  cache = vars->templates;
+  if (cache == NULL || cache->commands == NULL) {
+    return pyg_error_str(kPygErrGYP,
+                         "command `%.*s` can't be run here",
+                         (int) seg->len,
+                         seg->str);
+  }
+
+  /* Variables in the command are expanded first */
+  err = pyg_unroll_expand(vars, seg->str, seg->len, &str, &len);
+  if (!pyg_is_ok(err))
+    return err;
 
-  str.str = input;
-  str.len = strlen(input);
-  err = pyg_unroll_calc_size(vars, &str, &size);
+  err = pyg_commands_run(cache->commands, cache->dir, str, len, &cmd);
+  free(str);
   if (!pyg_is_ok(err))
     return err;
 
-  /* Embed string in the structure */
+  *out = seg->type == kPygUnrollCommandList ? &cmd->list : &cmd->value;
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_unroll_prefetch(pyg_unroll_cache_t* cache,
+                                JSON_Value* value) {
+  pyg_error_t err;
+  size_t i;
+  size_t count;
+
+  switch (json_value_get_type(value)) {
+    case JSONString:
+      return pyg_unroll_prefetch_str(cache, json_value_get_string(value));
+    case JSONArray:
+      {
+        JSON_Array* arr;
+
+        arr = json_value_get_array(value);
+        count = json_array_get_count(arr);
+        for (i = 0; i < count; i++) {
+          err = pyg_unroll_prefetch(cache, json_array_get_value(arr, i));
+          if (!pyg_is_ok(err))
+            return err;
+        }
+      }
+      break;
+    case JSONObject:
+      {
+        JSON_Object* obj;
+
+        obj = json_value_get_object(value);
+        count = json_object_get_count(obj);
+        for (i = 0; i < count; i++) {
+          err = pyg_unroll_prefetch(cache, json_object_get_value_at(obj, i));
+          if (!pyg_is_ok(err))
+            return err;
+        }
+      }
+      break;
+    default:
+      break;
+  }
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_unroll_prefetch_str(pyg_unroll_cache_t* cache,
+                                    const char* str) {
+  pyg_error_t err;
+  pyg_unroll_ref_t ref;
+  const char* end;
+
+  end = str + strlen(str);
+  while (pyg_unroll_next(str, end, &ref) == 0) {
+    str = ref.close + 1;
+    if (ref.type == kPygUnrollVar || ref.type == kPygUnrollVarList)
+      continue;
+
+    /* Commands with variables have to wait for the scope */
+    if (pyg_unroll_next(ref.str, ref.close, NULL) == 0)
+      continue;
+
+    err = pyg_commands_submit(cache->commands,
+                              cache->dir,
+                              ref.str,
+                              ref.close - ref.str);
+    if (!pyg_is_ok(err))
+      return err;
+  }
+
+  return pyg_ok();
+}
+
+
+pyg_error_t pyg_unroll_build(pyg_unroll_template_t* t,
+                             pyg_value_t** values,
+                             char** out,
+                             unsigned int* out_len) {
+  unsigned int size;
+  unsigned int i;
+  unsigned int j;
+  char* res;
+  char* p;
+
+  /* Every value has its text at hand, only the size is needed */
+  size = t->literal_len;
+  for (j = 0; j < t->ref_count; j++) {
+    if (pyg_value_str(values[j]) == NULL)
+      return pyg_error_str(kPygErrNoMem, "Failed to format unroll value");
+    size += values[j]->len;
+  }
+
   res = malloc(size + 1);
   if (res == NULL)
     return pyg_error_str(kPygErrNoMem, "Failed to malloc() unroll result");
 
-  err = pyg_unroll_write(vars, &str, res);
-  if (!pyg_is_ok(err)) {
-    free(res);
-    return err;
+  p = res;
+  for (i = 0, j = 0; i < t->count; i++) {
+    pyg_unroll_seg_t* seg;
+
+    seg = &t->segs[i];
+    if (seg->type == kPygUnrollLiteral) {
+      memcpy(p, seg->str, seg->len);
+      p += seg->len;
+    } else {
+      memcpy(p, values[j]->str, values[j]->len);
+      p += values[j]->len;
+      j++;
+    }
   }
+  *p = '\0';
 
   *out = res;
+  *out_len = size;
   return pyg_ok();
 }
 
 
-pyg_error_t pyg_unroll_calc_size(pyg_proto_hashmap_t* vars,
-                                 pyg_str_t* str,
-                                 int* out) {
-  pyg_unroll_state_t st;
-  const char* p;
-  const char* end;
-  const char* mark;
-  int sz;
-
-  st = kPygUnrollLT;
-  sz = 0;
-  end = str->str + str->len;
-  for (p = str->str; p != end; p++, sz++) {
-    pyg_error_t err;
-    char ch;
-    pyg_value_t* value;
-    char* str_value;
-
-    ch = *p;
-    switch (st) {
-      case kPygUnrollLT:
-        if (ch != '<')
-          break;
-        st = kPygUnrollParenOpen;
-        break;
-      case kPygUnrollParenOpen:
-        if (ch != '(') {
-          st = kPygUnrollLT;
-        } else {
-          st = kPygUnrollName;
-          mark = p + 1;
-        }
-        break;
-      case kPygUnrollName:
-        if (ch != ')')
-          break;
-        st = kPygUnrollLT;
-        value = pyg_proto_hashmap_get(vars, mark, p - mark);
-        if (value == NULL) {
-          return pyg_error_str(kPygErrGYP,
-                               "variable `%.*s` not found",
-                               p - mark,
-                               mark);
-        }
+/*
+ * Results are keyed by the template and the identities of the values it
+ * references. Values are owned by the scopes of the same file and are not
+ * freed before the cache, so equal pointers always mean equal values.
+ *
+ * With `*out == NULL` - looks up the result, otherwise stores `*out`.
+ */
+pyg_error_t pyg_unroll_memo(pyg_unroll_cache_t* cache,
+                            pyg_unroll_template_t* t,
+                            pyg_value_t** values,
+                            const char** out) {
+  pyg_error_t err;
+  const void* inline_key[1 + PYG_UNROLL_INLINE];
+  const void** key;
+  unsigned int key_len;
+  uint64_t hash;
+  const char* res;
+
+  key = inline_key;
+  key_len = (1 + t->ref_count) * sizeof(*key);
+  if (t->ref_count > PYG_UNROLL_INLINE) {
+    key = malloc(key_len);
+    if (key == NULL)
+      return pyg_error_str(kPygErrNoMem, "Failed to malloc() unroll key");
+  }
 
-        err = pyg_value_to_str(value, &str_value);
-        if (!pyg_is_ok(err))
-          return err;
+  key[0] = t;
+  memcpy(&key[1], values, t->ref_count * sizeof(*values));
+  hash = pyg_hash((const char*) key, key_len);
 
-        sz -= (p - mark) + 3;
-        sz += strlen(str_value);
-        free(str_value);
-        break;
-    }
+  err = pyg_ok();
+  if (*out == NULL) {
+    res = pyg_hashmap_hget(&cache->results, (const char*) key, key_len, hash);
+    if (res != NULL)
+      cache->stats.hits++;
+    *out = res;
+  } else {
+    cache->stats.misses++;
+    err = pyg_hashmap_hinsert(&cache->results,
+                              (const char*) key,
+                              key_len,
+                              hash,
+                              (void*) *out);
+  }
+
+  if (key != inline_key)
+    free(key);
+  return err;
+}
+
+
+/* Without cache template is parsed into `scratch`, freed by the caller */
+pyg_error_t pyg_unroll_get_template(pyg_scope_t* vars,
+                                    const char* str,
+                                    unsigned int len,
+                                    pyg_arena_t* scratch,
+                                    pyg_unroll_template_t** out) {
+  pyg_error_t err;
+  pyg_unroll_cache_t* cache;
+  pyg_unroll_template_t* t;
+  uint64_t hash;
+
+  cache = vars->templates;
+  if (cache == NULL)
+    return pyg_unroll_parse(str, len, scratch, out);
+
+  hash = pyg_hash(str, len);
+  t = pyg_hashmap_hget(&cache->map, str, len, hash);
+  if (t != NULL) {
+    *out = t;
+    return pyg_ok();
   }
 
-  *out = sz;
+  err = pyg_unroll_parse(str, len, &cache->arena, &t);
+  if (!pyg_is_ok(err))
+    return err;
+  cache->stats.templates++;
+
+  /* Literal segments point into the copy, so it doubles as the key */
+  err = pyg_hashmap_hinsert(&cache->map,
+                            t->segs[t->count].str,
+                            len,
+                            hash,
+                            t);
+  if (!pyg_is_ok(err))
+    return err;
+
+  *out = t;
   return pyg_ok();
 }
 
 
-pyg_error_t pyg_unroll_write(pyg_proto_hashmap_t* vars,
-                             pyg_str_t* str,
-                             char* out) {
-  pyg_unroll_state_t st;
-  const char* p;
-  const char* end;
-  char* pout;
-  const char* mark;
-  int sz;
-
-  st = kPygUnrollLT;
-  sz = 0;
-  pout = out;
-  end = str->str + str->len;
-  for (p = str->str; p != end; p++, sz++) {
-    char ch;
-
-    ch = *p;
-    switch (st) {
-      case kPygUnrollLT:
-        if (ch != '<')
+/*
+ * Finds the next `<(name)`, `<@(name)`, `<!(command)` or `<!@(command)`
+ * (parens in the command should be balanced). Returns 0 if found, `ref` may
+ * be NULL.
+ */
+int pyg_unroll_next(const char* p, const char* end, pyg_unroll_ref_t* ref) {
+  while (p < end) {
+    pyg_unroll_seg_type_t type;
+    const char* str;
+    const char* close;
+    unsigned int depth;
+
+    p = memchr(p, '<', end - p);
+    if (p == NULL || end - p < 2)
+      return -1;
+
+    if (p[1] == '(' || (p[1] == '@' && end - p >= 3 && p[2] == '(')) {
+      type = p[1] == '(' ? kPygUnrollVar : kPygUnrollVarList;
+      str = type == kPygUnrollVar ? p + 2 : p + 3;
+      close = memchr(str, ')', end - str);
+      if (close == NULL)
+        return -1;
+    } else if (p[1] == '!' && end - p >= 3 && p[2] == '(') {
+      type = kPygUnrollCommand;
+      str = p + 3;
+    } else if (p[1] == '!' && end - p >= 4 && p[2] == '@' && p[3] == '(') {
+      type = kPygUnrollCommandList;
+      str = p + 4;
+    } else {
+      p++;
+      continue;
+    }
+
+    if (type == kPygUnrollCommand || type == kPygUnrollCommandList) {
+      depth = 1;
+      for (close = str; close < end; close++) {
+        if (*close == '(')
+          depth++;
+        else if (*close == ')' && --depth == 0)
           break;
-        st = kPygUnrollParenOpen;
+      }
+
+      /* Unbalanced, not a command */
+      if (close == end) {
+        p++;
         continue;
-      case kPygUnrollParenOpen:
-        if (ch != '(') {
-          *pout = '<';
-          pout++;
-          st = kPygUnrollLT;
-          break;
-        } else {
-          st = kPygUnrollName;
-          mark = p + 1;
-          continue;
-        }
-      case kPygUnrollName:
-        {
-          pyg_error_t err;
-          int len;
-          pyg_value_t* value;
-          char* str_value;
+      }
+    }
 
-          if (ch != ')')
-            continue;
+    if (ref != NULL) {
+      ref->type = type;
+      ref->start = p;
+      ref->str = str;
+      ref->close = close;
+    }
+    return 0;
+  }
 
-          value = pyg_proto_hashmap_get(vars, mark, p - mark);
-          assert(value != NULL);
+  return -1;
+}
 
-          err = pyg_value_to_str(value, &str_value);
-          if (!pyg_is_ok(err))
-            return err;
 
-          len = strlen(str_value);
-          memcpy(pout, str_value, len);
-          pout += len;
-          free(str_value);
+/*
+ * Template is followed by an extra segment holding the copy of input (not
+ * counted in `count`)
+ */
+pyg_error_t pyg_unroll_parse(const char* str,
+                             unsigned int len,
+                             pyg_arena_t* arena,
+                             pyg_unroll_template_t** out) {
+  pyg_unroll_template_t* t;
+  const char* p;
+  const char* end;
+  const char* copy;
+  unsigned int count;
+  unsigned int i;
+
+  /* Count segments first: at most a literal before each reference + tail */
+  count = 1;
+  end = str + len;
+  for (p = str; p < end; count += 2) {
+    pyg_unroll_ref_t ref;
+
+    if (pyg_unroll_next(p, end, &ref) != 0)
+      break;
+    p = ref.close + 1;
+  }
 
-          st = kPygUnrollLT;
-          /* Skip copying `)` */
-          continue;
-        }
+  t = pyg_arena_alloc(arena, sizeof(*t) + count * sizeof(*t->segs));
+  copy = pyg_arena_alloc(arena, len + 1);
+  if (t == NULL || copy == NULL)
+    return pyg_error_str(kPygErrNoMem, "pyg_unroll_template_t");
+  memcpy((char*) copy, str, len);
+  ((char*) copy)[len] = '\0';
+
+  t->literal_len = 0;
+  t->ref_count = 0;
+  i = 0;
+  end = copy + len;
+  for (p = copy; p < end;) {
+    pyg_unroll_ref_t ref;
+
+    if (pyg_unroll_next(p, end, &ref) != 0)
+      ref.start = end;
+
+    if (ref.start != p) {
+      t->segs[i].type = kPygUnrollLiteral;
+      t->segs[i].str = p;
+      t->segs[i].len = ref.start - p;
+      t->literal_len += ref.start - p;
+      i++;
     }
+    if (ref.start == end)
+      break;
+
+    t->segs[i].type = ref.type;
+    t->segs[i].str = ref.str;
+    t->segs[i].len = ref.close - ref.str;
+    t->segs[i].hash = pyg_hash(t->segs[i].str, t->segs[i].len);
+    t->ref_count++;
+    i++;
 
-    *pout = ch;
-    pout++;
+    p = ref.close + 1;
   }
-  *pout = '\0';
+  t->count = i;
+
+  t->segs[i].type = kPygUnrollLiteral;
+  t->segs[i].str = copy;
+  t->segs[i].len = len;
 
+  *out = t;
   return pyg_ok();
 }
@@ -1,13 +1,88 @@
 #ifndef SRC_UNROLL_H_
 #define SRC_UNROLL_H_
 
+#include "src/arena.h"
+#include "src/command.h"
 #include "src/common.h"
+#include "src/scope.h"
 
-pyg_error_t pyg_unroll_value(pyg_proto_hashmap_t* vars,
+#include "parson.h"
+
+typedef struct pyg_unroll_cache_s pyg_unroll_cache_t;
+typedef struct pyg_unroll_stats_s pyg_unroll_stats_t;
+
+struct pyg_unroll_stats_s {
+  /* Distinct strings parsed into templates */
+  unsigned int templates;
+
+  /* Lookups of `pyg_unroll_istr()` results */
+  unsigned int hits;
+  unsigned int misses;
+
+  /* Variables defined, and the ones that were used and expanded */
+  unsigned int variables;
+  unsigned int evaluated;
+};
+
+/*
+ * Parsed templates (literal spans and `<(name)` references) keyed by the
+ * input string. Every distinct string is scanned once, later expansions only
+ * look up variables and copy the pieces. Not thread-safe, one cache belongs
+ * to one .gyp file (see `pyg_scope_t.templates`).
+ */
+struct pyg_unroll_cache_s {
+  pyg_hashmap_t map;
+
+  /* Interned results keyed by template and referenced values */
+  pyg_hashmap_t results;
+
+  /* Templates and copies of their input strings */
+  pyg_arena_t arena;
+
+  /* Runs `<!(command)` in `dir`, NULL - commands are not allowed */
+  pyg_commands_t* commands;
+  const char* dir;
+
+  pyg_unroll_stats_t stats;
+};
+
+pyg_error_t pyg_unroll_cache_init(pyg_unroll_cache_t* cache);
+void pyg_unroll_cache_destroy(pyg_unroll_cache_t* cache);
+
+/*
+ * Submit every command of `value` (and of values nested in it) that does not
+ * depend on variables, so they run in background before being expanded
+ */
+pyg_error_t pyg_unroll_prefetch(pyg_unroll_cache_t* cache, JSON_Value* value);
+
+/* Adds counters of `cache` to `stats` */
+void pyg_unroll_stats(pyg_unroll_cache_t* cache, pyg_unroll_stats_t* stats);
+
+/* Text of the result is interned, lists are allocated and owned by caller */
+pyg_error_t pyg_unroll_value(pyg_scope_t* vars,
                              pyg_value_t* input,
-                             pyg_value_t** out);
-pyg_error_t pyg_unroll_str(pyg_proto_hashmap_t* vars,
+                             pyg_value_t* out);
+/*
+ * Expands `var` in the scope of its definition, once. Fails if expansion
+ * needs the value of `var` itself.
+ */
+pyg_error_t pyg_unroll_var(pyg_var_t* var, pyg_value_t** out);
+
+pyg_error_t pyg_unroll_str(pyg_scope_t* vars,
                            const char* input,
                            char** out);
 
+/* Same as `pyg_unroll_str()`, but the result is interned and memoized */
+pyg_error_t pyg_unroll_istr(pyg_scope_t* vars,
+                            const char* input,
+                            const char** out);
+
+/*
+ * If `input` is exactly `<@(name)` or `<!@(command)` of a list - the list,
+ * owned by the scope or the commands, otherwise NULL
+ */
+pyg_error_t pyg_unroll_list(pyg_scope_t* vars,
+                            const char* input,
+                            pyg_list_t** out);
+
 #endif  /* SRC_UNROLL_H_ */
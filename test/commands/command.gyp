@@ -0,0 +1,12 @@
+{
+  'variables': {
+    'name': '<!(echo one)',
+    'files': ['<!@(echo a.c b.c)'],
+  },
+  'targets': [{
+    'target_name': 'c',
+    'type': 'static_library',
+    'sources': ['<(name).c', '<@(files)'],
+    'cflags': ['<!@(printf "%s %s" -DX -DY)'],
+  }],
+}
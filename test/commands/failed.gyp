@@ -0,0 +1,10 @@
+{
+  'variables': {
+    'v': '<!(echo oops; exit 3)',
+  },
+  'targets': [{
+    'target_name': 'f',
+    'type': 'static_library',
+    'sources': ['<(v).c'],
+  }],
+}
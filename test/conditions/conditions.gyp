@@ -0,0 +1,26 @@
+{
+  'variables': {
+    'os': 'linux',
+    'arch': 'x64',
+    'level': 2,
+  },
+  'targets': [{
+    'target_name': 'c',
+    'type': 'static_library',
+    'sources': ['a.c'],
+    'conditions': [
+      ['not os == "win"', {'defines': ['NOT']}],
+      ['os in ("linux", "mac")', {'defines': ['IN_TUPLE']}],
+      ['os not in ["win", "android"]', {'defines': ['NOT_IN_LIST']}],
+      ['arch in ["arm", "arm64", "ia32", "mips", "mipsel", "ppc", "s390",'
+       ' "x64", "riscv64"]', {'defines': ['IN_HASHED']}],
+      ['(os == "mac" or os == "linux") and (level >= 2)',
+       {'defines': ['PARENS']}],
+      ['os == "mac" or level > 1 and arch == "x64"',
+       {'defines': ['PRECEDENCE']}],
+      ['os == "win" and undefined_var == 1', {'defines': ['AND_SKIPPED']}],
+      ['os == "linux" or undefined_var == 1', {'defines': ['OR_SKIPPED']}],
+      ['level < 2', {'defines': ['NO']}, {'defines': ['ELSE']}],
+    ],
+  }],
+}
@@ -0,0 +1,13 @@
+{
+  'variables': {
+    'os': 'linux',
+  },
+  'targets': [{
+    'target_name': 'u',
+    'type': 'static_library',
+    'sources': ['a.c'],
+    'conditions': [
+      ['os == "linux" and undefined_var == 1', {'defines': ['NO']}],
+    ],
+  }],
+}
@@ -0,0 +1,4 @@
+{
+  'includes': ['cycle-a.gypi'],
+  'targets': [],
+}
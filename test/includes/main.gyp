@@ -0,0 +1,18 @@
+{
+  'includes': ['common.gypi'],
+  'target_defaults': {
+    'defines': ['FROM_FILE'],
+    'sources': ['<(flavor).c'],
+  },
+  'targets': [{
+    'target_name': 'a',
+    'type': 'static_library',
+    'defines': ['OWN'],
+    'sources': ['a.c'],
+  }, {
+    'target_name': 'b',
+    'type': 'static_library',
+    'sources': ['b.c'],
+    'dependencies': ['a'],
+  }],
+}
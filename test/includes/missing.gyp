@@ -0,0 +1,4 @@
+{
+  'includes': ['nope.gypi'],
+  'targets': [],
+}
@@ -0,0 +1,19 @@
+{
+  'variables': {
+    'name': 'a',
+  },
+  'targets': [{
+    'target_name': 'a',
+    'type': 'static_library',
+    'sources': ['<(name).c'],
+    'dependencies': [
+      '../c/c.gyp:c',
+      '../d/d.gyp:d',
+    ],
+  }, {
+    'target_name': 'a_test',
+    'type': 'executable',
+    'sources': ['<(name).c'],
+    'dependencies': ['a'],
+  }],
+}
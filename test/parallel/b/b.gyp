@@ -0,0 +1,19 @@
+{
+  'variables': {
+    'name': 'b',
+  },
+  'targets': [{
+    'target_name': 'b',
+    'type': 'static_library',
+    'sources': ['<(name).c'],
+    'dependencies': [
+      '../c/c.gyp:c',
+      '../e/e.gyp:e',
+    ],
+  }, {
+    'target_name': 'b_test',
+    'type': 'executable',
+    'sources': ['<(name).c'],
+    'dependencies': ['b'],
+  }],
+}
@@ -0,0 +1,18 @@
+{
+  'variables': {
+    'name': 'c',
+  },
+  'targets': [{
+    'target_name': 'c',
+    'type': 'static_library',
+    'sources': ['<(name).c'],
+    'dependencies': [
+      '../e/e.gyp:e',
+    ],
+  }, {
+    'target_name': 'c_test',
+    'type': 'executable',
+    'sources': ['<(name).c'],
+    'dependencies': ['c'],
+  }],
+}
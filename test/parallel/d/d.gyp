@@ -0,0 +1,19 @@
+{
+  'variables': {
+    'name': 'd',
+  },
+  'targets': [{
+    'target_name': 'd',
+    'type': 'static_library',
+    'sources': ['<(name).c'],
+    'dependencies': [
+      '../e/e.gyp:e',
+      '../f/f.gyp:f',
+    ],
+  }, {
+    'target_name': 'd_test',
+    'type': 'executable',
+    'sources': ['<(name).c'],
+    'dependencies': ['d'],
+  }],
+}
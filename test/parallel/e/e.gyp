@@ -0,0 +1,17 @@
+{
+  'variables': {
+    'name': 'e',
+  },
+  'targets': [{
+    'target_name': 'e',
+    'type': 'static_library',
+    'sources': ['<(name).c'],
+    'dependencies': [
+    ],
+  }, {
+    'target_name': 'e_test',
+    'type': 'executable',
+    'sources': ['<(name).c'],
+    'dependencies': ['e'],
+  }],
+}
@@ -0,0 +1,17 @@
+{
+  'variables': {
+    'name': 'f',
+  },
+  'targets': [{
+    'target_name': 'f',
+    'type': 'static_library',
+    'sources': ['<(name).c'],
+    'dependencies': [
+    ],
+  }, {
+    'target_name': 'f_test',
+    'type': 'executable',
+    'sources': ['<(name).c'],
+    'dependencies': ['f'],
+  }],
+}
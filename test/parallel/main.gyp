@@ -0,0 +1,12 @@
+{
+  'targets': [{
+    'target_name': 'main',
+    'type': 'executable',
+    'sources': ['main.c'],
+    'dependencies': [
+      'a/a.gyp:a',
+      'b/b.gyp:b',
+      'f/f.gyp:f',
+    ],
+  }],
+}
@@ -0,0 +1,8 @@
+{
+  'targets': [{
+    'target_name': 'bad',
+    'type': 'static_library',
+    'sources': ['a.c'],
+    'defines': ['B=bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb'],
+  }],
+}
@@ -0,0 +1,8 @@
+﻿# Starts with UTF-8 BOM
+{
+  "targets": [{
+    "target_name": "bom",
+    "type": "static_library",
+    "sources": ["a.c"],
+  }],
+}
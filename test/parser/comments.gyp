@@ -0,0 +1,14 @@
+# Python-style comments, trailing commas and single quotes
+{
+  'targets': [{  # after a value
+    'target_name': 'comments',
+    'type': 'static_library',
+    # between keys
+    'defines': [
+      'HASH=#kept',  # `#` inside a string is not a comment
+      "MIXED='q'",
+    ],
+    'sources': ['a.c',],
+  },],
+}
+# at the end
@@ -0,0 +1,16 @@
+{
+  'targets': [{
+    'target_name': 'escapes',
+    'type': 'static_library',
+    'defines': [
+      'QUOTE=\"q\"',
+      "APOS=\'a\'",
+      'HEX=\x41\x42',
+      'UNKNOWN=\d',
+      'ADJACENT=' 'a' "b",
+      'CONT=a\
+b',
+    ],
+    'sources': ['a.c'],
+  }],
+}
@@ -0,0 +1,50 @@
+{
+  'targets': [{
+    'target_name': 'long',
+    'type': 'static_library',
+    'sources': ['a.c'],
+    'defines': [
+     'L0=\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	'L1=x\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	'L2=xx\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	'L3=xxx\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	'L4=xxxx\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	'L5=xxxxx\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	'L6=xxxxxx\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	'L7=xxxxxxx\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	'L8=xxxxxxxx\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	'L9=xxxxxxxxx\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	'L10=xxxxxxxxxx\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	'L11=xxxxxxxxxxx\'yyyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	'L12=xxxxxxxxxxxx\'yyyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	'L13=xxxxxxxxxxxxx\'yyyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	 	'L14=xxxxxxxxxxxxxx\'yyyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	 	 	'L15=xxxxxxxxxxxxxxx\'yyyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	'L16=xxxxxxxxxxxxxxxx\'yyyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	'L17=xxxxxxxxxxxxxxxxx\'yyyyyyyyyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	'L18=xxxxxxxxxxxxxxxxxx\'yyyyyyyyyyyyyyyyyyyyyy',
+     'L19=xxxxxxxxxxxxxxxxxxx\'yyyyyyyyyyyyyyyyyyyyy',
+      	'L20=xxxxxxxxxxxxxxxxxxxx\'yyyyyyyyyyyyyyyyyyyy',
+      	 	'L21=xxxxxxxxxxxxxxxxxxxxx\'yyyyyyyyyyyyyyyyyyy',
+      	 	 	'L22=xxxxxxxxxxxxxxxxxxxxxx\'yyyyyyyyyyyyyyyyyy',
+      	 	 	 	'L23=xxxxxxxxxxxxxxxxxxxxxxx\'yyyyyyyyyyyyyyyyy',
+      	 	 	 	 	'L24=xxxxxxxxxxxxxxxxxxxxxxxx\'yyyyyyyyyyyyyyyy',
+      	 	 	 	 	 	'L25=xxxxxxxxxxxxxxxxxxxxxxxxx\'yyyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	'L26=xxxxxxxxxxxxxxxxxxxxxxxxxx\'yyyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	'L27=xxxxxxxxxxxxxxxxxxxxxxxxxxx\'yyyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	'L28=xxxxxxxxxxxxxxxxxxxxxxxxxxxx\'yyyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	'L29=xxxxxxxxxxxxxxxxxxxxxxxxxxxxx\'yyyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	'L30=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\'yyyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	'L31=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\'yyyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	'L32=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\'yyyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	 	'L33=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\'yyyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	 	 	'L34=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\'yyyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	'L35=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\'yyyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	'L36=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\'yyyy',
+      	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	'L37=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\'yyy',
+     'L38=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\'yy',
+      	'L39=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\'y',
+      'Q="qqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqq\\"rrrrrrrrrrrrrrrrrrrrrrrrrrrrrrr"',
+    ],
+  }],
+}
@@ -0,0 +1,42 @@
+{
+  'targets': [{
+    'target_name': 'utf8',
+    'type': 'static_library',
+    'sources': ['a.c'],
+    'defines': [
+      'U0=é€😀',
+      'U1=aé€😀',
+      'U2=aaé€😀',
+      'U3=aaaé€😀',
+      'U4=aaaaé€😀',
+      'U5=aaaaaé€😀',
+      'U6=aaaaaaé€😀',
+      'U7=aaaaaaaé€😀',
+      'U8=aaaaaaaaé€😀',
+      'U9=aaaaaaaaaé€😀',
+      'U10=aaaaaaaaaaé€😀',
+      'U11=aaaaaaaaaaaé€😀',
+      'U12=aaaaaaaaaaaaé€😀',
+      'U13=aaaaaaaaaaaaaé€😀',
+      'U14=aaaaaaaaaaaaaaé€😀',
+      'U15=aaaaaaaaaaaaaaaé€😀',
+      'U16=aaaaaaaaaaaaaaaaé€😀',
+      'U17=aaaaaaaaaaaaaaaaaé€😀',
+      'U18=aaaaaaaaaaaaaaaaaaé€😀',
+      'U19=aaaaaaaaaaaaaaaaaaaé€😀',
+      'U20=aaaaaaaaaaaaaaaaaaaaé€😀',
+      'U21=aaaaaaaaaaaaaaaaaaaaaé€😀',
+      'U22=aaaaaaaaaaaaaaaaaaaaaaé€😀',
+      'U23=aaaaaaaaaaaaaaaaaaaaaaaé€😀',
+      'U24=aaaaaaaaaaaaaaaaaaaaaaaaé€😀',
+      'U25=aaaaaaaaaaaaaaaaaaaaaaaaaé€😀',
+      'U26=aaaaaaaaaaaaaaaaaaaaaaaaaaé€😀',
+      'U27=aaaaaaaaaaaaaaaaaaaaaaaaaaaé€😀',
+      'U28=aaaaaaaaaaaaaaaaaaaaaaaaaaaaé€😀',
+      'U29=aaaaaaaaaaaaaaaaaaaaaaaaaaaaaé€😀',
+      'U30=aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaé€😀',
+      'U31=aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaé€😀',
+      'U32=aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaé€😀',
+    ],
+  }],
+}
@@ -0,0 +1,13 @@
+# Every missing source is reported at once, even in missing directories
+{
+  'targets': [{
+    'target_name': 'strict',
+    'type': 'static_library',
+    'sources': [
+      'nodir1/x.c',
+      'nodir2/y.c',
+      'missing.c',
+      'a.c',
+    ],
+  }],
+}
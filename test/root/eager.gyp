@@ -0,0 +1,13 @@
+{
+  'targets': [{
+    'target_name': 'app',
+    'type': 'executable',
+    'sources': ['app.c'],
+    'dependencies': ['shared.gyp:used'],
+  }, {
+    # Never reached from `app`, fails if materialized
+    'target_name': 'tool',
+    'type': 'executable',
+    'sources': ['<(undefined_tool_var).c'],
+  }],
+}
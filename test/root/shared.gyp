@@ -0,0 +1,20 @@
+{
+  'targets': [{
+    'target_name': 'used',
+    'type': 'static_library',
+    'sources': ['used.c'],
+  }, {
+    # Nobody depends on these, both fail if materialized
+    'target_name': 'broken_condition',
+    'type': 'static_library',
+    'sources': ['used.c'],
+    'conditions': [
+      ['undefined_var == 1', {'defines': ['NO']}],
+    ],
+  }, {
+    'target_name': 'broken_dependency',
+    'type': 'static_library',
+    'sources': ['missing.c'],
+    'dependencies': ['nowhere.gyp:nothing'],
+  }],
+}
@@ -0,0 +1,157 @@
+#!/bin/sh
+# Runs pyg on every `<name>.gyp` of test/*/ that has `<name>.out` next to it,
+# and compares the output (or the error) with it:
+#
+#   test/run.sh [path/to/pyg]
+#
+# Extra arguments for a fixture are read from `<name>.args`. With UPDATE=1
+# the `.out` files are rewritten instead. Every fixture is run again with
+# `-j 8`, which should not change a byte, and with `--parse-cache` and
+# `--command-cache`, cold, warm and after `touch`, where only the cold run
+# should write cache entries.
+
+pyg=${1:-build/pyg}
+pyg="$(cd "$(dirname "$pyg")" && pwd)/$(basename "$pyg")"
+root="$(cd "$(dirname "$0")" && pwd)"
+tmp="$(mktemp -d)"
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+run() {
+  dir=$1
+  name=$2
+  shift 2
+  args=
+  if [ -f "$dir/$name.args" ]; then
+    args=$(cat "$dir/$name.args")
+  fi
+  (cd "$dir" && "$pyg" $args "$@" "$name.gyp" 2>&1) | sed "s|$dir/||g"
+}
+
+check() {
+  if [ "$2" != "$3" ]; then
+    echo "FAIL $1"
+    printf '%s\n' "$2" > "$tmp/expected"
+    printf '%s\n' "$3" > "$tmp/actual"
+    diff -u "$tmp/expected" "$tmp/actual" | head -20
+    failed=1
+  fi
+}
+
+for out in "$root"/*/*.out; do
+  dir=$(dirname "$out")
+  name=$(basename "$out" .out)
+  actual=$(run "$dir" "$name")
+
+  if [ -n "$UPDATE" ]; then
+    printf '%s\n' "$actual" > "$out"
+    continue
+  fi
+  check "$name" "$(cat "$out")" "$actual"
+  check "$name (-j 8)" "$actual" "$(run "$dir" "$name" -j 8)"
+
+  # Every scanning kernel should parse the same, avx2 falls back to sse2 on
+  # CPUs without it (see src/scan.h)
+  if [ "$(basename "$dir")" = parser ]; then
+    for scan in scalar sse2 avx2; do
+      check "$name (PYG_SCAN=$scan)" "$actual" \
+            "$(PYG_SCAN=$scan; export PYG_SCAN; run "$dir" "$name")"
+    done
+  fi
+
+  cache="$tmp/cache-$name"
+  mkdir -p "$cache"
+  check "$name (cold cache)" "$actual" \
+        "$(run "$dir" "$name" --parse-cache "$cache" --command-cache)"
+  ls -i "$cache" > "$tmp/entries"
+  check "$name (warm cache)" "$actual" \
+        "$(run "$dir" "$name" --parse-cache "$cache" --command-cache)"
+  check "$name (cache entries)" "$(cat "$tmp/entries")" "$(ls -i "$cache")"
+
+  # Touched, but not modified - entries are matched by the content hash
+  touch "$dir/$name.gyp"
+  check "$name (touched)" "$actual" \
+        "$(run "$dir" "$name" --parse-cache "$cache" --command-cache)"
+  check "$name (touched entries)" "$(cat "$tmp/entries")" "$(ls -i "$cache")"
+done
+
+# Cache entry of a multiple of the page size is read into a buffer instead
+# of being mapped, it should still be reused
+dir="$tmp/page-entry"
+mkdir -p "$dir/cache"
+touch "$dir/a.c"
+page_gyp() {
+  printf "{'variables': {'pad': '%s'}, 'targets': [{'target_name': 'p', \
+'type': 'static_library', 'sources': ['a.c']}]}\n" "$1" > "$dir/p.gyp"
+}
+page_gyp ""
+run "$dir" p --parse-cache "$dir/cache" > /dev/null
+size=$(cat "$dir"/cache/*.pygc | wc -c)
+page=$(getconf PAGESIZE)
+page_gyp "$(head -c $(( (page - size % page) % page )) /dev/zero | tr '\0' x)"
+rm -f "$dir"/cache/*.pygc
+expected=$(run "$dir" p)
+check "page-sized entry (cold cache)" "$expected" \
+      "$(run "$dir" p --parse-cache "$dir/cache")"
+check "page-sized entry (size)" 0 \
+      "$(( $(cat "$dir"/cache/*.pygc | wc -c) % page ))"
+ls -i "$dir/cache" > "$tmp/entries"
+check "page-sized entry (warm cache)" "$expected" \
+      "$(run "$dir" p --parse-cache "$dir/cache")"
+check "page-sized entry (cache entries)" "$(cat "$tmp/entries")" \
+      "$(ls -i "$dir/cache")"
+
+# Cached command output should follow the files it reads and the environment
+dir="$tmp/command-entry"
+mkdir -p "$dir/cache"
+touch "$dir/one-x.c" "$dir/two-x.c" "$dir/two-y.c"
+printf "{'variables': {'v': '<!(cat <v.txt)', 'e': '<!(echo \$PYGTEST)'}, \
+'targets': [{'target_name': 'c', 'type': 'static_library', \
+'sources': ['<(v)-<(e).c']}]}\n" > "$dir/c.gyp"
+command_run() {
+  run "$dir" c --parse-cache "$dir/cache" --command-cache | grep '_0.o:'
+}
+echo one > "$dir/v.txt"
+check "command entry (cold)" "build build/0/c/one-x_0.o: cc_c_0 one-x.c" \
+      "$(PYGTEST=x command_run)"
+echo two > "$dir/v.txt"
+check "command entry (input)" "build build/0/c/two-x_0.o: cc_c_0 two-x.c" \
+      "$(PYGTEST=x command_run)"
+check "command entry (environment)" \
+      "build build/0/c/two-y_0.o: cc_c_0 two-y.c" \
+      "$(PYGTEST=y command_run)"
+
+# Beyond 64 inputs a change to the last one would go unnoticed, so such
+# commands are not cached at all
+i=0
+files=
+while [ $i -lt 70 ]; do
+  i=$((i + 1))
+  touch "$dir/in$i.txt"
+  files="$files in$i.txt"
+done
+printf "{'variables': {'v': '<!(cat $files)'}, 'targets': [{'target_name': \
+'m', 'type': 'static_library', 'sources': ['<(v).c']}]}\n" > "$dir/m.gyp"
+touch "$dir/many.c" "$dir/more.c"
+many_run() {
+  run "$dir" m --parse-cache "$dir/cache" --command-cache | grep '_0.o:'
+}
+echo many > "$dir/in70.txt"
+check "command entry (many inputs)" \
+      "build build/0/m/many_0.o: cc_m_0 many.c" "$(many_run)"
+echo more > "$dir/in70.txt"
+check "command entry (last of many inputs)" \
+      "build build/0/m/more_0.o: cc_m_0 more.c" "$(many_run)"
+
+# Without io_uring, paths are checked by a pool of stat(2) threads
+check "strict (PYG_IO_URING=0)" "$(cat "$root/paths/strict.out")" \
+      "$(PYG_IO_URING=0; export PYG_IO_URING; run "$root/paths" strict)"
+
+# Only positive thread counts are accepted
+for jobs in -1 0 abc 4x; do
+  check "-j $jobs" "Invalid -j \`$jobs\`, expected a positive number" \
+        "$("$pyg" -j "$jobs" "$root/a.gyp" 2>&1 | head -1)"
+done
+
+[ $failed -eq 0 ] && echo "OK"
+exit $failed
@@ -0,0 +1,12 @@
+{
+  'variables': {
+    'x': '<(y)',
+    'y': '<(z)',
+    'z': '<(x)',
+  },
+  'targets': [{
+    'target_name': 'c',
+    'type': 'static_library',
+    'sources': ['<(x).c'],
+  }],
+}
@@ -0,0 +1,13 @@
+{
+  'variables': {
+    'base': ['a.c', 'b.c'],
+    'more': ['<@(base)', 'c.c'],
+    'flags': ['-O2', '-g'],
+  },
+  'targets': [{
+    'target_name': 's',
+    'type': 'static_library',
+    'sources': ['<@(more)'],
+    'cflags': ['-Wall', '<@(flags)'],
+  }],
+}
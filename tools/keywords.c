@@ -0,0 +1,326 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Generates perfect hash lookup of keywords (see src/keywords.list):
+ *
+ *   keywords <list> <prefix>
+ *
+ * writes `<prefix>.h` with `pyg_keyword_t` enum and `<prefix>.c` with the
+ * table. Seed is searched until every keyword gets a slot of its own, so
+ * lookup is a single hash, compare of the length, and `memcmp()`.
+ *
+ * NOTE: Hash must match `pyg_keyword()` emitted below.
+ */
+
+typedef struct pyg_kw_s pyg_kw_t;
+
+struct pyg_kw_s {
+  char* str;
+  unsigned int len;
+  char* name;
+};
+
+static const unsigned int kPygKwMaxCount = 256;
+static const unsigned int kPygKwMaxSeed = 1000000;
+
+static int pyg_kw_read(const char* path, pyg_kw_t* list, unsigned int* count);
+static uint32_t pyg_kw_hash(const char* str, unsigned int len, uint32_t seed);
+static int pyg_kw_place(pyg_kw_t* list,
+                        unsigned int count,
+                        unsigned int size,
+                        uint32_t seed,
+                        int* table);
+static int pyg_kw_write_header(const char* path,
+                               pyg_kw_t* list,
+                               unsigned int count);
+static int pyg_kw_write_source(const char* path,
+                               const char* header,
+                               pyg_kw_t* list,
+                               unsigned int count,
+                               unsigned int size,
+                               uint32_t seed,
+                               int* table);
+
+
+int main(int argc, char** argv) {
+  pyg_kw_t list[256];
+  unsigned int count;
+  unsigned int size;
+  uint32_t seed;
+  int* table;
+  char header[1024];
+  char source[1024];
+  const char* base;
+
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <list> <prefix>\n", argv[0]);
+    return 1;
+  }
+
+  if (pyg_kw_read(argv[1], list, &count) != 0)
+    return 1;
+
+  snprintf(header, sizeof(header), "%s.h", argv[2]);
+  snprintf(source, sizeof(source), "%s.c", argv[2]);
+
+  /* Start with load factor of 1/2, grow if no seed fits */
+  for (size = 1; size < count * 2; size <<= 1) {
+  }
+
+  for (;;) {
+    table = malloc(size * sizeof(*table));
+    if (table == NULL) {
+      fprintf(stderr, "Failed to allocate table\n");
+      return 1;
+    }
+
+    for (seed = 1; seed < kPygKwMaxSeed; seed++)
+      if (pyg_kw_place(list, count, size, seed, table) == 0)
+        break;
+    if (seed < kPygKwMaxSeed)
+      break;
+
+    free(table);
+    size <<= 1;
+  }
+
+  /* Header is included relative to the repository root */
+  base = strstr(header, "src/");
+  if (base == NULL)
+    base = header;
+
+  if (pyg_kw_write_header(header, list, count) != 0 ||
+      pyg_kw_write_source(source, base, list, count, size, seed, table) != 0) {
+    free(table);
+    return 1;
+  }
+
+  free(table);
+  return 0;
+}
+
+
+int pyg_kw_read(const char* path, pyg_kw_t* list, unsigned int* count) {
+  FILE* f;
+  char line[1024];
+  unsigned int i;
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return -1;
+  }
+
+  *count = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char* str;
+    char* name;
+
+    str = strtok(line, " \t\r\n");
+    if (str == NULL || str[0] == '#')
+      continue;
+
+    name = strtok(NULL, " \t\r\n");
+    if (name == NULL) {
+      fprintf(stderr, "No enum name for `%s`\n", str);
+      goto fail;
+    }
+
+    /* Emitted as C string literal without escaping */
+    if (strpbrk(str, "\"\\") != NULL) {
+      fprintf(stderr, "Invalid keyword `%s`\n", str);
+      goto fail;
+    }
+
+    if (*count == kPygKwMaxCount) {
+      fprintf(stderr, "Too many keywords\n");
+      goto fail;
+    }
+
+    for (i = 0; i < *count; i++) {
+      if (strcmp(list[i].str, str) == 0 || strcmp(list[i].name, name) == 0) {
+        fprintf(stderr, "Duplicate keyword `%s` (%s)\n", str, name);
+        goto fail;
+      }
+    }
+
+    list[*count].str = strdup(str);
+    list[*count].len = strlen(str);
+    list[*count].name = strdup(name);
+    if (list[*count].str == NULL || list[*count].name == NULL) {
+      fprintf(stderr, "Failed to allocate keyword\n");
+      goto fail;
+    }
+    (*count)++;
+  }
+
+  fclose(f);
+  return 0;
+
+fail:
+  fclose(f);
+  return -1;
+}
+
+
+uint32_t pyg_kw_hash(const char* str, unsigned int len, uint32_t seed) {
+  uint32_t h;
+  unsigned int i;
+
+  h = seed ^ len;
+  for (i = 0; i < len; i++)
+    h = (h ^ (uint8_t) str[i]) * 0x01000193;
+  return h ^ (h >> 15);
+}
+
+
+int pyg_kw_place(pyg_kw_t* list,
+                 unsigned int count,
+                 unsigned int size,
+                 uint32_t seed,
+                 int* table) {
+  unsigned int i;
+
+  for (i = 0; i < size; i++)
+    table[i] = -1;
+
+  for (i = 0; i < count; i++) {
+    uint32_t slot;
+
+    slot = pyg_kw_hash(list[i].str, list[i].len, seed) & (size - 1);
+    if (table[slot] != -1)
+      return -1;
+    table[slot] = i;
+  }
+
+  return 0;
+}
+
+
+int pyg_kw_write_header(const char* path, pyg_kw_t* list, unsigned int count) {
+  FILE* f;
+  unsigned int i;
+
+  f = fopen(path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return -1;
+  }
+
+  fprintf(f,
+          "/* Generated by tools/keywords.c from src/keywords.list */\n"
+          "#ifndef SRC_KEYWORDS_H_\n"
+          "#define SRC_KEYWORDS_H_\n"
+          "\n"
+          "#include <string.h>\n"
+          "\n"
+          "enum pyg_keyword_e {\n"
+          "  kPygKwUnknown,\n");
+  for (i = 0; i < count; i++)
+    fprintf(f, "  kPygKw%s,\n", list[i].name);
+  fprintf(f,
+          "\n"
+          "  kPygKwCount\n"
+          "};\n"
+          "typedef enum pyg_keyword_e pyg_keyword_t;\n"
+          "\n"
+          "/* `kPygKwUnknown` if `str` is not a keyword */\n"
+          "pyg_keyword_t pyg_keyword(const char* str, unsigned int len);\n"
+          "\n"
+          "#define pyg_ckeyword(s) pyg_keyword((s), strlen((s)))\n"
+          "\n"
+          "#endif  /* SRC_KEYWORDS_H_ */\n");
+
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+
+int pyg_kw_write_source(const char* path,
+                        const char* header,
+                        pyg_kw_t* list,
+                        unsigned int count,
+                        unsigned int size,
+                        uint32_t seed,
+                        int* table) {
+  FILE* f;
+  unsigned int i;
+  unsigned int max_len;
+
+  f = fopen(path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return -1;
+  }
+
+  max_len = 0;
+  for (i = 0; i < count; i++)
+    if (list[i].len > max_len)
+      max_len = list[i].len;
+
+  fprintf(f,
+          "/* Generated by tools/keywords.c from src/keywords.list */\n"
+          "#include \"%s\"\n"
+          "\n"
+          "#include <stdint.h>\n"
+          "#include <string.h>\n"
+          "\n"
+          "typedef struct pyg_keyword_slot_s pyg_keyword_slot_t;\n"
+          "\n"
+          "struct pyg_keyword_slot_s {\n"
+          "  const char* str;\n"
+          "  unsigned int len;\n"
+          "  pyg_keyword_t keyword;\n"
+          "};\n"
+          "\n"
+          "static const uint32_t kPygKeywordSeed = %uU;\n"
+          "static const unsigned int kPygKeywordMaxLen = %u;\n"
+          "\n"
+          "static const pyg_keyword_slot_t kPygKeywordTable[%u] = {\n",
+          header,
+          (unsigned int) seed,
+          max_len,
+          size);
+
+  for (i = 0; i < size; i++) {
+    if (table[i] == -1) {
+      fprintf(f, "  { \"\", 0, kPygKwUnknown },\n");
+      continue;
+    }
+
+    fprintf(f,
+            "  { \"%s\", %u, kPygKw%s },\n",
+            list[table[i]].str,
+            list[table[i]].len,
+            list[table[i]].name);
+  }
+
+  fprintf(f,
+          "};\n"
+          "\n"
+          "\n"
+          "pyg_keyword_t pyg_keyword(const char* str, unsigned int len) {\n"
+          "  const pyg_keyword_slot_t* slot;\n"
+          "  uint32_t h;\n"
+          "  unsigned int i;\n"
+          "\n"
+          "  if (len > kPygKeywordMaxLen)\n"
+          "    return kPygKwUnknown;\n"
+          "\n"
+          "  h = kPygKeywordSeed ^ len;\n"
+          "  for (i = 0; i < len; i++)\n"
+          "    h = (h ^ (uint8_t) str[i]) * 0x01000193;\n"
+          "  h ^= h >> 15;\n"
+          "\n"
+          "  slot = &kPygKeywordTable[h & %uU];\n"
+          "  if (slot->len != len || memcmp(slot->str, str, len) != 0)\n"
+          "    return kPygKwUnknown;\n"
+          "\n"
+          "  return slot->keyword;\n"
+          "}\n",
+          size - 1);
+
+  return fclose(f) == 0 ? 0 : -1;
+}